@@ -0,0 +1,309 @@
+##
+## AutoTune.pm
+##
+## Finds good values for the performance related options of Config.pm
+## (vector_width, mpi_ghostzone_width, partition) on the current machine.
+## Variants of the application are generated, built and timed on a
+## reduced grid. The fastest configuration is written back into the
+## .cactus_inf.rc file.
+##
+
+package Cactusinterfacing::AutoTune;
+
+use strict;
+use warnings;
+use Exporter 'import';
+use Cactusinterfacing::Config qw(%cinf_config);
+use Cactusinterfacing::Utils qw(util_readFile util_writeFile util_mkdir
+								util_rmdir _err _warn vprint);
+use Cactusinterfacing::CreateLibgeodecompApp qw(createLibgeodecompApp);
+
+# exports
+our @EXPORT_OK = qw(autoTune);
+
+# size of the reduced grid in each direction and number of time steps
+my $tune_size  = 64;
+my $tune_steps = 20;
+
+#
+# Builds the parameter file for the tuning runs out of the given one.
+# The grid size and the number of iterations are replaced by the reduced
+# ones and the output is switched off.
+#
+# param:
+#  - parfile: parameter file given by the user
+#  - out_ref: ref to array where to store the new parameter file
+#
+# return:
+#  - none, parameter file will be stored in out_ref
+#
+sub buildTuningParFile
+{
+	my ($parfile, $out_ref) = @_;
+	my (@lines);
+
+	util_readFile($parfile, \@lines);
+
+	foreach my $line (@lines) {
+		next if ($line =~ /^\s*driver::(global|local)_n(size|x|y|z)\s*=/i);
+		next if ($line =~ /^\s*cactus::cctk_itlast\s*=/i);
+		next if ($line =~ /^\s*iohdf5::out_every\s*=/i);
+		push(@$out_ref, $line);
+	}
+
+	push(@$out_ref, "\n");
+	push(@$out_ref, "# reduced grid for auto-tuning\n");
+	push(@$out_ref, "driver::global_nsize = $tune_size\n");
+	push(@$out_ref, "cactus::cctk_itlast  = $tune_steps\n");
+	push(@$out_ref, "iohdf5::out_every    = " . ($tune_steps + 1) . "\n");
+
+	return;
+}
+
+#
+# Gets the dimension of the generated cell from its stencil.
+#
+# param:
+#  - dir: directory of generated application
+#
+# return:
+#  - dimension of cell
+#
+sub getCellDim
+{
+	my ($dir) = @_;
+	my (@lines);
+
+	util_readFile("$dir/cell.h", \@lines);
+
+	foreach my $line (@lines) {
+		return $1 if ($line =~ /Stencils::Moore<(\d+),/);
+	}
+
+	return 3;
+}
+
+#
+# Gets the number of cores, assuming a linux system.
+#
+# param:
+#  - none
+#
+# return:
+#  - number of cores, at least 1
+#
+sub numCPUs
+{
+	my ($fh, $n);
+
+	$n = 0;
+	if (open($fh, "<", "/proc/cpuinfo")) {
+		while (my $line = <$fh>) {
+			++$n if ($line =~ /^processor/);
+		}
+		close $fh;
+	}
+
+	return $n > 0 ? $n : 1;
+}
+
+#
+# Gets the time per step of a tuning run. It is printed by the PerfSteerer
+# (perf_counters = 1) and covers only the steps, not the start up,
+# initialization and output.
+#
+# param:
+#  - log: output of the run
+#
+# return:
+#  - seconds per step, 0 if not found
+#
+sub getStepTime
+{
+	my ($log) = @_;
+	my (@lines);
+
+	util_readFile($log, \@lines);
+
+	foreach my $line (@lines) {
+		return $1 / 1e3 if ($line =~ /^\s*time\s*:\s*([\d.eE+-]+) ms per step/);
+	}
+
+	return 0;
+}
+
+#
+# Generates, builds and runs one variant of the application. The variant
+# is built with perf_counters = 1, so only the time of the steps is used.
+#
+# param:
+#  - config_ref: ref to config hash
+#  - var_ref   : ref to hash of options for this variant
+#  - dir       : directory where to store the variant
+#  - par_ref   : ref to array containing tuning parameter file
+#
+# return:
+#  - MLUPS of tuning run, 0 if build or run failed
+#
+sub runVariant
+{
+	my ($config_ref, $var_ref, $dir, $par_ref) = @_;
+	my (%saved, %config, $appdir, $bin, $cmd, $seconds, $dim);
+
+	# generate code with the options of this variant
+	%saved  = %cinf_config;
+	%config = %{$config_ref};
+	$config{"outputdir"} = $dir;
+	$cinf_config{$_} = $var_ref->{$_} for (keys %{$var_ref});
+	# level 2 would add system calls to every line
+	$cinf_config{"perf_counters"} = 1;
+	createLibgeodecompApp(\%config);
+	%cinf_config = %saved;
+
+	# build it
+	$appdir = "$dir/" . $config_ref->{"config"};
+	$bin    = "./cactus_" . $config_ref->{"config"};
+	if (system("make -j" . numCPUs() . " -C $appdir > $appdir/build.log 2>&1") != 0) {
+		_warn("Build of variant in $appdir failed, see $appdir/build.log");
+		return 0;
+	}
+	util_writeFile($par_ref, "$appdir/tune.par");
+
+	# run it
+	$cmd   = $config_ref->{"force_mpi"} ?
+		($ENV{"MPIRUN"} || "mpirun") . " -np " . numCPUs() . " $bin" : $bin;
+	if (system("cd $appdir && $cmd tune.par > run.log 2>&1") != 0) {
+		_warn("Run of variant in $appdir failed, see $appdir/run.log");
+		return 0;
+	}
+	$seconds = getStepTime("$appdir/run.log");
+	$dim     = getCellDim($appdir);
+	unless ($seconds > 0) {
+		_warn("No time per step found in $appdir/run.log");
+		return 0;
+	}
+
+	# the whole grid is updated once per step
+	return $tune_size ** $dim / $seconds / 1e6;
+}
+
+#
+# Writes the tuned options into the .cactus_inf.rc file. Existing lines
+# for these options and the report of a previous run are replaced, all
+# other lines are kept.
+#
+# param:
+#  - best_ref  : ref to hash of tuned options
+#  - report_ref: ref to array of report lines
+#
+# return:
+#  - none
+#
+sub writeConfiguration
+{
+	my ($best_ref, $report_ref) = @_;
+	my ($file, @lines, @out, $in_report);
+
+	_err("HOME is not set, cannot write .cactus_inf.rc")
+		unless (defined $ENV{"HOME"});
+
+	$file = "$ENV{HOME}/.cactus_inf.rc";
+	util_readFile($file, \@lines) if (-r $file);
+
+	$in_report = 0;
+	foreach my $line (@lines) {
+		$in_report = 1 if ($line =~ /^# autotune begin/);
+		if ($in_report) {
+			$in_report = 0 if ($line =~ /^# autotune end/);
+			next;
+		}
+		next if ($line =~ /^\s*(\w+)\s*=/ && exists $best_ref->{$1});
+		push(@out, $line);
+	}
+
+	push(@out, "# autotune begin\n");
+	push(@out, "# $_\n") for (@$report_ref);
+	push(@out, "$_ = $best_ref->{$_}\n") for (sort keys %{$best_ref});
+	push(@out, "# autotune end\n");
+
+	util_writeFile(\@out, $file);
+
+	return;
+}
+
+#
+# Runs the auto-tuning. The options are tuned one after another, each
+# one starting from the best values found so far:
+#  - vectorization off or vector_width 2, 4, 8, 16
+#  - mpi_ghostzone_width 1, 2 and 3 (MPI only)
+#  - partition (MPI only)
+# ghostzone_width is the stencil radius of the thorn and the topology
+# changes the boundary behaviour, so neither one is tuned.
+#
+# param:
+#  - config_ref: ref to config hash as used by createLibgeodecompApp
+#  - parfile   : Cactus parameter file used for the tuning runs
+#
+# return:
+#  - none, results will be written to .cactus_inf.rc
+#
+sub autoTune
+{
+	my ($config_ref, $parfile) = @_;
+	my ($tunedir, $n, $best_mlups, @par, @stages, %best, @report);
+
+	_err("Cannot read parameter file $parfile") unless (-r $parfile);
+
+	# init
+	$tunedir = $config_ref->{"outputdir"} . "/autotune";
+	util_rmdir($tunedir) if     (-d $tunedir);
+	util_mkdir($tunedir) unless (-d $tunedir);
+	buildTuningParFile($parfile, \@par);
+
+	@stages = (
+		[ { use_vectorization => 0 },
+		  map { +{ use_vectorization => 1, vector_width => $_ } } (2, 4, 8, 16) ],
+	);
+	if ($config_ref->{"force_mpi"}) {
+		push(@stages, [ map { +{ mpi_ghostzone_width => $_ } } (1, 2, 3) ]);
+		push(@stages, [ map { +{ partition => $_ } } qw(RecursiveBisection ZCurve Striping) ]);
+	}
+
+	$n          = 0;
+	$best_mlups = 0;
+	foreach my $stage (@stages) {
+		my (%stage_best);
+
+		foreach my $variant (@$stage) {
+			my (%options, $mlups, $desc);
+
+			%options = (%best, %{$variant});
+			$desc    = join(" ", map { "$_=$options{$_}" } sort keys %options);
+			vprint("Auto-tuning: $desc");
+			$mlups = runVariant($config_ref, \%options, "$tunedir/" . $n++, \@par);
+			push(@report, sprintf("%10.2f MLUPS: %s", $mlups, $desc));
+			if ($mlups > $best_mlups) {
+				$best_mlups = $mlups;
+				%stage_best = %options;
+			}
+		}
+		%best = %stage_best if (%stage_best);
+	}
+
+	_err("No variant could be built and run, see logs in $tunedir")
+		unless ($best_mlups > 0);
+
+	# vector_width is only meaningful with vectorization
+	$best{"vector_width"} = $cinf_config{"vector_width"}
+		unless (exists $best{"vector_width"});
+	unshift(@report, "grid $tune_size^dim, $tune_steps steps, best " .
+			sprintf("%.2f", $best_mlups) . " MLUPS");
+
+	print "$_\n" for (@report);
+	writeConfiguration(\%best, \@report);
+	vprint("Auto-tuning done, wrote result to $ENV{HOME}/.cactus_inf.rc");
+
+	return;
+}
+
+1;
@@ -68,6 +68,138 @@ BEGIN
 	my $use_vectorization = 0;
 	my $vector_width = 8;
 
+	# handling of the unaligned head and the tail of each line if
+	# vectorization is used:
+	#  - scalar : both are computed with scalar code
+	#  - overlap: both are computed as one unaligned full vector, which
+	#             overlaps the aligned part of the line. Points in the
+	#             overlap are computed twice, so evolution functions which
+	#             read variables they write still use scalar code.
+	# Lines shorter than vector_width are always computed with scalar code.
+	my $loop_peeling = "scalar";
+
+	# precision of CCTK_REAL (and CCTK_COMPLEX) in the generated application:
+	#  - double: CCTK_REAL is CCTK_REAL8, like in Cactus
+	#  - single: CCTK_REAL is CCTK_REAL4, which halves the memory traffic.
+	#            The vector width above is given for double precision and
+	#            gets doubled, since twice as many floats fit into a register.
+	my $real_precision = "double";
+
+	# partition used for distributing the grid among MPI ranks
+	# valid partitions are:
+	#  - RecursiveBisection
+	#  - ZCurve
+	#  - Striping
+	my $partition = "RecursiveBisection";
+
+	# load balancer used by the MPI application, the balancing period
+	# can be given in the parameter file by libgeodecomp::load_balancing_period
+	# valid load balancers are:
+	#  - none
+	#  - Ooze (balances by measured per rank step time)
+	# Thorns whose evolution code uses cctk_lsh, cctk_lbnd, cctk_ubnd or
+	# cctk_bbox are refused with a balancer, since these are set up once
+	# per rank from its initial region.
+	my $load_balancer = "none";
+
+	# ghostzone width used by the MPI application for exchanging halos,
+	# this is the number of time steps between two ghostzone
+	# synchronizations. The inner region of each rank is updated while the
+	# halos are in flight, so a wider ghostzone hides more latency at the
+	# cost of redundant computation on the rim.
+	my $mpi_ghostzone_width = 1;
+
+	# past timelevels which should be stored in single precision, given as
+	# space separated list of Cactus names, e.g. "phi_p_p". Only timelevels
+	# with at least two _p are allowed, since the first past timelevel shares
+	# its storage with the current one. Values are converted on every read.
+	my $float_timelevels = "";
+
+	# evaluate the initial data in parallel using OpenMP, the bounding box
+	# is split into slabs along the last axis and each thread runs the init
+	# function(s) on its own slab. Only use this if the initial data is
+	# computed pointwise, i.e. it does not read neighbouring grid points.
+	my $parallel_init = 0;
+
+	# fuse evolution functions into one function making a single pass over
+	# each line. Functions not ordered by the schedule are fused if they
+	# access disjoint variables, dependent ones if all variables shared
+	# between them are only accessed at the center point of the line. The
+	# timelevel rotation is fused into the last function, if possible.
+	my $fuse_functions = 1;
+
+	# iterate the grid in tiles of y-z lines instead of plain y-z order,
+	# so neighbouring lines are reused while still in cache. The tile size
+	# is picked by a short auto-tuning run at startup and recorded in the
+	# file tiling.cache in the working directory for later runs.
+	# Only used by the serial (non MPI) application for 3D thorns.
+	my $tiling = 0;
+
+	# precompile LibGeoDecomp and the cctk includes once (pch.h.gch) instead
+	# of parsing them for every object, needs g++
+	my $precompiled_header = 1;
+
+	# cpu the generated code is tuned for, passed as -march to the compiler,
+	# e.g. native. Empty means no -march at all, so the binary stays portable.
+	my $march = "";
+
+	# default memory limit per rank in MiB, the application prints an estimate
+	# of its memory usage at startup and refuses to run if it exceeds the
+	# limit. Estimates for ZCurve or a load balancer are approximate and
+	# never refuse a run. Can be changed by libgeodecomp::memory_limit in
+	# the parameter file. 0 means no limit.
+	my $memory_limit = 0;
+
+	# padding added to the SoA row (x) and plane (y) sizes of the grid
+	# storage, which are powers of two from 32 to 4096 otherwise. Avoids
+	# cache-set aliasing on power-of-two grids. 0 keeps plain powers of two.
+	my $soa_padding = 0;
+
+	# number of ensemble members, i.e. runs of the same thorn with different
+	# parameters, which are evolved together in one grid. Every cell member
+	# is stored ensemble_size times (var_name, var_name_e1, ...). Parameters
+	# can be set per member by thorn::name[member] in the parameter file,
+	# output is written per member. With use_vectorization the members
+	# share the SIMD lanes: the kernels compute one point of all members
+	# at once, lane k holds member k, which needs ensemble_size = 2, 4, 8
+	# or 16 (vector_width is not used then). Only real parameters may
+	# differ between members then. Without vectorization updateLineX
+	# advances the members line by line. See scripts/test.sh --ensemble
+	# for the benchmark. 1 disables the ensemble mode.
+	my $ensemble_size = 1;
+
+	# page policy for large allocations (the grids), see
+	# src/types/memorypolicy.h:
+	#  - default: normal pages
+	#  - thp:     transparent huge pages requested by madvise()
+	#  - hugetlb: explicit 2 MiB huge pages, falls back to thp
+	my $memory_policy = "default";
+
+	# NUMA node the grids are bound to, -1 leaves the placement to the kernel
+	my $numa_node = -1;
+
+	# directory on a fast local disk (e.g. NVMe) for out-of-core runs. If
+	# set, the grids are backed by files in this directory and streamed
+	# through a window of RAM, so grids larger than the memory of a node
+	# can be computed. Empty disables it.
+	my $out_of_core_dir = "";
+
+	# size of that window in MiB. It is grown at runtime to hold the planes
+	# read by the stencil, the RAM used for the grids stays below it.
+	my $out_of_core_window = 1024;
+
+	# hardware performance counters (cycles, instructions, LLC misses) read by
+	# perf_event_open(), see src/steerer/perfcounters.h:
+	#  - 0: disabled
+	#  - 1: per step, summary with IPC, bytes/cell and bandwidth at the end
+	#  - 2: also per evol function, adds system calls to every line
+	my $perf_counters = 0;
+
+	# measure bandwidth and peak flops at startup and report the achieved
+	# MLUPS as percentage of the roofline bound at the end, see
+	# src/steerer/roofline.h
+	my $roofline = 0;
+
 	################################################################################
 	# Configuration section ends here                                              #
 	################################################################################
@@ -76,7 +208,14 @@ BEGIN
 	my @allowed_options = ('debug', 'verbose', 'tab', 'use_astyle',
 						   'astyle_options', 'topology', 'scalar',
 						   'ghostzone_width', 'use_vectorization',
-						   'vector_width');
+						   'vector_width', 'partition', 'load_balancer',
+						   'mpi_ghostzone_width', 'float_timelevels',
+						   'parallel_init', 'fuse_functions', 'tiling',
+						   'precompiled_header', 'march', 'memory_limit',
+						   'soa_padding', 'loop_peeling',
+						   'real_precision', 'ensemble_size',
+						   'memory_policy', 'numa_node', 'out_of_core_dir',
+						   'out_of_core_window', 'perf_counters', 'roofline');
 
 	#
 	# Checks the values specified by the user above.
@@ -90,7 +229,12 @@ BEGIN
 	sub checkConfiguration
 	{
 		my ($ret, $debug, $tab, $topology, $ghostzone_width, $use_astyle,
-			$use_vectorization, $vector_width);
+			$use_vectorization, $vector_width, $partition, $load_balancer,
+			$mpi_ghostzone_width, $float_timelevels, $parallel_init,
+			$fuse_functions, $tiling, $precompiled_header, $march,
+			$memory_limit, $soa_padding, $loop_peeling, $real_precision,
+			$ensemble_size, $memory_policy, $numa_node, $out_of_core_dir,
+			$out_of_core_window, $perf_counters, $roofline);
 
 		$debug             = $cinf_config{"debug"};
 		$tab               = $cinf_config{"tab"};
@@ -99,6 +243,26 @@ BEGIN
 		$use_astyle        = $cinf_config{"use_astyle"};
 		$use_vectorization = $cinf_config{"use_vectorization"};
 		$vector_width      = $cinf_config{"vector_width"};
+		$partition         = $cinf_config{"partition"};
+		$load_balancer     = $cinf_config{"load_balancer"};
+		$mpi_ghostzone_width = $cinf_config{"mpi_ghostzone_width"};
+		$float_timelevels  = $cinf_config{"float_timelevels"};
+		$parallel_init     = $cinf_config{"parallel_init"};
+		$fuse_functions    = $cinf_config{"fuse_functions"};
+		$tiling            = $cinf_config{"tiling"};
+		$precompiled_header = $cinf_config{"precompiled_header"};
+		$march             = $cinf_config{"march"};
+		$memory_limit      = $cinf_config{"memory_limit"};
+		$soa_padding       = $cinf_config{"soa_padding"};
+		$loop_peeling      = $cinf_config{"loop_peeling"};
+		$real_precision    = $cinf_config{"real_precision"};
+		$ensemble_size     = $cinf_config{"ensemble_size"};
+		$memory_policy     = $cinf_config{"memory_policy"};
+		$numa_node         = $cinf_config{"numa_node"};
+		$out_of_core_dir   = $cinf_config{"out_of_core_dir"};
+		$out_of_core_window = $cinf_config{"out_of_core_window"};
+		$perf_counters     = $cinf_config{"perf_counters"};
+		$roofline          = $cinf_config{"roofline"};
 		$ret               = 1;
 
 		# check general options
@@ -109,6 +273,28 @@ BEGIN
 		$ret = 0 if ($use_astyle !~ /^\d+$/);
 		$ret = 0 if ($use_vectorization !~ /^\d+$/);
 		$ret = 0 if ($vector_width !~ /^\d+$/);
+		$ret = 0 if ($partition !~ /^(RecursiveBisection|ZCurve|Striping)$/);
+		$ret = 0 if ($load_balancer !~ /^(none|Ooze)$/);
+		$ret = 0 if ($mpi_ghostzone_width !~ /^[1-9]\d*$/);
+		$ret = 0 if (grep { $_ !~ /^\w+?(_p){2,}$/ } split(' ', $float_timelevels));
+		$ret = 0 if ($parallel_init !~ /^\d+$/);
+		$ret = 0 if ($fuse_functions !~ /^\d+$/);
+		$ret = 0 if ($tiling !~ /^\d+$/);
+		$ret = 0 if ($precompiled_header !~ /^\d+$/);
+		$ret = 0 if ($march !~ /^[\w\-]*$/);
+		$ret = 0 if ($memory_limit !~ /^\d+$/);
+		$ret = 0 if ($soa_padding !~ /^\d+$/);
+		$ret = 0 if ($loop_peeling !~ /^(scalar|overlap)$/);
+		$ret = 0 if ($real_precision !~ /^(single|double)$/);
+		$ret = 0 if ($ensemble_size !~ /^[1-9]\d*$/);
+		# one lane per member
+		$ret = 0 if ($use_vectorization && $ensemble_size !~ /^(1|2|4|8|16)$/);
+		$ret = 0 if ($memory_policy !~ /^(default|thp|hugetlb)$/);
+		$ret = 0 if ($numa_node !~ /^(-1|\d+)$/);
+		$ret = 0 if ($out_of_core_dir !~ /^[\w\-\/.]*$/);
+		$ret = 0 if ($out_of_core_window !~ /^[1-9]\d*$/);
+		$ret = 0 if ($perf_counters !~ /^[012]$/);
+		$ret = 0 if ($roofline !~ /^[01]$/);
 
 		return $ret;
 	}
@@ -136,6 +322,26 @@ BEGIN
 			ghostzone_width   => $ghostzone_width,
 			use_vectorization => $use_vectorization,
 			vector_width      => $vector_width,
+			partition         => $partition,
+			load_balancer     => $load_balancer,
+			mpi_ghostzone_width => $mpi_ghostzone_width,
+			float_timelevels  => $float_timelevels,
+			parallel_init     => $parallel_init,
+			fuse_functions    => $fuse_functions,
+			tiling            => $tiling,
+			precompiled_header => $precompiled_header,
+			march             => $march,
+			memory_limit      => $memory_limit,
+			soa_padding       => $soa_padding,
+			loop_peeling      => $loop_peeling,
+			real_precision    => $real_precision,
+			ensemble_size     => $ensemble_size,
+			memory_policy     => $memory_policy,
+			numa_node         => $numa_node,
+			out_of_core_dir   => $out_of_core_dir,
+			out_of_core_window => $out_of_core_window,
+			perf_counters     => $perf_counters,
+			roofline          => $roofline,
 		   );
 
 		return;
@@ -178,6 +384,9 @@ BEGIN
 			next if ($line =~ /^\s*#/);
 			# parse line
 			($option, $value) = $line =~ /^\s*(\w+)\s*=\s*([\w\- ]+)\s*$/;
+			# paths are only allowed for out_of_core_dir
+			($option, $value) = $line =~ /^\s*(out_of_core_dir)\s*=\s*([\w\-\/.]+)\s*$/
+				unless (defined $option);
 			# syntax error
 			unless (defined $option) {
 				print STDERR "[WARNING " . __FILE__ . ":" . __LINE__ . "]: " .
@@ -16,9 +16,10 @@ use Cactusinterfacing::Parameter qw(getParameters generateParameterMacro
 									buildParameterStrings);
 use Cactusinterfacing::Interface qw(getInterfaceVars buildInterfaceStrings
 									containsMixedTypes);
-use Cactusinterfacing::Libgeodecomp qw(getCoordZero generateSoAMacro
+use Cactusinterfacing::Libgeodecomp qw(getCoordZero generateSoAMacro getSoAMembers
 									   getGFIndexFirst getFixedCoordZero
-									   getLoopPeeler);
+									   getLoopPeeler getStorageType getEnsembleNames
+									   getEnsemblePointer getPerfCalls useLanes);
 use Cactusinterfacing::CreateStaticDataClass qw(createStaticDataClass);
 
 # exports
@@ -45,7 +46,7 @@ sub getDimension
 	$dim = -1;
 
 	# look for dimensions and find maximum
-	foreach my $key (keys %{$inf_ref}) {
+	foreach my $key (sort keys %{$inf_ref}) {
 		next if ($inf_ref->{$key}{"gtype"} =~ /^SCALAR$/i);
 		next if ($inf_ref->{$key}{"gtype"} =~ /^ARRAY$/i);
 
@@ -117,7 +118,7 @@ sub buildFunctionWithTL
 		push(@$out_ref, @lines);
 	}
 
-	push(@$out_ref, "\n");
+	push(@$out_ref, "\n") if (@rotate);
 	push(@$out_ref, @rotate);
 	push(@$out_ref, "}\n");
 
@@ -244,6 +245,12 @@ sub buildSpecialMacros
 # Static data is hold in a separate class called "staticData". This is
 # why these macros define parameter names into staticData.name. An example:
 #  - #define bound staticData.bound
+# In ensemble mode every member has its own parameters:
+#  - #define bound staticData.bound[ensembleMember]
+# If the members share the lanes (see useLanes()) real parameters are
+# loaded into the lanes, all others have to be the same for all members:
+#  - #define amplitude (vecLanes<DOUBLE>(staticData.amplitude))
+#  - #define bound staticData.bound[0]
 #
 # param:
 #  - par_ref  : ref to parameter hash
@@ -256,10 +263,20 @@ sub buildSpecialMacros
 sub buildParameterMacros
 {
 	my ($par_ref, $def_ref, $undef_ref) = @_;
+	my ($member);
+
+	# init
+	$member = $cinf_config{"ensemble_size"} > 1 ? "[ensembleMember]" : "";
 
-	foreach my $name (keys %{$par_ref}) {
+	foreach my $name (sort keys %{$par_ref}) {
 		# build define and undefines
-		push(@$def_ref,   "#define $name staticData.$name\n");
+		if (useLanes() && $par_ref->{$name}{"type"} eq "CCTK_REAL") {
+			push(@$def_ref, "#define $name (vecLanes<DOUBLE>(staticData.$name))\n");
+		} elsif (useLanes()) {
+			push(@$def_ref, "#define $name staticData.$name"."[0]\n");
+		} else {
+			push(@$def_ref, "#define $name staticData.$name$member\n");
+		}
 		push(@$undef_ref, "#undef $name\n");
 	}
 
@@ -293,7 +310,7 @@ sub buildInfVarMacros
 	$dim = $val_ref->{"dim"};
 
 	# go
-	foreach my $group (keys %{$inf_ref}) {
+	foreach my $group (sort keys %{$inf_ref}) {
 		my ($gtype, $timelevels);
 
 		# init
@@ -308,7 +325,7 @@ sub buildInfVarMacros
 			my ($i);
 
 			# for the first timelevel hoodNew is used
-			push(@$def_ref  , "#define $name (&hoodNew.var_$name())\n");
+			push(@$def_ref  , "#define $name (" . getEnsemblePointer("&hoodNew.var_$name()") . ")\n");
 			push(@$undef_ref, "#undef $name\n");
 
 			# for all other timelevels hoodOld
@@ -319,9 +336,8 @@ sub buildInfVarMacros
 				$var_name    = "var_" . $name . ("_p" x ($i - 1));
 				$fixed_coord = getFixedCoordZero($dim);
 
-				push(@$def_ref, "#define $past_name (&hoodOld[".
-						 $fixed_coord . "].".
-						 $var_name . "())\n");
+				push(@$def_ref, "#define $past_name (" .
+						 getEnsemblePointer("&hoodOld[$fixed_coord].$var_name()") . ")\n");
 				push(@$undef_ref, "#undef $past_name\n");
 			}
 		}
@@ -332,7 +348,8 @@ sub buildInfVarMacros
 
 #
 # Generates object constructions for vector objects representing the
-# grid variables.
+# grid variables. If the ensemble members share the lanes (see
+# useLanes()) the objects gather lane k from member k.
 #
 # param:
 #  - val_ref: ref to hash where macros will be stored
@@ -352,7 +369,7 @@ sub buildVectorObjects
 	$arity = "DOUBLE::ARITY";
 
 	# go
-	foreach my $group (keys %{$inf_ref}) {
+	foreach my $group (sort keys %{$inf_ref}) {
 		my ($gtype, $vtype, $timelevels);
 
 		# init
@@ -368,19 +385,35 @@ sub buildVectorObjects
 			my ($i);
 
 			# for the first timelevel hoodNew is used
-			push(@$obj_ref, $tab.$tab."VecWrite<$vtype, $arity> $name(&hoodNew.var_$name());\n");
+			if (useLanes()) {
+				my @lanes = getEnsembleNames("&hoodNew.var_$name");
+
+				push(@$obj_ref, $tab.$tab."VecScatter<$vtype, $arity> $name;\n");
+				push(@$obj_ref, $tab.$tab."$name.lane($_, $lanes[$_]());\n") for (0 .. $#lanes);
+			} else {
+				push(@$obj_ref, $tab.$tab."VecWrite<$vtype, $arity> $name(" .
+					 getEnsemblePointer("&hoodNew.var_$name()") . ");\n");
+			}
 
 			# for all other timelevels hoodOld
 			for ($i = 1; $i < $timelevels; ++$i) {
-				my ($past_name, $var_name, $fixed_coord);
+				my ($past_name, $var_name, $fixed_coord, $storage);
 
 				$past_name   = "$name" . ("_p" x $i);
 				$var_name    = "var_" . $name . ("_p" x ($i - 1));
 				$fixed_coord = getFixedCoordZero($dim);
+				$storage     = getStorageType($vtype, $name, $i - 1);
+				$storage     = $storage ne $vtype ? ", $storage" : "";
+
+				if (useLanes()) {
+					my @lanes = getEnsembleNames("&hoodOld[$fixed_coord].$var_name");
 
-				push(@$obj_ref, $tab.$tab."VecRead<$vtype, $arity> $past_name(&hoodOld[" .
-						 $fixed_coord . "]." .
-						 $var_name . "());\n");
+					push(@$obj_ref, $tab.$tab."VecGather<$vtype, $arity$storage> $past_name;\n");
+					push(@$obj_ref, $tab.$tab."$past_name.lane($_, $lanes[$_]());\n") for (0 .. $#lanes);
+				} else {
+					push(@$obj_ref, $tab.$tab."VecRead<$vtype, $arity$storage> $past_name(" .
+						 getEnsemblePointer("&hoodOld[$fixed_coord].$var_name()") . ");\n");
+				}
 			}
 		}
 	}
@@ -388,6 +421,27 @@ sub buildVectorObjects
 	return;
 }
 
+#
+# Turns the local variables of type CCTK_REAL of an evolution function
+# into vectors, if the ensemble members share the lanes. They may depend
+# on parameters, which differ from lane to lane. Pointers stay as they are.
+# Locals of other types have to be the same for all members.
+#
+# param:
+#  - body_ref: ref to array of evol function
+#
+# return:
+#  - none, body_ref is modified
+#
+sub promoteRealLocals
+{
+	my ($body_ref) = @_;
+
+	s/^(\s*(?:const\s+)?)CCTK_REAL(\s+(?!\*)\w)/$1DOUBLE$2/ for (@$body_ref);
+
+	return;
+}
+
 #
 # Builds cell's static updateLineX function using vectorization.
 # The actual evolution function will be created seperately and gets
@@ -407,8 +461,8 @@ sub buildVectorObjects
 sub buildUpdateFunctionsWithVec
 {
 	my ($evol_ref, $val_ref, $inf_ref) = @_;
-	my (@keys, @linex, @linex_body, @objects, @func_names,
-		$linex_proto, $linex_temp, $type);
+	my (@keys, @linex, @linex_body, @objects, @func_names, @rotate_body,
+		%scalar, $linex_proto, $linex_temp, $type, $member);
 
 	# check if we can build with vectorization
 	_err("Cannot build with vectorization, since the interface data contains " .
@@ -416,6 +470,8 @@ sub buildUpdateFunctionsWithVec
 		if (containsMixedTypes($inf_ref));
 	$type = scalar (keys %{$inf_ref}) ?
 		$inf_ref->{(keys %{$inf_ref})[0]}{"vtype"} : "CCTK_REAL";
+	# functions are called once per ensemble member, unless they share the lanes
+	$member = $cinf_config{"ensemble_size"} > 1 && !useLanes() ? ", int ensembleMember" : "";
 
 	# check functions
 	@keys = keys %{$evol_ref};
@@ -426,15 +482,21 @@ sub buildUpdateFunctionsWithVec
 
 	# build all evol functions
 	foreach my $func (@keys) {
-		my (@func_body, @evol, $func_proto, $func_temp);
+		my (@func_body, @evol, %reads, %writes, $func_proto, $func_temp);
 		# build function
 		@func_body = @{$evol_ref->{$func}{"data"}};
 
+		# overlapping peeling computes points twice, which is only
+		# correct if the function doesn't read what it writes
+		getReadWriteSets($inf_ref, join("\n", @func_body), \%reads, \%writes);
+		$scalar{$evol_ref->{$func}{"name"}} = 1 if (grep { $reads{$_} } keys %writes);
+
 		adjustEvolutionFunction($inf_ref, $val_ref, \@func_body);
+		promoteRealLocals(\@func_body) if (useLanes());
 		push(@objects, "\n");
 		unshift(@func_body, @objects);
 
-		$func_proto = "static void $func(long indexStart, long indexEnd, ACCESSOR1& hoodOld, ACCESSOR2& hoodNew)";
+		$func_proto = "static void $func(long indexStart, long indexEnd, ACCESSOR1& hoodOld, ACCESSOR2& hoodNew$member)";
 		$func_temp  = "template<typename DOUBLE, typename ACCESSOR1, typename ACCESSOR2>";
 		buildFunctionWithTL($val_ref, $inf_ref, \@func_body, $func_proto, \@evol, $func_temp, 1)
 			if (@keys == 1);
@@ -446,12 +508,12 @@ sub buildUpdateFunctionsWithVec
 	}
 
 	# build rotate timelevels as separate function
-	if (@keys > 1) {
-		my (@rotate, @rotate_body, $rot_proto, $rot_temp);
+	getRotateTimelevels($inf_ref, $val_ref, \@rotate_body) if (@keys > 1);
+	if (@rotate_body) {
+		my (@rotate, $rot_proto, $rot_temp);
 
-		getRotateTimelevels($inf_ref, $val_ref, \@rotate_body);
 		$_ = $_ . "\n" for (@rotate_body);
-		$rot_proto = "static void rotateTimelevels(long indexStart, long indexEnd, ACCESSOR1& hoodOld, ACCESSOR2& hoodNew)";
+		$rot_proto = "static void rotateTimelevels(long indexStart, long indexEnd, ACCESSOR1& hoodOld, ACCESSOR2& hoodNew$member)";
 		$rot_temp  = "template<typename DOUBLE, typename ACCESSOR1, typename ACCESSOR2>";
 		util_buildFunction(\@rotate_body, $rot_proto, \@rotate, $rot_temp, 1);
 
@@ -461,13 +523,9 @@ sub buildUpdateFunctionsWithVec
 	# build updateLineX by using loop peeling code
 	$linex_proto = "static void updateLineX(ACCESSOR1& hoodOld, int indexEnd, ACCESSOR2& hoodNew, int /* nanoStep */)";
 	$linex_temp  = "template<typename ACCESSOR1, typename ACCESSOR2>";
-	getLoopPeeler($type, \@func_names, \@linex_body);
 	# also call separate time levels function
-	if (@keys > 1) {
-		push(@linex_body, $tab.$tab."rotateTimelevels<ScalarType>(0, nextStop, hoodOld, hoodNew);");
-		push(@linex_body, $tab.$tab."rotateTimelevels<ShortVecType>(nextStop, indexEnd, hoodOld, hoodNew);");
-		push(@linex_body, $tab.$tab."rotateTimelevels<ScalarType>(last, indexEnd, hoodOld, hoodNew);");
-	}
+	getLoopPeeler($type, [@func_names, @rotate_body ? ("rotateTimelevels") : ()],
+				  \@linex_body, \%scalar);
 	util_buildFunction(\@linex_body, $linex_proto, \@linex, $linex_temp, 1);
 
 	$val_ref->{"update_linex"} = join("", @linex);
@@ -478,7 +536,9 @@ sub buildUpdateFunctionsWithVec
 #
 # Builds cell's static updateLineX function. If more than one function for
 # evolution is given, then every function will be build separately and just
-# called in updateLineX in given order.
+# called in updateLineX in given order. In ensemble mode this is done for
+# a single function, too, and updateLineX calls the functions for every
+# ensemble member.
 #
 # param:
 #  - evol_ref: ref to hash where evolution function(s) is/are stored
@@ -493,13 +553,15 @@ sub buildUpdateFunctionsWithVec
 sub buildUpdateFunctions
 {
 	my ($evol_ref, $val_ref, $inf_ref) = @_;
-	my (@keys);
+	my (@keys, $ensemble, $member);
 
 	# init
-	@keys = keys %{$evol_ref};
+	@keys     = keys %{$evol_ref};
+	$ensemble = $cinf_config{"ensemble_size"} > 1;
+	$member   = $ensemble ? ", int ensembleMember" : "";
 
 	# one function -> just build updateLineX
-	if (@keys == 1) {
+	if (@keys == 1 && !$ensemble) {
 		my (@body, @evol, $temp, $proto, $func);
 
 		# get function
@@ -509,6 +571,17 @@ sub buildUpdateFunctions
 		# adjust evol function for updateLine
 		adjustEvolutionFunction($inf_ref, $val_ref, \@body);
 
+		# out-of-core grids are streamed through a window, see memorypolicy.h
+		unshift(@body, "advanceWindow(hoodOld, hoodNew);\n")
+			if ($cinf_config{"out_of_core_dir"} ne "");
+
+		# updateLineX is the evol function, so the scope covers all of it
+		if ($cinf_config{"perf_counters"} > 1) {
+			unshift(@body, "PerfScope perfScope(0, \"$func\");\n");
+		} elsif ($cinf_config{"perf_counters"}) {
+			unshift(@body, "PerfCounters::thread();\n");
+		}
+
 		# build function
 		$proto = "static void updateLineX(ACCESSOR1& hoodOld, int indexEnd, ACCESSOR2& hoodNew, int /* nanoStep */)";
 		$temp  = "template<typename ACCESSOR1, typename ACCESSOR2>";
@@ -517,10 +590,10 @@ sub buildUpdateFunctions
 
 		# build final string
 		$val_ref->{"update_linex"} = join("", @evol);
-	} elsif (@keys > 1) {
+	} elsif (@keys >= 1) {
 		# more functions -> build and call them
-		my (@linex, @linex_body, @rotate, @rotate_body,
-			$rot_proto, $rot_temp, $linex_proto, $linex_temp);
+		my (@linex, @linex_body, @calls, @rotate, @rotate_body,
+			$rot_proto, $rot_temp, $linex_proto, $linex_temp, $args);
 
 		# build each function
 		foreach my $func (@keys) {
@@ -533,7 +606,7 @@ sub buildUpdateFunctions
 			adjustEvolutionFunction($inf_ref, $val_ref, \@body);
 
 			# build function
-			$proto = "static void $func(ACCESSOR1& hoodOld, int indexEnd, ACCESSOR2& hoodNew)";
+			$proto = "static void $func(ACCESSOR1& hoodOld, int indexEnd, ACCESSOR2& hoodNew$member)";
 			$temp  = "template<typename ACCESSOR1, typename ACCESSOR2>";
 
 			util_buildFunction(\@body, $proto, \@evol, $temp, 1);
@@ -542,22 +615,32 @@ sub buildUpdateFunctions
 			push(@{$val_ref->{"evol_funcs"}}, join("", @evol));
 		}
 
-		# build rotate timelevels
+		# build rotate timelevels, if not done by the evolution functions
 		getRotateTimelevels($inf_ref, $val_ref, \@rotate_body);
-		$_ = $_ . "\n" for (@rotate_body);
-		$rot_proto = "static void rotateTimelevels(ACCESSOR1& hoodOld, int indexEnd, ACCESSOR2& hoodNew)";
-		$rot_temp  = "template<typename ACCESSOR1, typename ACCESSOR2>";
+		if (@rotate_body) {
+			$_ = $_ . "\n" for (@rotate_body);
+			$rot_proto = "static void rotateTimelevels(ACCESSOR1& hoodOld, int indexEnd, ACCESSOR2& hoodNew$member)";
+			$rot_temp  = "template<typename ACCESSOR1, typename ACCESSOR2>";
 
-		util_buildFunction(\@rotate_body, $rot_proto, \@rotate, $rot_temp, 1);
-		push(@{$val_ref->{"evol_funcs"}}, join("", @rotate));
+			util_buildFunction(\@rotate_body, $rot_proto, \@rotate, $rot_temp, 1);
+			push(@{$val_ref->{"evol_funcs"}}, join("", @rotate));
+		}
 
 		# build updateLineX
 		$linex_proto = "static void updateLineX(ACCESSOR1& hoodOld, int indexEnd, ACCESSOR2& hoodNew, int /* nanoStep */)";
 		$linex_temp  = "template<typename ACCESSOR1, typename ACCESSOR2>";
-		for my $func (@keys) {
-			push(@linex_body, $func."(hoodOld, indexEnd, hoodNew);\n");
+		$args        = $ensemble ? "hoodOld, indexEnd, hoodNew, ensembleMember" : "hoodOld, indexEnd, hoodNew";
+		push(@calls, "PerfCounters::thread();") if ($cinf_config{"perf_counters"});
+		push(@calls, "advanceWindow(hoodOld, hoodNew);") if ($cinf_config{"out_of_core_dir"} ne "");
+		push(@calls, "for (int ensembleMember = 0; ensembleMember < ENSEMBLESIZE; ++ensembleMember) {")
+			if ($ensemble);
+		for my $i (0 .. $#keys) {
+			getPerfCalls($i, $keys[$i], [ $keys[$i]."($args);" ], \@calls);
 		}
-		push(@linex_body, "rotateTimelevels(hoodOld, indexEnd, hoodNew);\n");
+		getPerfCalls(scalar(@keys), "rotateTimelevels", [ "rotateTimelevels($args);" ], \@calls)
+			if (@rotate_body);
+		push(@calls, "}") if ($ensemble);
+		push(@linex_body, $_ . "\n") for (@calls);
 
 		util_buildFunction(\@linex_body, $linex_proto, \@linex, $linex_temp, 1);
 
@@ -572,42 +655,35 @@ sub buildUpdateFunctions
 }
 
 #
-# Adds the rotating of the timelevels to the array given by
-# out_ref (see params). Default indent is 2.
+# Builds the statements rotating the timelevels of one grid point, i.e.
+# copying each past timelevel from hoodOld to the next older one in hoodNew.
 #
 # param:
 #  - inf_ref: ref to interface data hash
 #  - val_ref: ref to values hash
-#  - out_ref: ref to array where to store rotating of timelevels
+#  - index  : name of the index variable in x direction
+#  - out_ref: ref to array where to store the statements
 #
 # return:
-#  - none, modifies array behind out_ref
+#  - none, statements will be stored in out_ref, nothing if there is
+#    nothing to rotate
 #
-sub getRotateTimelevels
+sub getRotateStatements
 {
-	my ($inf_ref, $val_ref, $out_ref) = @_;
-	my (@outdata, $i, $dim, $index, $pushed, $use_vec, $range, $incr, $start_idx);
+	my ($inf_ref, $val_ref, $index, $out_ref) = @_;
+	my (@outdata, $i, $dim, $use_vec, $var_idx);
 
 	# init
-	$pushed	   = 0;
-	$dim	   = $val_ref->{"dim"};
-	$index	   = "_i";
-	$use_vec   = $cinf_config{"use_vectorization"};
-	$range	   = $use_vec ? "(indexEnd - DOUBLE::ARITY + 1)" : "(indexEnd - hoodOld.index())";
-	$incr	   = $use_vec ? "$index += DOUBLE::ARITY" : "++$index";
-	$start_idx = $use_vec ? "indexStart" : "0";
-
-	# start with a comment
-	push(@outdata, "// rotate timelevels");
-
-	# start for loop
-	push(@outdata, "for (int $index = $start_idx; $index < $range; $incr) {");
+	$dim	 = $val_ref->{"dim"};
+	$use_vec = $cinf_config{"use_vectorization"};
+	$var_idx = "vindex";
 
-	foreach my $group (keys %{$inf_ref}) {
-		my ($gtype, $timelevels);
+	foreach my $group (sort keys %{$inf_ref}) {
+		my ($gtype, $vtype, $timelevels);
 
 		# init
 		$gtype      = $inf_ref->{$group}{"gtype"};
+		$vtype      = $inf_ref->{$group}{"vtype"};
 		$timelevels = $inf_ref->{$group}{"timelevels"};
 
 		# skip scalars and arrays
@@ -616,44 +692,104 @@ sub getRotateTimelevels
 
 		foreach my $name (@{$inf_ref->{$group}{"names"}}) {
 			for ($i = $timelevels - 1; $i > 1; --$i) {
-				my ($left, $right, $hood_new, $gfindex, $var_idx, $buf, $store);
+				my ($left, $right, $hood_new, $buf, $store);
 
-				$var_idx  = "vindex";
-				$gfindex  = getGFIndexFirst($dim, $index);
-				$hood_new = "&hoodNew.var_" . $name . ("_p" x ($i - 1) . "()");
+				$hood_new = getEnsemblePointer("&hoodNew.var_" . $name . ("_p" x ($i - 1) . "()"));
 
-				# get index
-				push(@outdata, "int $var_idx = $gfindex;");
+				if (useLanes()) {
+					my (@src, @dst, $fixed_coord);
 
-				if ($use_vec) {
-					my ($past_name, $var_name, $fixed_coord);
+					# every member is copied on its own, converted if needed
+					$fixed_coord = getFixedCoordZero($dim);
+					@src = getEnsembleNames("&hoodOld[$fixed_coord].var_" . $name . ("_p" x ($i - 2)));
+					@dst = getEnsembleNames("&hoodNew.var_" . $name . ("_p" x ($i - 1)));
+					push(@outdata, "($dst[$_]())[$var_idx] = ($src[$_]())[$var_idx];") for (0 .. $#src);
+				} elsif ($use_vec) {
+					my ($var_name, $fixed_coord, $src, $dst);
 
 					$var_name    = "var_" . $name . ("_p" x ($i - 2));
 					$fixed_coord = getFixedCoordZero($dim);
-					$buf         = "DOUBLE buf = &hoodOld[$fixed_coord].$var_name() + $var_idx;";
+					$src         = getStorageType($vtype, $name, $i - 2);
+					$dst         = getStorageType($vtype, $name, $i - 1);
+					$buf         = "DOUBLE buf = " . getEnsemblePointer("&hoodOld[$fixed_coord].$var_name()") . " + $var_idx;";
 					$store       = "($hood_new + vindex) << buf;";
-
+					# different storage types need a conversion
+					if ($src ne $vtype || $dst ne $vtype) {
+						$buf   = "DOUBLE buf = VecRead<$vtype, DOUBLE::ARITY, $src>(" .
+							getEnsemblePointer("&hoodOld[$fixed_coord].$var_name()") . ")[$var_idx];";
+						$store = "(VecWrite<$vtype, DOUBLE::ARITY, $dst>($hood_new))[$var_idx] = buf;";
+					}
+
+					# buf is declared for each variable
+					push(@outdata, "{");
 					push(@outdata, "$buf");
 					push(@outdata, "$store");
+					push(@outdata, "}");
 				} else {
 					$left  = "($hood_new)" . "[$var_idx]";
 					$right = "$name" . ("_p" x ($i - 1)) . "[$var_idx]";
 					push(@outdata, "$left = $right;");
 				}
-
-				$pushed = 1;
 			}
 		}
 	}
 
-	# end foor loop
+	# the index is only needed if there is something to rotate
+	unshift(@outdata, "int $var_idx = " . getGFIndexFirst($dim, $index) . ";") if (@outdata);
+
+	push(@$out_ref, @outdata);
+
+	return;
+}
+
+#
+# Adds the rotating of the timelevels to the array given by
+# out_ref (see params). Default indent is 2. Nothing is added if the
+# rotation has already been merged into an evolution function.
+#
+# param:
+#  - inf_ref: ref to interface data hash
+#  - val_ref: ref to values hash
+#  - out_ref: ref to array where to store rotating of timelevels
+#
+# return:
+#  - none, modifies array behind out_ref
+#
+sub getRotateTimelevels
+{
+	my ($inf_ref, $val_ref, $out_ref) = @_;
+	my (@outdata, @stmts, $index, $use_vec, $range, $incr, $start_idx);
+
+	# init
+	$index	   = "_i";
+	$use_vec   = $cinf_config{"use_vectorization"};
+	$range	   = $use_vec ? "(indexEnd - DOUBLE::ARITY + 1)" : "(indexEnd - hoodOld.index())";
+	$incr	   = $use_vec ? "$index += DOUBLE::ARITY" : "++$index";
+	$start_idx = $use_vec ? "indexStart" : "0";
+	# the lanes hold the ensemble members, x is stepped point by point
+	if (useLanes()) {
+		$range = "indexEnd";
+		$incr  = "++$index";
+	}
+
+	return if ($val_ref->{"rotate_fused"});
+
+	# only add if there variables, else there would be a useless comment
+	getRotateStatements($inf_ref, $val_ref, $index, \@stmts);
+	return unless (@stmts);
+
+	# start with a comment
+	push(@outdata, "// rotate timelevels");
+
+	# loop over line
+	push(@outdata, "for (int $index = $start_idx; $index < $range; $incr) {");
+	push(@outdata, @stmts);
 	push(@outdata, "}");
 
 	# indent
 	util_indent(\@outdata, 2);
 
-	# only add if there variables, else there would be a useless comment
-	push(@$out_ref, @outdata) if ($pushed);
+	push(@$out_ref, @outdata);
 
 	return;
 }
@@ -668,6 +804,8 @@ sub getRotateTimelevels
 #  - the last will be: for (int x = 0; x < (indexEnd - hoodOld.index()); ++x)
 #  - when vectorization is used, it will be:
 #  - for (int x = indexStart; x < (indexEnd - DOUBLE::ARITY + 1; x += DOUBLE::ARITY)
+#  - when the ensemble members share the lanes, it will be:
+#  - for (int x = indexStart; x < indexEnd; ++x)
 #
 # params:
 #  - inf_ref : ref to interface data hash
@@ -709,7 +847,11 @@ sub adjustEvolutionFunction
 			$index = $3;
 
 			# check for vectorization
-			if ($use_vec) {
+			if (useLanes()) {
+				$range	   = "indexEnd";
+				$incr	   = "++$index";
+				$start_idx = "indexStart";
+			} elsif ($use_vec) {
 				$range	   = "(indexEnd - DOUBLE::ARITY + 1)";
 				$incr	   = "$index += DOUBLE::ARITY";
 				$start_idx = "indexStart";
@@ -740,6 +882,784 @@ sub adjustEvolutionFunction
 	return;
 }
 
+#
+# Collects the grid functions read and written by a piece of code.
+# A grid function is written, if one of its elements is assigned.
+# Grid functions which are not accessed via [], e.g. passed to a function,
+# are treated as read and written.
+#
+# param:
+#  - inf_ref   : ref to interface data hash
+#  - code      : code string
+#  - reads_ref : ref to hash where read grid functions will be stored
+#  - writes_ref: ref to hash where written grid functions will be stored
+#
+# return:
+#  - none, results will be stored in reads_ref and writes_ref
+#
+sub getReadWriteSets
+{
+	my ($inf_ref, $code, $reads_ref, $writes_ref) = @_;
+
+	foreach my $group (sort keys %{$inf_ref}) {
+		my ($i, $timelevels);
+
+		# init
+		$timelevels = $inf_ref->{$group}{"timelevels"};
+		$timelevels = 1 unless ($timelevels);
+
+		foreach my $name (@{$inf_ref->{$group}{"names"}}) {
+			for ($i = 0; $i < $timelevels; ++$i) {
+				my ($var);
+
+				$var = $name . ("_p" x $i);
+
+				while ($code =~ /\b$var\b(\s*\[[^\]]*\]\s*(?:[-+*\/]?=(?!=))?)?/g) {
+					my ($access) = ($1);
+
+					if (!defined $access) {
+						$reads_ref->{$var}  = 1;
+						$writes_ref->{$var} = 1;
+					} elsif ($access =~ /([-+*\/])?=$/) {
+						$writes_ref->{$var} = 1;
+						# compound assignments read as well
+						$reads_ref->{$var}  = 1 if (defined $1);
+					} else {
+						$reads_ref->{$var}  = 1;
+					}
+				}
+			}
+		}
+	}
+
+	return;
+}
+
+#
+# Splits code into statements. Comments are removed and whitespace
+# is normalized, so that equal statements compare equal.
+#
+# param:
+#  - code: code string
+#
+# return:
+#  - array of statements
+#
+sub getStatements
+{
+	my ($code) = @_;
+	my (@stmts);
+
+	$code =~ s/\/\*.*?\*\///gs;
+	$code =~ s/\/\/[^\n]*//g;
+
+	foreach my $stmt (split(/;/, $code)) {
+		$stmt =~ s/\s+/ /g;
+		$stmt =~ s/^[\s{}]+|\s+$//g;
+		push(@stmts, $stmt) if ($stmt ne "");
+	}
+
+	return @stmts;
+}
+
+#
+# Parses a local declaration like "CCTK_REAL dx, dy".
+#
+# param:
+#  - stmt: statement
+#
+# return:
+#  - (type, names) if stmt is a declaration, else empty list
+#
+sub parseDeclaration
+{
+	my ($stmt) = @_;
+	my ($type, $decl, @names);
+
+	return () unless ($stmt =~ /^((?:(?:const|unsigned|static|register)\s+)*(?:int|long|short|char|float|double|bool|CCTK_\w+))\b\s*(.*)$/);
+	$type = $1;
+	$decl = $2;
+
+	# remove initializers
+	1 while ($decl =~ s/\([^()]*\)//g);
+	$decl =~ s/=[^,]*//g;
+	push(@names, $1) while ($decl =~ /(?:^|,)\s*\**\s*(\w+)/g);
+
+	return ($type, @names);
+}
+
+#
+# Gets all names a statement assigns to or declares.
+#
+# param:
+#  - stmt: statement
+#
+# return:
+#  - array of names
+#
+sub getDefinedNames
+{
+	my ($stmt) = @_;
+	my ($type, @names);
+
+	($type, @names) = parseDeclaration($stmt);
+	return @names if (defined $type);
+
+	push(@names, $1) while ($stmt =~ /\b(\w+)\s*(?:\[[^\]]*\]\s*)?[-+*\/]?=(?!=)/g);
+	push(@names, $1) while ($stmt =~ /(?:\+\+|--)\s*(\w+)/g);
+	push(@names, $1) while ($stmt =~ /\b(\w+)\s*(?:\+\+|--)/g);
+
+	return @names;
+}
+
+#
+# Gets all identifiers used by some statements.
+#
+# param:
+#  - stmts_ref: ref to array of statements
+#
+# return:
+#  - hash of identifiers
+#
+sub getIdentifiers
+{
+	my ($stmts_ref) = @_;
+	my (%ids);
+
+	foreach my $stmt (@$stmts_ref) {
+		$ids{$1} = 1 while ($stmt =~ /\b([A-Za-z_]\w*)\b/g);
+	}
+
+	return %ids;
+}
+
+#
+# Splits an evolution function into the code before the loop nest,
+# the loop headers and the body of the innermost loop. This only works
+# for functions containing exactly one perfectly nested loop nest, which
+# is the same pattern adjustEvolutionFunction relies on.
+#
+# param:
+#  - code    : code string of function
+#  - dim     : dimension
+#  - part_ref: ref to hash where to store the parts
+#
+# return:
+#  - true on success, else false
+#
+sub splitLoopNest
+{
+	my ($code, $dim, $part_ref) = @_;
+	my (@blocks, @vars, $start, $rest, $depth, $i, $closing);
+
+	@blocks = $code =~ /((?:for\s*\([\w\s()+\-*\/=<>;,\[\]]*\)\s*\{\s*){$dim})/g;
+	return 0 unless (@blocks == 1);
+
+	# no blocks before the loop nest
+	$start = index($code, $blocks[0]);
+	return 0 if (substr($code, 0, $start) =~ /[{}]/);
+
+	@vars = $blocks[0] =~ /for\s*\(\s*(?:\w+\s+)?(\w+)\s*=/g;
+	return 0 unless (@vars == $dim);
+
+	# search end of innermost body
+	$rest  = substr($code, $start + length($blocks[0]));
+	$depth = 0;
+	for ($i = 0; $i < length($rest); ++$i) {
+		my $c = substr($rest, $i, 1);
+
+		++$depth if ($c eq '{');
+		if ($c eq '}') {
+			last if ($depth == 0);
+			--$depth;
+		}
+	}
+	return 0 if ($i >= length($rest));
+
+	# only the closing braces of the loop nest may follow
+	($closing = substr($rest, $i)) =~ s/\s+//g;
+	return 0 unless ($closing eq ("}" x $dim));
+
+	# code appended to the body has to be executed in every iteration
+	return 0 if (substr($rest, 0, $i) =~ /\b(continue|break|return|goto)\b/);
+
+	$part_ref->{"pre"}    = substr($code, 0, $start);
+	$part_ref->{"header"} = $blocks[0];
+	$part_ref->{"body"}   = substr($rest, 0, $i);
+	$part_ref->{"post"}   = substr($rest, $i);
+	$part_ref->{"vars"}   = join(",", @vars);
+
+	return 1;
+}
+
+#
+# Checks whether the evolution functions may run with a load balancer.
+# cctk_lsh, cctk_lbnd, cctk_ubnd and cctk_bbox are held once per rank by
+# the cctkGH of the static data and set up by the initializer from the
+# initial region of the rank. A balancer moving the regions later leaves
+# them stale, so such code is refused.
+#
+# param:
+#  - evol_ref  : ref to hash where evolution function(s) is/are stored
+#  - option_ref: ref to options hash
+#
+# return:
+#  - none, exits with an error if the code uses the local extent
+#
+sub checkLoadBalancer
+{
+	my ($evol_ref, $option_ref) = @_;
+
+	return unless ($option_ref->{"mpi"});
+	return if ($cinf_config{"load_balancer"} eq "none");
+
+	foreach my $func (sort keys %{$evol_ref}) {
+		my $code = join("\n", @{$evol_ref->{$func}{"data"}});
+
+		next unless ($code =~ /\b(cctk_lsh|cctk_lbnd|cctk_ubnd|cctk_bbox)\b/);
+		_err("$func uses $1, which is set up once per rank and would go stale " .
+			 "when the load balancer moves regions. Use load_balancer = none.");
+	}
+
+	return;
+}
+
+#
+# Counts the floating point operations of one cell update for the roofline
+# report (see src/steerer/roofline.h). Only the body of the loop nest is
+# counted, the code before it is executed once per line. Operators in
+# index expressions, assignments to integer variables, pointer arithmetic
+# and unary signs are not counted, calls of math functions count as one
+# operation.
+#
+# param:
+#  - evol_ref: ref to hash where evolution function(s) is/are stored
+#  - val_ref : ref to value data hash
+#
+# return:
+#  - none, stores flops per cell into value hash, key "flops"
+#
+sub countFlops
+{
+	my ($evol_ref, $val_ref) = @_;
+	my ($dim, $flops);
+
+	$dim   = $val_ref->{"dim"};
+	$flops = 0;
+
+	foreach my $func (keys %{$evol_ref}) {
+		my (%parts, %ints, $code);
+
+		$code = join("\n", @{$evol_ref->{$func}{"data"}});
+
+		# integer variables, e.g. indices
+		foreach my $stmt (getStatements($code)) {
+			my ($type, @names) = parseDeclaration($stmt);
+
+			next unless (defined $type && $type !~ /REAL|float|double/);
+			$ints{$_} = 1 for (@names);
+		}
+
+		# whole function, if the loop nest is unknown
+		$code = $parts{"body"} if (splitLoopNest($code, $dim, \%parts));
+
+		foreach my $stmt (getStatements($code)) {
+			my ($type, @names) = parseDeclaration($stmt);
+
+			next if (defined $type && $type !~ /REAL|float|double/);
+			@names = getDefinedNames($stmt) unless (defined $type);
+			next unless (grep { !$ints{$_} } @names);
+			# pointer arithmetic, e.g. of the rotated timelevels
+			next if ($stmt =~ /(?<!&)&(?!&)/);
+
+			1 while ($stmt =~ s/\[[^\[\]]*\]//g);
+			1 while ($stmt =~ s/\bCCTK_\w+\s*\([^()]*\)//g);
+			$stmt =~ s/\+\+|--|->//g;
+			$stmt =~ s/\b\d*\.?\d+[eE][+\-]?\d+//g;
+			$stmt =~ s/([=(,?:*\/+\-])\s*[+\-]/$1/g;
+
+			$flops += () = $stmt =~ /[+\-*\/]/g;
+			$flops += () = $stmt =~ /\b(?:sqrt|exp|log|pow|sin|cos|tan|fabs|abs)\s*\(/g;
+		}
+	}
+
+	# every ensemble member is updated
+	$val_ref->{"flops"} = $flops * $cinf_config{"ensemble_size"};
+
+	return;
+}
+
+#
+# Checks whether a grid function is only accessed at the center point of
+# the line, i.e. by CCTK_GFINDEX with the loop variables or by an
+# index variable, which is only assigned such an index.
+#
+# param:
+#  - var : name of grid function
+#  - code: code string
+#  - vars: comma separated loop variables
+#
+# return:
+#  - true if all accesses are center accesses, else false
+#
+sub isCenterAccessOnly
+{
+	my ($var, $code, $vars) = @_;
+	my (@vars, $inner, $outer, $center);
+
+	# the innermost loop runs along the line, the outer loops are adjusted
+	# to a single iteration, so e.g. CCTK_GFINDEX3D(cctkGH,i,j,k) or
+	# CCTK_GFINDEX3D(cctkGH,i,0,0) with i being the innermost loop variable
+	@vars   = split(/,/, $vars);
+	$inner  = pop(@vars);
+	$outer  = join("|", @vars, "0");
+	$center = qr/^\s*CCTK_GFINDEX\dD\s*\(\s*cctkGH\s*,\s*$inner(?:\s*,\s*(?:$outer))*\s*\)\s*$/;
+
+	while ($code =~ /\b$var\b(\s*\[)?/g) {
+		my ($start, $depth, $pos, $expr, $found, $copy);
+
+		# not used as array, e.g. passed to a function
+		return 0 unless (defined $1);
+
+		# get index expression
+		$start = pos($code);
+		$depth = 1;
+		for ($pos = $start; $pos < length($code) && $depth; ++$pos) {
+			my $c = substr($code, $pos, 1);
+			++$depth if ($c eq "[");
+			--$depth if ($c eq "]");
+		}
+		$expr = substr($code, $start, $pos - $start - 1);
+		pos($code) = $pos;
+
+		next if ($expr =~ $center);
+		return 0 unless ($expr =~ /^\s*(\w+)\s*$/);
+
+		# check all assignments to index variable, on a copy to keep pos()
+		$expr  = $1;
+		$found = 0;
+		$copy  = $code;
+		foreach my $assign ($copy =~ /\b$expr\s*=(?!=)\s*([^;]+);/g) {
+			return 0 unless ($assign =~ $center);
+			$found = 1;
+		}
+		return 0 unless ($found);
+	}
+
+	return 1;
+}
+
+#
+# Checks whether the locals of two evolution functions allow fusing
+# them. Statements before the loop nest occuring in both functions are
+# only executed once, equal declarations are merged. Everything else
+# defined by one function must not be used by the other one.
+# Locals assigned within both loop bodies have to be set up by the same
+# statement before use in both bodies (e.g. "vindex = CCTK_GFINDEX3D(...)").
+#
+# param:
+#  - first   : ref to parts of first function
+#  - second  : ref to parts of second function
+#  - gfs_ref : ref to hash of grid function names
+#  - pre_ref : ref to array where to store the statements of second
+#              function, which have to be added before the loop nest
+#
+# return:
+#  - true if the functions can be fused, else false
+#
+sub checkFusableLocals
+{
+	my ($first, $second, $gfs_ref, $pre_ref) = @_;
+	my (@pre1, @pre2, @body1, @body2, %decl1, %decl2, %ids1, %ids2, %pre1);
+
+	# init
+	@pre1  = getStatements($first->{"pre"});
+	@pre2  = getStatements($second->{"pre"});
+	@body1 = getStatements($first->{"body"});
+	@body2 = getStatements($second->{"body"});
+	%ids1  = getIdentifiers([ @pre1, @body1 ]);
+	%ids2  = getIdentifiers([ @pre2, @body2 ]);
+	%pre1  = map { $_ => 1 } @pre1;
+
+	# declarations
+	foreach my $stmt (@pre1) {
+		my ($type, @names) = parseDeclaration($stmt);
+		next unless (defined $type);
+		$decl1{$_} = $type for (@names);
+	}
+	foreach my $stmt (@pre2) {
+		my ($type, @names) = parseDeclaration($stmt);
+		next unless (defined $type);
+		$decl2{$_} = $type for (@names);
+	}
+	foreach my $name (sort keys %decl1) {
+		next unless (exists $ids2{$name});
+		return 0 unless (defined $decl2{$name} && $decl2{$name} eq $decl1{$name});
+	}
+
+	# statements before the loop nest
+	foreach my $stmt (@pre1) {
+		my ($type) = parseDeclaration($stmt);
+
+		next if (defined $type);
+		next if (grep { $_ eq $stmt } @pre2);
+		return 0 if (grep { exists $ids2{$_} } getDefinedNames($stmt));
+	}
+	foreach my $stmt (@pre2) {
+		my ($type, @names, @new);
+
+		next if ($pre1{$stmt});
+
+		($type, @names) = parseDeclaration($stmt);
+		if (defined $type) {
+			# drop names already declared by first function
+			@new = grep { !exists $decl1{$_} } @names;
+			return 0 if (grep { exists $ids1{$_} } @new);
+			push(@$pre_ref, "$type " . join(", ", @new)) if (@new);
+			next;
+		}
+		return 0 if (grep { exists $ids1{$_} } getDefinedNames($stmt));
+		push(@$pre_ref, $stmt);
+	}
+
+	# locals assigned within the loop bodies
+	foreach my $pair ([ \@body1, \%ids2, \@body2 ], [ \@body2, \%ids1, \@body1 ]) {
+		my ($body, $ids, $other) = @$pair;
+
+		foreach my $name (map { getDefinedNames($_) } @$body) {
+			my ($s1, $s2);
+
+			next if ($gfs_ref->{$name});
+			next unless (exists $ids->{$name});
+
+			# loop variables must not be changed
+			return 0 if (grep { $_ eq $name } split(/,/, $first->{"vars"}));
+
+			($s1) = grep { /\b$name\b/ } @$body;
+			($s2) = grep { /\b$name\b/ } @$other;
+			return 0 unless (defined $s2 && $s1 eq $s2 && $s1 =~ /^$name\s*=[^=]/);
+			return 0 if ((split(/=/, $s1, 2))[1] =~ /\b$name\b/);
+		}
+	}
+
+	return 1;
+}
+
+#
+# Checks whether two evolution functions, which are called one after
+# another, can be executed point by point in one loop nest. This is true if
+#  - they are on the same level of the schedule DAG and access disjoint grid
+#    functions, or
+#  - every grid function written by one and accessed by the other one is
+#    only accessed at the center point by both. Then no point depends on
+#    another point of the line, so the order of the schedule is kept
+#    for each point.
+#
+# param:
+#  - first : ref to entry of first function
+#  - second: ref to entry of second function
+#
+# return:
+#  - true if the functions are independent within a line, else false
+#
+sub isIndependent
+{
+	my ($first, $second) = @_;
+	my (@shared, $vars);
+
+	# grid functions creating a dependency
+	@shared = grep { $second->{"reads"}{$_} || $second->{"writes"}{$_} } keys %{$first->{"writes"}};
+	push(@shared, grep { $first->{"reads"}{$_} && !$first->{"writes"}{$_} } keys %{$second->{"writes"}});
+
+	unless (@shared) {
+		return (defined $first->{"level"} && defined $second->{"level"} &&
+				$first->{"level"} == $second->{"level"});
+	}
+
+	$vars = $first->{"parts"}{"vars"};
+	foreach my $var (@shared) {
+		# code before the loop nest is executed before both loops
+		return 0 if ($first->{"parts"}{"pre"}  =~ /\b$var\b/);
+		return 0 if ($second->{"parts"}{"pre"} =~ /\b$var\b/);
+		return 0 unless (isCenterAccessOnly($var, $first->{"parts"}{"body"}, $vars));
+		return 0 unless (isCenterAccessOnly($var, $second->{"parts"}{"body"}, $vars));
+	}
+
+	return 1;
+}
+
+#
+# Fuses independent evolution functions into one function making a single
+# pass over each line. Two functions scheduled one after another are fused
+# if
+#  - the schedule does not order them, i.e. they are on the same level of
+#    the schedule DAG
+#  - neither writes a grid function the other one reads or writes, the read
+#    and write sets are derived from the interface variables
+#  - both consist of a single loop nest using the same loop variables
+#  - their locals do not interfere (see checkFusableLocals)
+# The loop nest of the first function is kept, since adjustEvolutionFunction
+# replaces its bounds anyway. Both loop bodies are placed into it in the
+# scheduled order.
+#
+# param:
+#  - evol_ref: ref to hash where evolution function(s) is/are stored
+#  - val_ref : ref to values hash
+#  - inf_ref : ref to interface data hash
+#
+# return:
+#  - none, fused functions will replace the original ones in evol_ref
+#
+sub fuseEvolutionFunctions
+{
+	my ($evol_ref, $val_ref, $inf_ref) = @_;
+	my (@funcs, @fused, %gfs, $dim);
+
+	# init
+	$dim = $val_ref->{"dim"};
+
+	return unless ($cinf_config{"fuse_functions"});
+
+	# all names of grid variables
+	foreach my $group (sort keys %{$inf_ref}) {
+		my ($i, $timelevels);
+
+		$timelevels = $inf_ref->{$group}{"timelevels"};
+		$timelevels = 1 unless ($timelevels);
+		foreach my $name (@{$inf_ref->{$group}{"names"}}) {
+			$gfs{$name . ("_p" x $_)} = 1 for (0 .. ($timelevels - 1));
+		}
+	}
+
+	# analyze functions
+	foreach my $func (keys %{$evol_ref}) {
+		my (%entry, %reads, %writes, $code);
+
+		$code = join("\n", @{$evol_ref->{$func}{"data"}});
+		getReadWriteSets($inf_ref, $code, \%reads, \%writes);
+
+		$entry{"name"}     = $evol_ref->{$func}{"name"};
+		$entry{"data"}     = $evol_ref->{$func}{"data"};
+		$entry{"level"}    = $evol_ref->{$func}{"level"};
+		$entry{"reads"}    = \%reads;
+		$entry{"writes"}   = \%writes;
+		$entry{"parts"}    = {};
+		$entry{"fusable"}  = splitLoopNest($code, $dim, $entry{"parts"});
+		$entry{"bodies"}   = [ $entry{"parts"}{"body"} || "" ];
+		$entry{"bodies"}[0] =~ s/^\s+|\s+$//g;
+
+		push(@funcs, \%entry);
+	}
+
+	# fuse neighbours
+	push(@fused, shift @funcs);
+	foreach my $second (@funcs) {
+		my ($first, @pre, @bodies, $code, %reads, %writes, %parts);
+
+		$first = $fused[-1];
+
+		unless ($first->{"fusable"} && $second->{"fusable"} &&
+				$first->{"parts"}{"vars"} eq $second->{"parts"}{"vars"} &&
+				isIndependent($first, $second) &&
+				checkFusableLocals($first->{"parts"}, $second->{"parts"}, \%gfs, \@pre)) {
+			push(@fused, $second);
+			next;
+		}
+
+		# build fused function, each body gets its own block
+		@bodies = (@{$first->{"bodies"}}, @{$second->{"bodies"}});
+		$code   = $first->{"parts"}{"pre"};
+		$code  .= "$_;\n" for (@pre);
+		$code  .= $first->{"parts"}{"header"};
+		$code  .= "{\n$_\n}\n" for (@bodies);
+		$code  .= $first->{"parts"}{"post"};
+
+		%reads  = (%{$first->{"reads"}},  %{$second->{"reads"}});
+		%writes = (%{$first->{"writes"}}, %{$second->{"writes"}});
+		splitLoopNest($code, $dim, \%parts);
+
+		$fused[-1] = {
+			"name"    => $first->{"name"} . "_" . $second->{"name"},
+			"data"    => [ split(/\n/, $code) ],
+			"level"   => $first->{"level"},
+			"reads"   => \%reads,
+			"writes"  => \%writes,
+			"parts"   => \%parts,
+			"bodies"  => \@bodies,
+			"fusable" => 1,
+		};
+	}
+
+	# the rotation of the timelevels is independent of all evolution
+	# functions, so it can be done in the loop nest of the last one
+	if ($fused[-1]{"fusable"}) {
+		my ($last, @rotate, @vars, $body, $code);
+
+		$last = $fused[-1];
+		@vars = split(/,/, $last->{"parts"}{"vars"});
+		getRotateStatements($inf_ref, $val_ref, $vars[-1], \@rotate);
+
+		if (@rotate) {
+			($body = $last->{"parts"}{"body"}) =~ s/^\s+|\s+$//g;
+			$code  = $last->{"parts"}{"pre"};
+			$code .= $last->{"parts"}{"header"};
+			$code .= "$body\n";
+			$code .= "{\n";
+			$code .= "// rotate timelevels\n";
+			$code .= "$_\n" for (@rotate);
+			$code .= "}\n";
+			$code .= $last->{"parts"}{"post"};
+
+			$last->{"data"} = [ split(/\n/, $code) ];
+			$val_ref->{"rotate_fused"} = 1;
+		}
+	}
+
+	# nothing changed
+	return if (@fused == keys %{$evol_ref} && !$val_ref->{"rotate_fused"});
+
+	# replace functions, hash keeps order
+	%{$evol_ref} = ();
+	foreach my $entry (@fused) {
+		$evol_ref->{$entry->{"name"}}{"name"}  = $entry->{"name"};
+		$evol_ref->{$entry->{"name"}}{"data"}  = $entry->{"data"};
+		$evol_ref->{$entry->{"name"}}{"level"} = $entry->{"level"};
+	}
+
+	return;
+}
+
+#
+# Gets the storage sizes of the grid in x, y and z direction. LibFlatArray
+# rounds the grid storage up to the smallest of these sizes in each
+# direction. The sizes are powers of two up to 2^12, i.e. a 4096^3 grid
+# per rank, and every size adds instantiations of the update code. The
+# row (x) and plane (y) sizes are padded by soa_padding elements, plain
+# powers of two map rows and planes of power-of-two grids to the same
+# cache sets.
+#
+# param:
+#  - dim: dimension of cell
+#
+# return:
+#  - refs to arrays of the sizes in x, y and z direction
+#
+sub getSoASizeLists
+{
+	my ($dim) = @_;
+	my ($pad, @pow, @padded);
+
+	$pad    = $cinf_config{"soa_padding"};
+	@pow    = map { 2 ** $_ } (5 .. 12);
+	@padded = map { $_ + $pad } @pow;
+
+	return ([ @padded ], $dim >= 2 ? [ @padded ] : [ 1 ], $dim >= 3 ? [ @pow ] : [ 1 ]);
+}
+
+#
+# Builds the LIBFLATARRAY_CUSTOM_SIZES macro for the cell API.
+#
+# param:
+#  - dim: dimension of cell
+#
+# return:
+#  - macro string
+#
+sub getSoASizes
+{
+	my ($dim) = @_;
+
+	return "LIBFLATARRAY_CUSTOM_SIZES(" .
+		join(", ", map { join("", map { "($_)" } @$_) } getSoASizeLists($dim)) . ")";
+}
+
+#
+# Builds the static function soaStorageSize() of the cell class, which
+# gives the storage size of LibFlatArray for an extent of the grid. Used
+# by MemoryReport.
+#
+# param:
+#  - dim    : dimension of cell
+#  - out_ref: ref to array where to store the code
+#
+# return:
+#  - none, code will be stored in out_ref
+#
+sub buildSoAStorageSize
+{
+	my ($dim, $out_ref) = @_;
+	my (@lists, $n, $tab);
+
+	# init
+	$tab   = "\t";
+	@lists = getSoASizeLists($dim);
+	$n     = 0;
+	foreach my $list (@lists) {
+		$n = @$list if (@$list > $n);
+	}
+
+	push(@$out_ref, $tab."// storage size of LibFlatArray for an extent in direction dir,\n");
+	push(@$out_ref, $tab."// 0 if the extent is larger than all sizes of LIBFLATARRAY_CUSTOM_SIZES\n");
+	push(@$out_ref, $tab."static int soaStorageSize(int dir, int extent)\n");
+	push(@$out_ref, $tab."{\n");
+	push(@$out_ref, $tab.$tab."static const int sizes[3][$n] = {\n");
+	foreach my $list (@lists) {
+		my (@row);
+
+		# shorter lists repeat their last size
+		@row = (@$list, ($list->[-1]) x ($n - @$list));
+		push(@$out_ref, $tab.$tab.$tab."{ " . join(", ", @row) . " },\n");
+	}
+	push(@$out_ref, $tab.$tab."};\n");
+	push(@$out_ref, "\n");
+	push(@$out_ref, $tab.$tab."for (int i = 0; i < $n; ++i)\n");
+	push(@$out_ref, $tab.$tab.$tab."if (sizes[dir][i] >= extent)\n");
+	push(@$out_ref, $tab.$tab.$tab.$tab."return sizes[dir][i];\n");
+	push(@$out_ref, $tab.$tab."return 0;\n");
+	push(@$out_ref, $tab."}\n");
+
+	return;
+}
+
+#
+# Builds the static function advanceWindow() of the cell class, which
+# reports the line updateLineX is about to sweep to the out-of-core window
+# of MemoryPolicy, once for every member of the old and the new grid,
+# since LibFlatArray stores each of them as an array of its own.
+#
+# param:
+#  - val_ref: ref to value hash
+#  - out_ref: ref to array where to store the code
+#
+# return:
+#  - none, code will be stored in out_ref
+#
+sub buildAdvanceWindow
+{
+	my ($val_ref, $out_ref) = @_;
+	my ($members, $fixed_coord, $tab);
+
+	# init
+	$tab         = "\t";
+	$members     = $val_ref->{"soa_members"};
+	$fixed_coord = getFixedCoordZero($val_ref->{"dim"});
+
+	push(@$out_ref, $tab."// arrays swept at the same time per grid, see advanceWindow()\n");
+	push(@$out_ref, $tab."static const int SOAMEMBERS = " . scalar(@$members) . ";\n");
+	push(@$out_ref, "\n");
+	push(@$out_ref, $tab."// moves the out-of-core window to the current line\n");
+	push(@$out_ref, $tab."template<typename ACCESSOR1, typename ACCESSOR2>\n");
+	push(@$out_ref, $tab."static void advanceWindow(ACCESSOR1& hoodOld, ACCESSOR2& hoodNew)\n");
+	push(@$out_ref, $tab."{\n");
+	foreach my $member (@$members) {
+		push(@$out_ref, $tab.$tab."MemoryPolicy::advance(&hoodOld[$fixed_coord].$member->[1]());\n");
+		push(@$out_ref, $tab.$tab."MemoryPolicy::advance(&hoodNew.$member->[1]());\n");
+	}
+	push(@$out_ref, $tab."}\n");
+
+	return;
+}
+
 #
 # Build cell header.
 #
@@ -777,6 +1697,10 @@ sub buildCellHeader
 	push(@$out_ref, "#include \"cctk_$class.h\"\n");
 	push(@$out_ref, "#include \"vector.h\"\n")
 		if ($cinf_config{"use_vectorization"});
+	push(@$out_ref, "#include \"perfcounters.h\"\n")
+		if ($cinf_config{"perf_counters"});
+	push(@$out_ref, "#include \"memorypolicy.h\"\n")
+		if ($cinf_config{"out_of_core_dir"} ne "");
 	push(@$out_ref, "\n");
 	push(@$out_ref, "using namespace LibGeoDecomp;\n");
 	push(@$out_ref, "\n");
@@ -793,13 +1717,26 @@ sub buildCellHeader
 	push(@$out_ref, $tab.$tab."public APITraits::HasSoA,\n");
 	# for cactus code using updateLineX which should make things a bit faster
 	push(@$out_ref, $tab.$tab."public APITraits::HasUpdateLineX,\n");
+	# ghostzones of SoA cells are serialized member by member by LibFlatArray,
+	# so the cell data type never describes a halo buffer; sending only some
+	# timelevels would need a serializer inside LibGeoDecomp itself
 	push(@$out_ref, $tab.$tab."public APITraits::HasOpaqueMPIDataType<$class>,\n")
 		if ($mpi);
 	push(@$out_ref, $tab.$tab."public APITraits::HasStencil<Stencils::Moore<$dim, $cinf_config{\"ghostzone_width\"}> >,\n");
 	push(@$out_ref, $tab.$tab."public APITraits::Has".$cinf_config{"topology"}."Topology<$dim>,\n");
 	push(@$out_ref, $tab.$tab."public APITraits::HasStaticData<$static_class>\n");
-	push(@$out_ref, $tab."{};\n");
+	push(@$out_ref, $tab."{\n");
+	push(@$out_ref, $tab."public:\n");
+	push(@$out_ref, $tab.$tab."// storage sizes, padded by soa_padding to avoid cache-set aliasing\n");
+	push(@$out_ref, $tab.$tab.getSoASizes($dim)."\n");
+	push(@$out_ref, $tab."};\n");
 	push(@$out_ref, "\n");
+	buildSoAStorageSize($dim, $out_ref);
+	push(@$out_ref, "\n");
+	if ($cinf_config{"out_of_core_dir"} ne "") {
+		buildAdvanceWindow($val_ref, $out_ref);
+		push(@$out_ref, "\n");
+	}
 	# check here if there are cell vars for avoiding build failures
 	if (!$ncellvars) {
 		push(@$out_ref, $tab."explicit $class() {}\n");
@@ -881,7 +1818,9 @@ sub initValueHash
 	$val_ref->{"cell_params"}       = "";
 	$val_ref->{"cell_init_params"}  = "";
 	$val_ref->{"soa_macro"}         = "";
+	$val_ref->{"soa_members"}       = [];
 	$val_ref->{"static_class_name"} = "";
+	$val_ref->{"rotate_fused"}      = 0;
 
 	return;
 }
@@ -913,6 +1852,7 @@ sub initValueHash
 #    - cell_params      : parameters for constructor
 #    - cell_init_params : init constructor variables
 #    - soa_macro        : string of LibGeoDecomp Struct of Array macro
+#    - soa_members      : members of the cell in SoA order, [ type, name ]
 #    - static_class_name: name of the class which holds the static data for cell
 #
 sub createCellClass
@@ -929,7 +1869,7 @@ sub createCellClass
 	$values{"class_name"} = $class;
 
 	# get data
-	foreach my $key (keys %{$config_ref->{"evol_thorns"}}) {
+	foreach my $key (sort keys %{$config_ref->{"evol_thorns"}}) {
 		my (%evol_thorn, $thorndir, $thorn, $arrangement, $impl);
 
 		# init
@@ -946,7 +1886,7 @@ sub createCellClass
 	}
 
 	# parse param.ccl to get parameters
-	generateParameterMacro(\%param_data, $class, "staticData.", \@param_macro);
+	generateParameterMacro(\%param_data, $class, "staticData.", \@param_macro, useLanes());
 
 	# parse schedule.ccl to get function(s) at CCTK_Evol-Timestep
 	getEvolFunctions(\%sched_data, \%evol_funcs);
@@ -958,12 +1898,22 @@ sub createCellClass
 	$values{"dim"} = getDimension(\%inf_data);
 
 	# build LibGeoDecomp Struct of Array macro
-	$values{"soa_macro"} = generateSoAMacro(\%inf_data, $class);
+	$values{"soa_macro"}   = generateSoAMacro(\%inf_data, $class);
+	$values{"soa_members"} = [ getSoAMembers(\%inf_data) ];
 
 	# special macros
 	buildSpecialMacros(\%values, \%inf_data, \%param_data, \@special_macros,
 					   \@special_macros_undef);
 
+	# the local extent cannot follow a load balancer
+	checkLoadBalancer(\%evol_funcs, $option_ref);
+
+	# fuse independent evolution functions
+	fuseEvolutionFunctions(\%evol_funcs, \%values, \%inf_data);
+
+	# count flops per cell for the roofline report
+	countFlops(\%evol_funcs, \%values) if ($cinf_config{"roofline"});
+
 	# build updateLineX function
 	buildUpdateFunctionsWithVec(\%evol_funcs, \%values, \%inf_data)
 		if ($cinf_config{"use_vectorization"});
@@ -987,6 +1937,7 @@ sub createCellClass
 	$out_ref->{"special_macros_undef"} = \@special_macros_undef;
 	$out_ref->{"class_name"}           = $values{"class_name"};
 	$out_ref->{"dim"}                  = $values{"dim"};
+	$out_ref->{"flops"}                = $values{"flops"};
 	$out_ref->{"inf_data"}             = \%inf_data;
 	$out_ref->{"static_data_class"}    = \%static;
 
@@ -14,7 +14,8 @@ use Cactusinterfacing::Parameter qw(getParameters generateParameterMacro
 									buildParameterStrings);
 use Cactusinterfacing::Schedule qw(getScheduleData getInitFunctions);
 use Cactusinterfacing::Utils qw(util_indent _err _warn);
-use Cactusinterfacing::Libgeodecomp qw(getCoord getGFIndex);
+use Cactusinterfacing::Libgeodecomp qw(getCoord getGFIndex getStorageType
+										getEnsembleNames);
 use Cactusinterfacing::ThornList qw(isInherit isFriend);
 
 # exports
@@ -25,7 +26,8 @@ my $tab = $cinf_config{"tab"};
 
 #
 # Builds the ADD_WRITE_MEMBER macro calls to create the
-# classes for write access.
+# classes for write access. In ensemble mode the members of
+# all ensemble members are passed, too.
 #
 # param:
 #  - val_ref: ref to values hash
@@ -39,7 +41,7 @@ sub buildWriteMember
 {
 	my ($val_ref, $inf_ref, $out_ref) = @_;
 
-	foreach my $group (keys %{$inf_ref}) {
+	foreach my $group (sort keys %{$inf_ref}) {
 		my ($i, $gtype, $vtype, $timelevels);
 
 		# init
@@ -54,7 +56,14 @@ sub buildWriteMember
 		for ($i = 0; $i < ($timelevels - 1); ++$i) {
 			foreach my $name (@{$inf_ref->{$group}{"names"}}) {
 				my $var_name = "var_".$name.("_p" x $i);
-				push(@$out_ref, "ADD_WRITE_MEMBER($vtype, $var_name)\n");
+				my $type     = getStorageType($vtype, $name, $i);
+				my $members  = "";
+
+				if ($cinf_config{"ensemble_size"} > 1) {
+					my $cell_class = $val_ref->{"cell_class_name"};
+					$members = join("", map { ", &$cell_class"."::$_" } getEnsembleNames($var_name));
+				}
+				push(@$out_ref, "ADD_WRITE_MEMBER($type, $var_name$members)\n");
 			}
 		}
 	}
@@ -76,16 +85,35 @@ sub buildWriteMember
 sub buildObjectsDecl
 {
 	my ($val_ref, $inf_ref) = @_;
-	my (@outdata, $dim);
+	my (@outdata, $dim, $member);
 
 	# init
-	$dim = $val_ref->{"dim"};
-
-	# the first object is fixed
-	# it's the box
-	push(@outdata, $tab."CoordBox<$dim> box = target->boundingBox();\n");
+	$dim    = $val_ref->{"dim"};
+	$member = $cinf_config{"ensemble_size"} > 1 ? ", ensembleMember" : "";
+
+	if ($cinf_config{"parallel_init"}) {
+		my ($i, $x, $class);
+
+		$class = $val_ref->{"class_name"};
+
+		# each slab gets its own copy of the grid hierarchy and x, y, z,
+		# they shadow the members, so the thorn code uses the slab ones
+		push(@outdata, $tab."CactusGrid slabGH(*$class"."::cctkGH);\n");
+		push(@outdata, $tab."CactusGrid *cctkGH = &slabGH;\n");
+		push(@outdata, $tab."CoordBox<$dim> box;\n");
+		push(@outdata, $tab."setupSlab(cctkGH, box, slab, nslabs);\n");
+		push(@outdata, $tab."CoordView x, y, z;\n");
+		for ($i = 0, $x = 'x'; $i < $dim; ++$i, ++$x) {
+			push(@outdata, $tab."$x.setup(cctkGH, $i);\n");
+		}
+	} else {
+		# the first object is fixed
+		# it's the box, clipped to the global grid by setupCctkGH
+		push(@outdata, $tab."CoordBox<$dim> box = target->boundingBox();\n");
+		push(@outdata, $tab."setupCctkGH(box);\n");
+	}
 
-	foreach my $group (keys %{$inf_ref}) {
+	foreach my $group (sort keys %{$inf_ref}) {
 		my ($i, $gtype, $vtype, $timelevels);
 
 		# init
@@ -99,7 +127,7 @@ sub buildObjectsDecl
 
 		for ($i = 0; $i < ($timelevels - 1); ++$i) {
 			foreach my $name (@{$inf_ref->{$group}{"names"}}) {
-				my $decl = "WriteMember_var_".$name.("_p" x $i)." $name".("_p" x $i)."(target);";
+				my $decl = "WriteMember_var_".$name.("_p" x $i)." $name".("_p" x $i)."(target, box$member);";
 				push(@outdata, $tab."$decl\n");
 			}
 		}
@@ -179,6 +207,32 @@ sub buildSpecialMacros
 	return;
 }
 
+#
+# Builds the parameter macros for the ensemble mode. The parameters
+# are arrays holding one value per ensemble member, the init code
+# uses the value of the ensemble member currently initialized.
+#
+# param:
+#  - par_ref: ref to parameter data hash
+#  - out_ref: ref to array where parameter macros will be stored
+#
+# return:
+#  - none, macros will be stored in out_ref
+#
+sub buildParameterMacros
+{
+	my ($par_ref, $out_ref) = @_;
+
+	return unless ($cinf_config{"ensemble_size"} > 1);
+
+	foreach my $name (sort keys %{$par_ref}) {
+		push(@$out_ref, "#define $name $name"."[ensembleMember]\n");
+	}
+	push(@$out_ref, "\n");
+
+	return;
+}
+
 #
 # Builds ADD_READ_MEMBER. This is needed for defining
 # read access to a cell member.
@@ -228,6 +282,9 @@ sub buildReadMemberMacro
 #
 # Builds ADD_WRITE_MEMBER. This is needed for defining
 # write access to a cell member to set initial values.
+# In ensemble mode the macro takes the pointers to the cell
+# members of all ensemble members and the WriteMember object
+# writes the one of the given ensemble member.
 #
 # param:
 #  - val_ref: ref to values hash
@@ -239,26 +296,32 @@ sub buildReadMemberMacro
 sub buildWriteMemberMacro
 {
 	my ($val_ref, $out_ref) = @_;
-	my ($cell_class, $dim);
+	my ($cell_class, $dim, $ensemble, $args, $field, $ptr, $ptr_init, $ptr_arg);
 
 	# init
 	$cell_class = $val_ref->{"cell_class_name"};
 	$dim        = $val_ref->{"dim"};
+	$ensemble   = $cinf_config{"ensemble_size"} > 1;
+	$args       = $ensemble ? "TYPE, MEMBER, ..." : "TYPE, MEMBER";
+	$field      = $ensemble ? ".*member" : ".MEMBER";
+	$ptr        = $ensemble ? ", TYPE $cell_class"."::*member" : "";
+	$ptr_init   = $ensemble ? ", member(member)" : "";
+	$ptr_arg    = $ensemble ? ", member" : "";
 
 	# build macro
 	push(@$out_ref, "// helper code to write data back to gridbase\n");
-	push(@$out_ref, "#define ADD_WRITE_MEMBER(TYPE, MEMBER) \\\n");
+	push(@$out_ref, "#define ADD_WRITE_MEMBER($args) \\\n");
 	push(@$out_ref, $tab."class WriteReference_##MEMBER \\\n");
 	push(@$out_ref, $tab."{ \\\n");
 	push(@$out_ref, $tab."public: \\\n");
-	push(@$out_ref, $tab.$tab."WriteReference_##MEMBER(const Coord<$dim>& pos, GridBase<$cell_class, $dim> *target) : \\\n");
-	push(@$out_ref, $tab.$tab.$tab."pos(pos), target(target) \\\n");
+	push(@$out_ref, $tab.$tab."WriteReference_##MEMBER(const Coord<$dim>& pos, GridBase<$cell_class, $dim> *target$ptr) : \\\n");
+	push(@$out_ref, $tab.$tab.$tab."pos(pos), target(target)$ptr_init \\\n");
 	push(@$out_ref, $tab.$tab."{} \\\n");
 	#push(@$out_ref, "\\\n");
 	push(@$out_ref, $tab.$tab."WriteReference_##MEMBER& operator=(CCTK_REAL value) \\\n");
 	push(@$out_ref, $tab.$tab."{ \\\n");
 	push(@$out_ref, $tab.$tab.$tab."$cell_class cell = target->get(pos); \\\n");
-	push(@$out_ref, $tab.$tab.$tab."cell.MEMBER = value; \\\n");
+	push(@$out_ref, $tab.$tab.$tab."cell$field = value; \\\n");
 	push(@$out_ref, $tab.$tab.$tab."target->set(pos, cell); \\\n");
 	push(@$out_ref, $tab.$tab.$tab."return *this; \\\n");
 	push(@$out_ref, $tab.$tab."} \\\n");
@@ -266,7 +329,7 @@ sub buildWriteMemberMacro
 	push(@$out_ref, $tab.$tab."WriteReference_##MEMBER& operator=(CCTK_INT value) \\\n");
 	push(@$out_ref, $tab.$tab."{ \\\n");
 	push(@$out_ref, $tab.$tab.$tab."$cell_class cell = target->get(pos); \\\n");
-	push(@$out_ref, $tab.$tab.$tab."cell.MEMBER = value; \\\n");
+	push(@$out_ref, $tab.$tab.$tab."cell$field = value; \\\n");
 	push(@$out_ref, $tab.$tab.$tab."target->set(pos, cell); \\\n");
 	push(@$out_ref, $tab.$tab.$tab."return *this; \\\n");
 	push(@$out_ref, $tab.$tab."} \\\n");
@@ -274,7 +337,7 @@ sub buildWriteMemberMacro
 	push(@$out_ref, $tab.$tab."WriteReference_##MEMBER& operator=(CCTK_BYTE value) \\\n");
 	push(@$out_ref, $tab.$tab."{ \\\n");
 	push(@$out_ref, $tab.$tab.$tab."$cell_class cell = target->get(pos); \\\n");
-	push(@$out_ref, $tab.$tab.$tab."cell.MEMBER = value; \\\n");
+	push(@$out_ref, $tab.$tab.$tab."cell$field = value; \\\n");
 	push(@$out_ref, $tab.$tab.$tab."target->set(pos, cell); \\\n");
 	push(@$out_ref, $tab.$tab.$tab."return *this; \\\n");
 	push(@$out_ref, $tab.$tab."} \\\n");
@@ -282,7 +345,7 @@ sub buildWriteMemberMacro
 	push(@$out_ref, $tab.$tab."WriteReference_##MEMBER& operator=(CCTK_CHAR value) \\\n");
 	push(@$out_ref, $tab.$tab."{ \\\n");
 	push(@$out_ref, $tab.$tab.$tab."$cell_class cell = target->get(pos); \\\n");
-	push(@$out_ref, $tab.$tab.$tab."cell.MEMBER = value; \\\n");
+	push(@$out_ref, $tab.$tab.$tab."cell$field = value; \\\n");
 	push(@$out_ref, $tab.$tab.$tab."target->set(pos, cell); \\\n");
 	push(@$out_ref, $tab.$tab.$tab."return *this; \\\n");
 	push(@$out_ref, $tab.$tab."} \\\n");
@@ -296,38 +359,49 @@ sub buildWriteMemberMacro
 	#push(@$out_ref, "\\\n");
 	push(@$out_ref, $tab.$tab."TYPE get() const \\\n");
 	push(@$out_ref, $tab.$tab."{ \\\n");
-	push(@$out_ref, $tab.$tab.$tab."return target->get(pos).MEMBER; \\\n");
+	push(@$out_ref, $tab.$tab.$tab."return target->get(pos)$field; \\\n");
 	push(@$out_ref, $tab.$tab."} \\\n");
 	#push(@$out_ref, "\\\n");
 	push(@$out_ref, $tab."private: \\\n");
 	push(@$out_ref, $tab.$tab."Coord<$dim> pos; \\\n");
 	push(@$out_ref, $tab.$tab."GridBase<$cell_class, $dim> *target; \\\n");
+	push(@$out_ref, $tab.$tab."TYPE $cell_class"."::*member; \\\n") if ($ensemble);
 	push(@$out_ref, $tab."}; \\\n");
 	#push(@$out_ref, "\\\n");
 	push(@$out_ref, $tab."class WriteMember_##MEMBER \\\n");
 	push(@$out_ref, $tab."{ \\\n");
 	push(@$out_ref, $tab."public: \\\n");
-	push(@$out_ref, $tab.$tab."WriteMember_##MEMBER(GridBase<$cell_class, $dim> *target) : \\\n");
-	push(@$out_ref, $tab.$tab.$tab."target(target), box(target->boundingBox()) \\\n");
-	push(@$out_ref, $tab.$tab."{} \\\n");
+	if ($ensemble) {
+		push(@$out_ref, $tab.$tab."WriteMember_##MEMBER(GridBase<$cell_class, $dim> *target, const CoordBox<$dim>& box, int ensembleMember) : \\\n");
+		push(@$out_ref, $tab.$tab.$tab."target(target), box(box) \\\n");
+		push(@$out_ref, $tab.$tab."{ \\\n");
+		push(@$out_ref, $tab.$tab.$tab."static TYPE $cell_class"."::* const members[] = { __VA_ARGS__ }; \\\n");
+		push(@$out_ref, $tab.$tab.$tab."member = members[ensembleMember]; \\\n");
+		push(@$out_ref, $tab.$tab."} \\\n");
+	} else {
+		push(@$out_ref, $tab.$tab."WriteMember_##MEMBER(GridBase<$cell_class, $dim> *target, const CoordBox<$dim>& box) : \\\n");
+		push(@$out_ref, $tab.$tab.$tab."target(target), box(box) \\\n");
+		push(@$out_ref, $tab.$tab."{} \\\n");
+	}
 	#push(@$out_ref, "\\\n");
 	push(@$out_ref, $tab.$tab."WriteReference_##MEMBER operator[](int index)\\\n");
 	push(@$out_ref, $tab.$tab."{ \\\n");
 	push(@$out_ref, $tab.$tab.$tab."Coord<$dim> c = box.origin + \\\n");
 	push(@$out_ref, $tab.$tab.$tab.$tab."box.dimensions.indexToCoord(index); \\\n");
-	push(@$out_ref, $tab.$tab.$tab."return WriteReference_##MEMBER(c, target); \\\n");
+	push(@$out_ref, $tab.$tab.$tab."return WriteReference_##MEMBER(c, target$ptr_arg); \\\n");
 	push(@$out_ref, $tab.$tab."} \\\n");
 	#push(@$out_ref, "\\\n");
 	push(@$out_ref, $tab."private: \\\n");
 	push(@$out_ref, $tab.$tab."GridBase<$cell_class, $dim> *target; \\\n");
 	push(@$out_ref, $tab.$tab."CoordBox<$dim> box; \\\n");
+	push(@$out_ref, $tab.$tab."TYPE $cell_class"."::*member; \\\n") if ($ensemble);
 	push(@$out_ref, $tab."};\n");
 
 	return;
 }
 
 #
-# Builds constructor. Sets x, y and z to NULL.
+# Builds constructor.
 #
 # param:
 #  - val_ref: ref to values hash
@@ -353,8 +427,7 @@ sub buildConstructor
 
 	# itMax contains the steps to perform
 	push(@outdata, $tab."explicit $class(const unsigned& itMax) :\n");
-	push(@outdata, $tab.$tab."SimpleInitializer<$cell_class>($size_coord, itMax),\n");
-	push(@outdata, $tab.$tab."x(0), y(0), z(0)\n");
+	push(@outdata, $tab.$tab."SimpleInitializer<$cell_class>($size_coord, itMax)\n");
 	push(@outdata, $tab."{}\n");
 
 	# save data
@@ -364,7 +437,7 @@ sub buildConstructor
 }
 
 #
-# Builds the deconstructor. This frees x, y and z.
+# Builds the deconstructor.
 #
 # param:
 #  - val_ref: ref to values hash
@@ -375,21 +448,14 @@ sub buildConstructor
 sub buildDeconstructor
 {
 	my ($val_ref) = @_;
-	my (@outdata, $class, $dim, $i, $x);
+	my (@outdata, $class);
 
 	# init
-	$dim   = $val_ref->{"dim"};
 	$class = $val_ref->{"class_name"};
 
-	# go
+	# go, x, y and z do not hold any memory
 	push(@outdata, $tab."virtual ~$class()\n");
-	push(@outdata, $tab."{\n");
-
-	for ($i = 0, $x = 'x'; $i < $dim; ++$i, ++$x) {
-		push(@outdata, $tab.$tab."delete[] $x;\n");
-	}
-
-	push(@outdata, $tab."}\n");
+	push(@outdata, $tab."{}\n");
 
 	# save data
 	$val_ref->{"deconstructor"} = join("", @outdata);
@@ -399,6 +465,7 @@ sub buildDeconstructor
 
 #
 # This functions sets up fake x,y,z. This would be done by CartGrid3D Thorn.
+# The coordinates are not stored, but computed on access by CoordView.
 # Generates the code in appropriate dimension.
 #
 # param:
@@ -410,73 +477,18 @@ sub buildDeconstructor
 sub buildXYZFunction
 {
 	my ($val_ref) = @_;
-	my (@outdata, $dim);
+	my (@outdata, $dim, $i, $x);
 
 	# init
 	$dim = $val_ref->{"dim"};
 
+	_err("Dimension $dim is too high!") if ($dim > 3);
+
 	push(@outdata, $tab."inline void setupXYZ()\n");
 	push(@outdata, $tab."{\n");
-
-	# switch dimension
-	if ($dim == 1) {
-		push(@outdata, $tab.$tab."int a = cctkGH->cctk_lsh()[0];\n");
-		push(@outdata, $tab.$tab."int size = a;\n");
-		push(@outdata, $tab.$tab."x = new CCTK_REAL[size];\n");
-		push(@outdata, $tab.$tab."int vindex, i;\n");
-		push(@outdata, $tab.$tab."int iend = cctkGH->cctk_lsh()[0];\n");
-		push(@outdata, $tab.$tab."CCTK_REAL X = cctkGH->cctk_origin_space()[0]+cctkGH->cctk_delta_space()[0]*cctkGH->cctk_lbnd()[0];\n");
-		push(@outdata, $tab.$tab."for (i = 0; i < iend; ++i, X += cctkGH->cctk_delta_space()[0]) {\n");
-		push(@outdata, $tab.$tab.$tab."vindex = i;\n");
-		push(@outdata, $tab.$tab.$tab."x[vindex] = X;\n");
-		push(@outdata, $tab.$tab."}\n");
-	} elsif ($dim == 2) {
-		push(@outdata, $tab.$tab."int a = cctkGH->cctk_lsh()[0];\n");
-		push(@outdata, $tab.$tab."int b = cctkGH->cctk_lsh()[1];\n");
-		push(@outdata, $tab.$tab."int size = a * b;\n");
-		push(@outdata, $tab.$tab."x = new CCTK_REAL[size];\n");
-		push(@outdata, $tab.$tab."y = new CCTK_REAL[size];\n");
-		push(@outdata, $tab.$tab."int vindex, i, j;\n");
-		push(@outdata, $tab.$tab."int iend = cctkGH->cctk_lsh()[0];\n");
-		push(@outdata, $tab.$tab."int jend = cctkGH->cctk_lsh()[1];\n");
-		push(@outdata, $tab.$tab."CCTK_REAL X = cctkGH->cctk_origin_space()[0]+cctkGH->cctk_delta_space()[0]*cctkGH->cctk_lbnd()[0];\n");
-		push(@outdata, $tab.$tab."CCTK_REAL Y = cctkGH->cctk_origin_space()[1]+cctkGH->cctk_delta_space()[1]*cctkGH->cctk_lbnd()[1];\n");
-		push(@outdata, $tab.$tab."for (j = 0; j < jend; ++j, Y += cctkGH->cctk_delta_space()[1]) {\n");
-		push(@outdata, $tab.$tab.$tab."for (i = 0; i < iend; ++i, X += cctkGH->cctk_delta_space()[0]) {\n");
-		push(@outdata, $tab.$tab.$tab.$tab."vindex = (i + iend * j);\n");
-		push(@outdata, $tab.$tab.$tab.$tab."x[vindex] = X; y[vindex] = Y;\n");
-		push(@outdata, $tab.$tab.$tab."}\n");
-		push(@outdata, $tab.$tab.$tab."X = cctkGH->cctk_origin_space()[0]+cctkGH->cctk_delta_space()[0]*cctkGH->cctk_lbnd()[0];\n");
-		push(@outdata, $tab.$tab."}\n");
-	} elsif ($dim == 3) {
-		push(@outdata, $tab.$tab."int a = cctkGH->cctk_lsh()[0];\n");
-		push(@outdata, $tab.$tab."int b = cctkGH->cctk_lsh()[1];\n");
-		push(@outdata, $tab.$tab."int c = cctkGH->cctk_lsh()[2];\n");
-		push(@outdata, $tab.$tab."int size = a * b * c;\n");
-		push(@outdata, $tab.$tab."x = new CCTK_REAL[size];\n");
-		push(@outdata, $tab.$tab."y = new CCTK_REAL[size];\n");
-		push(@outdata, $tab.$tab."z = new CCTK_REAL[size];\n");
-		push(@outdata, $tab.$tab."int vindex, i, j, k;\n");
-		push(@outdata, $tab.$tab."int iend = cctkGH->cctk_lsh()[0];\n");
-		push(@outdata, $tab.$tab."int jend = cctkGH->cctk_lsh()[1];\n");
-		push(@outdata, $tab.$tab."int kend = cctkGH->cctk_lsh()[2];\n");
-		push(@outdata, $tab.$tab."CCTK_REAL X = cctkGH->cctk_origin_space()[0]+cctkGH->cctk_delta_space()[0]*cctkGH->cctk_lbnd()[0];\n");
-		push(@outdata, $tab.$tab."CCTK_REAL Y = cctkGH->cctk_origin_space()[1]+cctkGH->cctk_delta_space()[1]*cctkGH->cctk_lbnd()[1];\n");
-		push(@outdata, $tab.$tab."CCTK_REAL Z = cctkGH->cctk_origin_space()[2]+cctkGH->cctk_delta_space()[2]*cctkGH->cctk_lbnd()[2];\n");
-		push(@outdata, $tab.$tab."for (k = 0; k < kend; ++k, Z += cctkGH->cctk_delta_space()[2]) {\n");
-		push(@outdata, $tab.$tab.$tab."for (j = 0; j < jend; ++j, Y += cctkGH->cctk_delta_space()[1]) {\n");
-		push(@outdata, $tab.$tab.$tab.$tab."for (i = 0; i < iend; ++i, X += cctkGH->cctk_delta_space()[0]) {\n");
-		push(@outdata, $tab.$tab.$tab.$tab.$tab."vindex = (i + iend * (j + jend * k));\n");
-		push(@outdata, $tab.$tab.$tab.$tab.$tab."x[vindex] = X; y[vindex] = Y; z[vindex] = Z;\n");
-		push(@outdata, $tab.$tab.$tab.$tab."}\n");
-		push(@outdata, $tab.$tab.$tab.$tab."X = cctkGH->cctk_origin_space()[0]+cctkGH->cctk_delta_space()[0]*cctkGH->cctk_lbnd()[0];\n");
-		push(@outdata, $tab.$tab.$tab."}\n");
-		push(@outdata, $tab.$tab.$tab."Y = cctkGH->cctk_origin_space()[1]+cctkGH->cctk_delta_space()[1]*cctkGH->cctk_lbnd()[1];\n");
-		push(@outdata, $tab.$tab."}\n");
-	} else {
-		_err("Dimension $dim is too high!");
+	for ($i = 0, $x = 'x'; $i < $dim; ++$i, ++$x) {
+		push(@outdata, $tab.$tab."$x.setup(cctkGH, $i);\n");
 	}
-
 	push(@outdata, $tab."}\n");
 
 	# save
@@ -506,30 +518,138 @@ sub buildCctkGHFunction
 	$dim = $val_ref->{"dim"};
 
 	# build function
-	push(@outdata, $tab."inline void setupCctkGH(const CoordBox<$dim>& box)\n");
+	push(@outdata, $tab."inline void setupCctkGH(CoordBox<$dim>& box)\n");
 	push(@outdata, $tab."{\n");
+	push(@outdata, $tab.$tab."int origin[$dim], dimensions[$dim];\n");
 	for ($i = 0, $x = 'x'; $i < $dim; ++$i, ++$x) {
-		my ($bbox_idx0, $bbox_idx1);
+		push(@outdata, $tab.$tab."origin[$i] = box.origin.$x();\n");
+		push(@outdata, $tab.$tab."dimensions[$i] = box.dimensions.$x();\n");
+	}
+	push(@outdata, $tab.$tab."cctkGH->setLocalBox(origin, dimensions);\n");
+	# the local part of this rank/region may be smaller than the
+	# bounding box of the target grid, since the box is clipped
+	for ($i = 0, $x = 'x'; $i < $dim; ++$i, ++$x) {
+		push(@outdata, $tab.$tab."box.origin.$x() = cctkGH->cctk_lbnd()[$i];\n");
+		push(@outdata, $tab.$tab."box.dimensions.$x() = cctkGH->cctk_lsh()[$i];\n");
+	}
+	push(@outdata, $tab."}\n");
 
-		$bbox_idx0 = 2 * $i;
-		$bbox_idx1 = 2 * $i + 1;
+	# save
+	$val_ref->{"cctk_func"} = join("", @outdata);
 
-		push(@outdata, $tab.$tab."cctkGH->cctk_lsh()[$i]  = box.dimensions.$x();\n");
-		push(@outdata, $tab.$tab."cctkGH->cctk_lbnd()[$i] = box.origin.$x();\n");
-		push(@outdata, $tab.$tab."cctkGH->cctk_ubnd()[$i] = box.origin.$x() + box.dimensions.$x() - 1;\n");
-		push(@outdata, $tab.$tab."cctkGH->cctk_bbox()[$bbox_idx0] = box.origin.$x() == 0;\n");
-		push(@outdata, $tab.$tab."cctkGH->cctk_bbox()[$bbox_idx1] = (box.origin.$x() + dimensions.$x()) == cctkGH->cctk_gsh()[$i];\n");
+	return;
+}
+
+#
+# This functions splits the local part of the grid hierarchy into slabs
+# along the last axis for the parallel initialization. Each slab is
+# evaluated by one thread. The split depends only on the number of slabs,
+# every grid point is computed by the same code, so the result does
+# not depend on the number of threads.
+#
+# param:
+#  - val_ref: ref to values hash
+#
+# return:
+#  - none, result will be stored in values hash using key "slab_func"
+#
+sub buildSlabFunction
+{
+	my ($val_ref) = @_;
+	my (@outdata, $dim, $i, $x, $last);
+
+	# init
+	$dim  = $val_ref->{"dim"};
+	$last = $dim - 1;
+
+	return unless ($cinf_config{"parallel_init"});
+
+	# number of slabs, at most one per thread and one per plane
+	push(@outdata, $tab."static inline int numSlabs()\n");
+	push(@outdata, $tab."{\n");
+	push(@outdata, $tab.$tab."int nslabs = 1;\n");
+	push(@outdata, "#ifdef _OPENMP\n");
+	push(@outdata, $tab.$tab."nslabs = omp_get_max_threads();\n");
+	push(@outdata, "#endif\n");
+	push(@outdata, $tab.$tab."if (nslabs > cctkGH->cctk_lsh()[$last])\n");
+	push(@outdata, $tab.$tab.$tab."nslabs = cctkGH->cctk_lsh()[$last];\n");
+	push(@outdata, $tab.$tab."return nslabs;\n");
+	push(@outdata, $tab."}\n");
+	push(@outdata, "\n");
+
+	# restricts gh, which is a copy of the rank's one, to a slab
+	push(@outdata, $tab."static inline void setupSlab(CactusGrid *gh, CoordBox<$dim>& box, int slab, int nslabs)\n");
+	push(@outdata, $tab."{\n");
+	push(@outdata, $tab.$tab."int origin[$dim], dimensions[$dim];\n");
+	push(@outdata, $tab.$tab."int n = gh->cctk_lsh()[$last];\n");
+	for ($i = 0; $i < $dim; ++$i) {
+		push(@outdata, $tab.$tab."origin[$i] = gh->cctk_lbnd()[$i];\n");
+		push(@outdata, $tab.$tab."dimensions[$i] = gh->cctk_lsh()[$i];\n");
+	}
+	push(@outdata, $tab.$tab."origin[$last] += slab * n / nslabs;\n");
+	push(@outdata, $tab.$tab."dimensions[$last] = (slab + 1) * n / nslabs - slab * n / nslabs;\n");
+	push(@outdata, $tab.$tab."gh->setLocalBox(origin, dimensions);\n");
+	for ($i = 0, $x = 'x'; $i < $dim; ++$i, ++$x) {
+		push(@outdata, $tab.$tab."box.origin.$x() = gh->cctk_lbnd()[$i];\n");
+		push(@outdata, $tab.$tab."box.dimensions.$x() = gh->cctk_lsh()[$i];\n");
 	}
 	push(@outdata, $tab."}\n");
 
 	# save
-	$val_ref->{"cctk_func"} = join("", @outdata);
+	$val_ref->{"slab_func"} = join("", @outdata);
+
+	return;
+}
+
+#
+# Builds the grid function for the parallel initialization. The local
+# part of the grid is split into slabs which are initialized concurrently.
+# Each slab calls all init functions in order.
+#
+# param:
+#  - val_ref  : ref to values hash
+#  - funcs_ref: ref to array of init functions taking a slab
+#  - out_ref  : ref to array where grid function will be stored
+#
+# return:
+#  - none, result will be stored in out_ref
+#
+sub buildParallelGridFunction
+{
+	my ($val_ref, $funcs_ref, $out_ref) = @_;
+	my ($dim, $init_class, $cell_class, $ensemble);
+
+	# init
+	$dim        = $val_ref->{"dim"};
+	$init_class = $val_ref->{"class_name"};
+	$cell_class = $val_ref->{"cell_class_name"};
+	$ensemble   = $cinf_config{"ensemble_size"} > 1;
+
+	push(@$out_ref, "void $init_class"."::"."grid(GridBase<$cell_class, $dim> *target)\n");
+	push(@$out_ref, "{\n");
+	push(@$out_ref, $tab."CoordBox<$dim> box = target->boundingBox();\n");
+	push(@$out_ref, $tab."setupCctkGH(box);\n");
+	push(@$out_ref, $tab."int nslabs = numSlabs();\n");
+	push(@$out_ref, "\n");
+	push(@$out_ref, "#pragma omp parallel for schedule(static)\n");
+	push(@$out_ref, $tab."for (int slab = 0; slab < nslabs; ++slab) {\n");
+	if ($ensemble) {
+		push(@$out_ref, $tab.$tab."for (int ensembleMember = 0; ensembleMember < ENSEMBLESIZE; ++ensembleMember) {\n");
+		push(@$out_ref, $tab.$tab.$tab.$_."(target, slab, nslabs, ensembleMember);\n") for (@$funcs_ref);
+		push(@$out_ref, $tab.$tab."}\n");
+	} else {
+		push(@$out_ref, $tab.$tab.$_."(target, slab, nslabs);\n") for (@$funcs_ref);
+	}
+	push(@$out_ref, $tab."}\n");
+	push(@$out_ref, "}\n");
 
 	return;
 }
 
 #
 # Builds grid function. This function sets up the initial grid.
+# In ensemble mode the init functions take the ensemble member
+# and the grid function calls them once per member.
 #
 # param:
 #  - init_ref: ref to hash where the cctk initial function(s) is/are stored
@@ -541,16 +661,18 @@ sub buildCctkGHFunction
 sub buildGridFunctions
 {
 	my ($init_ref, $val_ref) = @_;
-	my (@grid_func, @keys, $dim, $init_class, $cell_class, $decl);
+	my (@grid_func, @keys, $dim, $init_class, $cell_class, $decl, $parallel, $ensemble);
 
 	# init
 	$dim        = $val_ref->{"dim"};
 	$init_class = $val_ref->{"class_name"};
 	$cell_class = $val_ref->{"cell_class_name"};
 	$decl       = $val_ref->{"objects_decl"};
+	$parallel   = $cinf_config{"parallel_init"};
+	$ensemble   = $cinf_config{"ensemble_size"} > 1;
 	@keys       = keys %{$init_ref};
 
-	if (@keys == 1) {
+	if (@keys == 1 && !$ensemble) {
 		my ($func, $func_ref, $code_str);
 
 		# init
@@ -563,19 +685,34 @@ sub buildGridFunctions
 		# build code string
 		$code_str = join("\n", @$func_ref);
 
-		push(@grid_func, "void $init_class"."::"."grid(GridBase<$cell_class, $dim> *target)\n");
-		push(@grid_func, "{\n");
-		push(@grid_func, "$decl\n");
-		# call functions to set up variables
-		push(@grid_func, $tab."setupCctkGH(box);\n");
-		push(@grid_func, $tab."setupXYZ();\n");
-		push(@grid_func, "\n");
-		push(@grid_func, "$code_str\n");
-		push(@grid_func, "}\n");
-	} elsif (@keys > 1) {
+		if ($parallel) {
+			my (@init);
+
+			# the init code is evaluated slab by slab
+			push(@init, "void $init_class"."::"."initSlab(GridBase<$cell_class, $dim> *target, int slab, int nslabs)\n");
+			push(@init, "{\n");
+			push(@init, "$decl\n");
+			push(@init, "$code_str\n");
+			push(@init, "}\n");
+
+			push(@{$val_ref->{"init_funcs"}}, join("", @init));
+			push(@{$val_ref->{"init_decls"}}, "void initSlab(GridBase<$cell_class, $dim> *target, int slab, int nslabs);");
+
+			buildParallelGridFunction($val_ref, ["initSlab"], \@grid_func);
+		} else {
+			push(@grid_func, "void $init_class"."::"."grid(GridBase<$cell_class, $dim> *target)\n");
+			push(@grid_func, "{\n");
+			push(@grid_func, "$decl\n");
+			# call functions to set up variables, cctkGH is already set up by decl
+			push(@grid_func, $tab."setupXYZ();\n");
+			push(@grid_func, "\n");
+			push(@grid_func, "$code_str\n");
+			push(@grid_func, "}\n");
+		}
+	} elsif (@keys >= 1) {
 		# more than one function -> build and call them
 		foreach my $func (@keys) {
-			my (@init, $code_str, $func_ref, $def);
+			my (@init, $code_str, $func_ref, $def, $args);
 
 			# build init function
 			$func_ref = $init_ref->{$func}{"data"};
@@ -583,7 +720,10 @@ sub buildGridFunctions
 			util_indent($func_ref, 1);
 
 			$code_str = join("\n", @$func_ref);
-			push(@init, "void $init_class"."::"."$func(GridBase<$cell_class, $dim> *target)\n");
+			$args     = "GridBase<$cell_class, $dim> *target";
+			$args    .= ", int slab, int nslabs" if ($parallel);
+			$args    .= ", int ensembleMember" if ($ensemble);
+			push(@init, "void $init_class"."::"."$func($args)\n");
 			push(@init, "{\n");
 			push(@init, "$decl\n");
 			push(@init, "\n");
@@ -593,20 +733,30 @@ sub buildGridFunctions
 			push(@{$val_ref->{"init_funcs"}}, join("", @init));
 
 			# build definition for header file
-			$def = "void $func(GridBase<$cell_class, $dim> *target);";
+			$def = "void $func($args);";
 			push(@{$val_ref->{"init_decls"}}, $def);
 		}
 
 		# build grid func
-		push(@grid_func, "void $init_class"."::"."grid(GridBase<$cell_class, $dim> *target)\n");
-		push(@grid_func, "{\n");
-		push(@grid_func, "CoordBox<$dim> box = target->boundingBox();\n");
-		push(@grid_func, $tab."setupCctkGH(box);\n");
-		push(@grid_func, $tab."setupXYZ();\n");
-		# call them
-		push(@grid_func, "\n");
-		push(@grid_func, $tab.$_."(target);\n") for (@keys);
-		push(@grid_func, "}\n");
+		if ($parallel) {
+			buildParallelGridFunction($val_ref, \@keys, \@grid_func);
+		} else {
+			push(@grid_func, "void $init_class"."::"."grid(GridBase<$cell_class, $dim> *target)\n");
+			push(@grid_func, "{\n");
+			push(@grid_func, "CoordBox<$dim> box = target->boundingBox();\n");
+			push(@grid_func, $tab."setupCctkGH(box);\n");
+			push(@grid_func, $tab."setupXYZ();\n");
+			# call them
+			push(@grid_func, "\n");
+			if ($ensemble) {
+				push(@grid_func, $tab."for (int ensembleMember = 0; ensembleMember < ENSEMBLESIZE; ++ensembleMember) {\n");
+				push(@grid_func, $tab.$tab.$_."(target, ensembleMember);\n") for (@keys);
+				push(@grid_func, $tab."}\n");
+			} else {
+				push(@grid_func, $tab.$_."(target);\n") for (@keys);
+			}
+			push(@grid_func, "}\n");
+		}
 	} else {
 		# this should never happen, since the schedule functions ensure that
 		# at least one function is returned, even if it's not valid
@@ -647,6 +797,12 @@ sub buildInitHeader
 	push(@$out_ref, "#include <cmath>\n");
 	push(@$out_ref, "#include \"cctk.h\"\n");
 	push(@$out_ref, "#include \"cell.h\"\n");
+	push(@$out_ref, "#include \"coordview.h\"\n");
+	if ($cinf_config{"parallel_init"}) {
+		push(@$out_ref, "#ifdef _OPENMP\n");
+		push(@$out_ref, "#include <omp.h>\n");
+		push(@$out_ref, "#endif\n");
+	}
 	push(@$out_ref, "\n");
 	push(@$out_ref, "using namespace LibGeoDecomp;\n");
 	push(@$out_ref, "\n");
@@ -668,14 +824,18 @@ sub buildInitHeader
 	push(@$out_ref, "\n");
 	push(@$out_ref, "$val_ref->{\"cctk_func\"}");
 	push(@$out_ref, "\n");
+	if ($val_ref->{"slab_func"}) {
+		push(@$out_ref, "$val_ref->{\"slab_func\"}");
+		push(@$out_ref, "\n");
+	}
 	if ($val_ref->{"init_decls"}) {
 		push(@$out_ref, $tab."$_\n") for (@{$val_ref->{"init_decls"}});
 		push(@$out_ref, "\n");
 	}
 	push(@$out_ref, $tab."// fake x, y, z\n");
-	push(@$out_ref, $tab."CCTK_REAL *x;\n");
-	push(@$out_ref, $tab."CCTK_REAL *y;\n");
-	push(@$out_ref, $tab."CCTK_REAL *z;\n");
+	push(@$out_ref, $tab."CoordView x;\n");
+	push(@$out_ref, $tab."CoordView y;\n");
+	push(@$out_ref, $tab."CoordView z;\n");
 	push(@$out_ref, "};\n");
 	push(@$out_ref, "\n");
 	push(@$out_ref, "#endif /* _INIT_H_ */\n");
@@ -698,10 +858,19 @@ sub buildInitCpp
 	my ($val_ref, $out_ref) = @_;
 
 	push(@$out_ref, "#include \"init.h\"\n");
-	push(@$out_ref, "#include \"cctk_$val_ref->{\"class_name\"}.h\"\n");
-	push(@$out_ref, "\n");
-	push(@$out_ref, "// parameter initialisation to default values\n");
-	push(@$out_ref, "$val_ref->{'param_init'}\n");
+	# the parameter macros of the ensemble mode must not touch the definitions
+	if ($cinf_config{"ensemble_size"} > 1) {
+		push(@$out_ref, "\n");
+		push(@$out_ref, "// parameter initialisation to default values\n");
+		push(@$out_ref, "$val_ref->{'param_init'}\n");
+		push(@$out_ref, "#include \"cctk_$val_ref->{\"class_name\"}.h\"\n");
+		push(@$out_ref, "\n");
+	} else {
+		push(@$out_ref, "#include \"cctk_$val_ref->{\"class_name\"}.h\"\n");
+		push(@$out_ref, "\n");
+		push(@$out_ref, "// parameter initialisation to default values\n");
+		push(@$out_ref, "$val_ref->{'param_init'}\n");
+	}
 	push(@$out_ref, "CactusGrid* $val_ref->{\"class_name\"}::cctkGH = 0;\n");
 	push(@$out_ref, "\n");
 	push(@$out_ref, "// setting up initial grid\n");
@@ -735,13 +904,13 @@ sub preCheck
 	my ($thorninfo_ref, $inits_ref, $evols_ref) = @_;
 
 	# every init thorn should share variables with one of the evol thorns
-	foreach my $init_thorn (keys %{$inits_ref}) {
+	foreach my $init_thorn (sort keys %{$inits_ref}) {
 		my ($init_ar, $res);
 
 		$init_ar = $inits_ref->{$init_thorn}->{"thorn_arr"};
 		$res     = 0;
 
-		foreach my $evol_thorn (keys %{$evols_ref}) {
+		foreach my $evol_thorn (sort keys %{$evols_ref}) {
 			my ($cell_ar);
 
 			$cell_ar = $evols_ref->{$evol_thorn}{"thorn_arr"};
@@ -782,6 +951,7 @@ sub initValueHash
 	$val_ref->{"objects_decl"}    = "";
 	$val_ref->{"xyz_func"}        = "";
 	$val_ref->{"cctk_func"}       = "";
+	$val_ref->{"slab_func"}       = "";
 	$val_ref->{"grid_func"}       = "";
 	$val_ref->{"init_funcs"}      = ();
 	$val_ref->{"init_decls"}      = ();
@@ -821,7 +991,7 @@ sub createInitializerClass
 	preCheck($thorninfo_ref, $config_ref->{"init_thorns"}, $config_ref->{"evol_thorns"});
 
 	# get data
-	foreach my $key (keys %{$config_ref->{"init_thorns"}}) {
+	foreach my $key (sort keys %{$config_ref->{"init_thorns"}}) {
 		my (%init_thorn, $thorndir, $thorn, $impl, $init_ar);
 
 		# init
@@ -845,11 +1015,13 @@ sub createInitializerClass
 
 	# build init specific special macros
 	buildSpecialMacros(\%values, $cell_ref->{"inf_data"}, \@special_macros);
+	buildParameterMacros(\%param_data, \@special_macros);
 
 	# build grid, setupXYZ and setupCctkGH function as well as (de|con)structor
 	buildGridFunctions(\%init_funcs, \%values);
 	buildXYZFunction(\%values);
 	buildCctkGHFunction(\%values);
+	buildSlabFunction(\%values);
 	buildConstructor(\%values);
 	buildDeconstructor(\%values);
 
@@ -14,12 +14,12 @@ use Exporter 'import';
 use FindBin qw($RealBin);
 use Cactusinterfacing::Config qw(%cinf_config);
 use Cactusinterfacing::Utils qw(util_readFile util_writeFile util_cp util_mkdir
-								util_tidySrcDir _err util_rmdir);
-use Cactusinterfacing::Make qw(createLibgeodecompMakefile);
+								util_tidySrcDir _err _warn util_rmdir util_syncDir);
+use Cactusinterfacing::Make qw(createLibgeodecompMakefile createPrecompiledHeader);
 use Cactusinterfacing::CreateCellClass qw(createCellClass);
 use Cactusinterfacing::CreateInitializerClass qw(createInitializerClass);
 use Cactusinterfacing::Libgeodecomp qw(buildCctkSteerer getBOVWriter
-									   getVisItWriter);
+									   getVisItWriter getReducer);
 use Cactusinterfacing::ThornList qw(parseThornList);
 
 # exports
@@ -28,6 +28,22 @@ our @EXPORT_OK = qw(createLibgeodecompApp);
 # tab
 my $tab = $cinf_config{"tab"};
 
+#
+# Checks whether the allocations go through MemoryPolicy, i.e. whether
+# huge pages, a NUMA node or out-of-core grids are requested.
+#
+# param:
+#  - none
+#
+# return:
+#  - true if memorypolicy.cpp is part of the application, else false
+#
+sub useMemoryPolicy
+{
+	return $cinf_config{"memory_policy"} ne "default" || $cinf_config{"numa_node"} >= 0 ||
+		$cinf_config{"out_of_core_dir"} ne "";
+}
+
 #
 # Builds the complete main.cpp.
 #
@@ -35,6 +51,7 @@ my $tab = $cinf_config{"tab"};
 #  - opt_ref  : ref to option hash
 #  - bov_ref  : ref to bov writer array
 #  - visit_ref: ref to visit writer array
+#  - red_ref  : ref to hash of reducer arrays ("reducer", "adaptive")
 #  - init_ref : ref to init hash
 #  - cell_ref : ref to cell hash
 #  - out_ref  : ref to an array where to store the complete main.cpp
@@ -44,11 +61,12 @@ my $tab = $cinf_config{"tab"};
 #
 sub createMain
 {
-	my ($opt_ref, $bov_ref, $visit_ref, $init_ref, $cell_ref, $out_ref) = @_;
-	my ($mpi, $cell_class);
+	my ($opt_ref, $bov_ref, $visit_ref, $red_ref, $init_ref, $cell_ref, $out_ref) = @_;
+	my ($mpi, $tiling, $cell_class);
 
 	# init
 	$mpi        = $opt_ref->{"mpi"};
+	$tiling     = $opt_ref->{"tiling"};
 	$cell_class = $cell_ref->{"class_name"};
 
 	# build main.cpp
@@ -57,10 +75,27 @@ sub createMain
 	push(@$out_ref, "#include <libgeodecomp/io/bovwriter.h>\n") if ($mpi);
 	push(@$out_ref, "#include <libgeodecomp/io/serialbovwriter.h>\n") if (!$mpi);
 	push(@$out_ref, "#include <libgeodecomp/io/visitwriter.h>\n");
+	if ($mpi) {
+		my ($partition_header, $balancer_header);
+
+		$partition_header = "\L$cinf_config{\"partition\"}\Epartition.h";
+		$balancer_header  = "\L$cinf_config{\"load_balancer\"}\Ebalancer.h";
+		push(@$out_ref, "#include <libgeodecomp/parallelization/hiparsimulator/partitions/$partition_header>\n");
+		push(@$out_ref, "#include <libgeodecomp/loadbalancer/$balancer_header>\n")
+			if ($cinf_config{"load_balancer"} ne "none");
+	}
 	push(@$out_ref, "#include \"cell.h\"\n");
 	push(@$out_ref, "#include \"init.h\"\n");
 	push(@$out_ref, "#include \"parparser.h\"\n");
 	push(@$out_ref, "#include \"cctksteerer.h\"\n");
+	push(@$out_ref, "#include \"symmetryboundary.h\"\n");
+	push(@$out_ref, "#include \"memoryreport.h\"\n");
+	push(@$out_ref, "#include \"memorypolicy.h\"\n") if (useMemoryPolicy());
+	push(@$out_ref, "#include \"perfcounters.h\"\n") if ($cinf_config{"perf_counters"});
+	push(@$out_ref, "#include \"roofline.h\"\n") if ($cinf_config{"roofline"});
+	push(@$out_ref, "#include \"cctkreducer.h\"\n") if (@{$red_ref->{"reducer"}});
+	push(@$out_ref, "#include \"parameter.h\"\n");
+	push(@$out_ref, "#include \"tiledsimulator.h\"\n") if ($tiling);
 	push(@$out_ref, "\n");
 	push(@$out_ref, "using namespace LibGeoDecomp;\n");
 	push(@$out_ref, "\n");
@@ -70,7 +105,8 @@ sub createMain
 	push(@$out_ref, $tab."delete ".$cell_class."::staticData.cctkGH;\n");
 	push(@$out_ref, "}\n");
 	push(@$out_ref, "\n");
-	createRunSimulation($opt_ref, $bov_ref, $visit_ref, $init_ref, $cell_ref, $out_ref);
+	createRunSimulation($opt_ref, $bov_ref, $visit_ref, $red_ref, $init_ref, $cell_ref,
+						$out_ref);
 	push(@$out_ref, "\n");
 	push(@$out_ref, "int main(int argc, char** argv)\n");
 	push(@$out_ref, "{\n");
@@ -78,14 +114,14 @@ sub createMain
 		push(@$out_ref, $tab."MPI_Init(&argc, &argv);\n");
 		push(@$out_ref, "\n");
 	}
-	push(@$out_ref, $tab."runSimulation(argv[1]);\n");
+	push(@$out_ref, $tab."int ret = runSimulation(argv[1]);\n");
 	push(@$out_ref, "\n");
 	push(@$out_ref, $tab."cleanup();\n");
 	push(@$out_ref, "\n");
 	if ($mpi) {
 		push(@$out_ref, $tab."MPI_Finalize();\n");
 	}
-	push(@$out_ref, $tab."return 0;\n");
+	push(@$out_ref, $tab."return ret;\n");
 	push(@$out_ref, "}\n");
 	push(@$out_ref, "\n");
 
@@ -99,6 +135,7 @@ sub createMain
 #  - opt_ref  : ref to options hash
 #  - bov_ref  : ref to bov writer array
 #  - visit_ref: ref to visit writer array
+#  - red_ref  : ref to hash of reducer arrays ("reducer", "adaptive")
 #  - init_ref : ref to init hash
 #  - cell_ref : ref to cell hash
 #  - out_ref  : ref to store runSimulation function
@@ -108,7 +145,7 @@ sub createMain
 #
 sub createRunSimulation
 {
-	my ($opt_ref, $bov_ref, $visit_ref, $init_ref, $cell_ref, $out_ref) = @_;
+	my ($opt_ref, $bov_ref, $visit_ref, $red_ref, $init_ref, $cell_ref, $out_ref) = @_;
 	my ($mpi, $dim, $init_class, $cell_class, $static_pointer);
 
 	# init
@@ -118,7 +155,7 @@ sub createRunSimulation
 	$cell_class     = $cell_ref->{"class_name"};
 	$static_pointer = "&" . $cell_class . "::staticData";
 
-	push(@$out_ref, "static void runSimulation(const char *paramFile)\n");
+	push(@$out_ref, "static int runSimulation(const char *paramFile)\n");
 	push(@$out_ref, "{\n");
 	push(@$out_ref, $tab."ParParser parser(paramFile);\n");
 	push(@$out_ref, $tab."parser.parse();\n");
@@ -128,13 +165,96 @@ sub createRunSimulation
 	push(@$out_ref, $tab.$cell_class."::staticData.cctkGH = cctkGH;\n");
 	push(@$out_ref, $tab.$init_class."::cctkGH = cctkGH;\n");
 	push(@$out_ref, "\n");
+	if ($cinf_config{"out_of_core_dir"} ne "") {
+		push(@$out_ref, $tab."// estimate memory usage, the grids are out of core, so there's no limit\n");
+	} else {
+		push(@$out_ref, $tab."// estimate memory usage, refuse to run if it exceeds the limit\n");
+	}
+	if ($mpi) {
+		my $layout;
+
+		# the balancer moves the parts, so only the initial layout is known
+		$layout = "IRREGULAR";
+		$layout = "STRIPES"   if ($cinf_config{"partition"} eq "Striping");
+		$layout = "BISECTION" if ($cinf_config{"partition"} eq "RecursiveBisection");
+		$layout = "IRREGULAR" if ($cinf_config{"load_balancer"} ne "none");
+		push(@$out_ref, $tab."MemoryReport<$cell_class> memory(cctkGH, GHOSTZONEWIDTH * MPIGHOSTZONEWIDTH, MPILayer().size(),\n");
+		push(@$out_ref, $tab.$tab."MemoryReport<$cell_class>::$layout);\n");
+		push(@$out_ref, $tab."if (MPILayer().rank() == 0)\n");
+		push(@$out_ref, $tab.$tab."memory.print(std::cout);\n");
+	} else {
+		push(@$out_ref, $tab."MemoryReport<$cell_class> memory(cctkGH, GHOSTZONEWIDTH);\n");
+		push(@$out_ref, $tab."memory.print(std::cout);\n");
+	}
+	if ($cinf_config{"out_of_core_dir"} eq "") {
+		push(@$out_ref, $tab."if (!memory.fits(parser.memoryLimit())) {\n");
+		push(@$out_ref, $tab.$tab."std::cerr << \"Estimated memory usage exceeds libgeodecomp::memory_limit of \"\n");
+		push(@$out_ref, $tab.$tab.$tab."<< parser.memoryLimit() << \" MiB, aborting\" << std::endl;\n");
+		push(@$out_ref, $tab.$tab."return 1;\n");
+		push(@$out_ref, $tab."}\n");
+	} else {
+		push(@$out_ref, $tab."// the window has to hold the planes of the stencil of both grids\n");
+		push(@$out_ref, $tab."MemoryPolicy::reserveWindow(2 * (2 * GHOSTZONEWIDTH + 2) * memory.planeBytes(),\n");
+		push(@$out_ref, $tab.$tab."2 * ${cell_class}::SOAMEMBERS);\n");
+	}
+	push(@$out_ref, "\n");
+	if ($cinf_config{"roofline"}) {
+		my $flops = $cell_ref->{"flops"};
+
+		push(@$out_ref, $tab."// probe bandwidth and peak flops before the grids are allocated\n");
+		push(@$out_ref, $tab."RooflineReport<$cell_class, CCTK_REAL> *roofline =\n");
+		push(@$out_ref, $tab.$tab."new RooflineReport<$cell_class, CCTK_REAL>($flops);\n");
+		push(@$out_ref, "\n");
+	}
 	push(@$out_ref, $tab."$init_class *init = new $init_class(parser.itMax());\n");
-	push(@$out_ref, $tab."CctkSteerer *steerer = new CctkSteerer($static_pointer);\n");
+	if (@{$red_ref->{"adaptive"}}) {
+		push(@$out_ref, $tab."// adapt time step for courant_speed, if a speed is given\n");
+		push(@$out_ref, $tab."AdaptiveTimeStep<$cell_class> *adaptive = 0;\n");
+		push(@$out_ref, $tab."if (!parser.courantSpeedVariable().empty()) {\n");
+		push(@$out_ref, $tab.$tab."adaptive = new AdaptiveTimeStep<$cell_class>(\n");
+		push(@$out_ref, $tab.$tab.$tab."cctkGH, parser.courantFac(), parser.courantEvery(), " .
+			 ($mpi ? "true, MPIGHOSTZONEWIDTH" : "false") . ");\n");
+		push(@$out_ref, $tab.$tab.$_) for (@{$red_ref->{"adaptive"}});
+		push(@$out_ref, $tab.$tab."adaptive->setup(parser.courantSpeedVariable());\n");
+		if ($mpi) {
+			push(@$out_ref, $tab.$tab."// the time step may only change between two halo exchanges\n");
+			push(@$out_ref, $tab.$tab."if (MPILayer().rank() == 0 && adaptive->period() != parser.courantEvery())\n");
+			push(@$out_ref, $tab.$tab.$tab."std::cout << \"libgeodecomp::courant_every rounded up to \" << adaptive->period()\n");
+			push(@$out_ref, $tab.$tab.$tab.$tab."<< \", a multiple of the MPI ghostzone width\" << std::endl;\n");
+		}
+		push(@$out_ref, $tab."}\n");
+		push(@$out_ref, $tab."CctkSteerer *steerer = new CctkSteerer($static_pointer, adaptive);\n");
+	} else {
+		push(@$out_ref, $tab."CctkSteerer *steerer = new CctkSteerer($static_pointer);\n");
+	}
 	push(@$out_ref, "\n");
 
+	# symmetry boundaries need fixed subdomains, see symmetryboundary.h
+	if ($mpi && $cinf_config{"load_balancer"} ne "none") {
+		push(@$out_ref, $tab."if (parser.symmetryMirror(0) || parser.symmetryMirror(1) || parser.symmetryMirror(2)) {\n");
+		push(@$out_ref, $tab.$tab."if (MPILayer().rank() == 0)\n");
+		push(@$out_ref, $tab.$tab.$tab."std::cerr << \"Symmetric domains cannot be load balanced, \"\n");
+		push(@$out_ref, $tab.$tab.$tab.$tab."<< \"rerun this tool with load_balancer = none\" << std::endl;\n");
+		push(@$out_ref, $tab.$tab."return 1;\n");
+		push(@$out_ref, $tab."}\n");
+		push(@$out_ref, "\n");
+	}
+
 	# switch simulator
 	if ($mpi) {
-		push(@$out_ref, $tab."HiParSimulator::HiParSimulator<$cell_class, RecursiveBisectionPartition<$dim> > sim(init);\n");
+		my ($partition, $balancer);
+
+		$partition = $cinf_config{"partition"} . "Partition<$dim>";
+		$balancer  = $cinf_config{"load_balancer"} eq "none" ? "0" :
+			"new $cinf_config{\"load_balancer\"}Balancer()";
+		push(@$out_ref, $tab."HiParSimulator::HiParSimulator<$cell_class, $partition > sim(\n");
+		push(@$out_ref, $tab.$tab."init, $balancer, parser.loadBalancingPeriod(),\n");
+		push(@$out_ref, $tab.$tab."MPIGHOSTZONEWIDTH);\n");
+	} elsif ($opt_ref->{"tiling"}) {
+		push(@$out_ref, $tab."TiledSimulator<$cell_class> sim(init);\n");
+		# the auto-tuning sweeps of the constructor are not part of the simulation
+		push(@$out_ref, $tab."PerfCounters::resetFunctions();\n")
+			if ($cinf_config{"perf_counters"} > 1);
 	} else {
 		push(@$out_ref, $tab."SerialSimulator<$cell_class> sim(init);\n");
 	}
@@ -168,8 +288,32 @@ sub createRunSimulation
 
 	# add steerer
 	push(@$out_ref, $tab."sim.addSteerer(steerer);\n");
+	push(@$out_ref, $tab."sim.addSteerer(new MemoryPolicyReport<$cell_class>());\n")
+		if (useMemoryPolicy());
+	push(@$out_ref, $tab."sim.addSteerer(new PerfSteerer<$cell_class>());\n")
+		if ($cinf_config{"perf_counters"});
+	push(@$out_ref, $tab."sim.addSteerer(roofline);\n") if ($cinf_config{"roofline"});
+
+	# add reflection for bitant, quadrant and octant domains
+	push(@$out_ref, $tab."int mirror[3] = { parser.symmetryMirror(0), parser.symmetryMirror(1), parser.symmetryMirror(2) };\n");
+	push(@$out_ref, $tab."if (mirror[0] || mirror[1] || mirror[2])\n");
+	push(@$out_ref, $tab.$tab."sim.addSteerer(new SymmetryBoundary<$cell_class>(mirror, GHOSTZONEWIDTH));\n");
+
+	# add reducer, if reductions are given
+	if (@{$red_ref->{"reducer"}}) {
+		push(@$out_ref, $tab."if (!parser.reductions().empty()) {\n");
+		push(@$out_ref, $tab.$tab."CctkReducer<$cell_class> *reducer =\n");
+		push(@$out_ref, $tab.$tab.$tab."new CctkReducer<$cell_class>(parser.reductionEvery(), " .
+			 ($mpi ? "true" : "false") . ", mirror, GHOSTZONEWIDTH);\n");
+		push(@$out_ref, $tab.$tab.$_) for (@{$red_ref->{"reducer"}});
+		push(@$out_ref, $tab.$tab."reducer->setup(parser.reductions());\n");
+		push(@$out_ref, $tab.$tab."sim.addSteerer(reducer);\n");
+		push(@$out_ref, $tab."}\n");
+	}
 	push(@$out_ref, "\n");
 	push(@$out_ref, $tab."sim.run();\n");
+	push(@$out_ref, "\n");
+	push(@$out_ref, $tab."return 0;\n");
 	push(@$out_ref, "}\n");
 	push(@$out_ref, "\n");
 
@@ -216,6 +360,18 @@ sub createParameterHeader
 	# actually it's good to know the dimension and width of ghostzones
 	push(@$out_ref, "#define CCTKGHDIM $dim\n");
 	push(@$out_ref, "#define GHOSTZONEWIDTH $cinf_config{\"ghostzone_width\"}\n");
+	push(@$out_ref, "#define MPIGHOSTZONEWIDTH $cinf_config{\"mpi_ghostzone_width\"}\n");
+	push(@$out_ref, "#define MEMORYLIMIT $cinf_config{\"memory_limit\"}\n");
+	push(@$out_ref, "#define ENSEMBLESIZE $cinf_config{\"ensemble_size\"}\n")
+		if ($cinf_config{"ensemble_size"} > 1);
+	if (useMemoryPolicy()) {
+		push(@$out_ref, "#define MEMORYPOLICY MemoryPolicy::\U$cinf_config{\"memory_policy\"}\E\n");
+		push(@$out_ref, "#define NUMANODE $cinf_config{\"numa_node\"}\n");
+		if ($cinf_config{"out_of_core_dir"} ne "") {
+			push(@$out_ref, "#define OUTOFCOREDIR \"$cinf_config{\"out_of_core_dir\"}\"\n");
+			push(@$out_ref, "#define OUTOFCOREWINDOW $cinf_config{\"out_of_core_window\"}\n");
+		}
+	}
 	push(@$out_ref, "\n");
 	push(@$out_ref, "#define $setup_thorn \\\n");
 	push(@$out_ref, $tab."do { \\\n");
@@ -366,6 +522,9 @@ sub setupIncludeDir
 #  - Makefile
 # into directory ./$config where $config is the name of the cactus configuration.
 # The output directory is configurable by config_ref, key is "outputdir".
+# The code is generated into a staging directory first. Afterwards only the
+# files whose content changed are copied into the output directory, so the
+# timestamps of unchanged files are kept and make rebuilds only what changed.
 #
 # param:
 #  - config_ref: ref to config hash
@@ -376,34 +535,54 @@ sub setupIncludeDir
 sub createLibgeodecompApp
 {
 	my ($config_ref) = @_;
-	my ($outputdir, $mpi, $writer_type);
+	my ($outputdir, $targetdir, $mpi, $writer_type);
 	my (%option, %thorninfo);
-	my (%cell, %init, @main, @make, @cctksteerer, @bovwriter, @visitwriter);
+	my (%cell, %init, @main, @make, @pch, @cctksteerer, @bovwriter, @visitwriter);
+	my (%reducer);
 
 	# init
 	parseThornList($config_ref, \%thorninfo, \%option);
-	$outputdir   = $config_ref->{"outputdir"} . "/" . $config_ref->{"config"};
+	$targetdir   = $config_ref->{"outputdir"} . "/" . $config_ref->{"config"};
+	$outputdir   = $config_ref->{"outputdir"} . "/." . $config_ref->{"config"} . ".staging";
 	$mpi         = $option{"mpi"};
 	$writer_type = $mpi ? "normal" : "serial";
 
-	# create directory where to store code, delete it first
+	# create staging directory where to store code, delete it first
 	util_rmdir($outputdir) if     (-d $outputdir);
 	util_mkdir($outputdir) unless (-d $outputdir);
 
 	# gen Makefile and write
 	createLibgeodecompMakefile($config_ref, \%option, \@make);
 	util_writeFile(\@make, $outputdir."/Makefile");
+	if ($cinf_config{"precompiled_header"}) {
+		createPrecompiledHeader(\%option, \@pch);
+		util_writeFile(\@pch, $outputdir."/pch.h");
+	}
 
 	# get cell, init, writers
 	createCellClass($config_ref, \%thorninfo, \%option, \%cell);
 	createInitializerClass($config_ref, \%thorninfo, \%cell, \%init);
+	getReducer($cell{"inf_data"}, $cell{"class_name"}, "reducer", 1, \@{$reducer{"reducer"}});
+	getReducer($cell{"inf_data"}, $cell{"class_name"}, "adaptive", 0, \@{$reducer{"adaptive"}});
 	buildCctkSteerer($cell{"class_name"}, $cell{"static_data_class"}{"class_name"},
-					 \@cctksteerer);
+					 scalar(@{$reducer{"adaptive"}}), \@cctksteerer);
 	getBOVWriter($cell{"inf_data"}, $cell{"class_name"}, $writer_type, \@bovwriter);
 	getVisItWriter($cell{"inf_data"}, $cell{"class_name"}, \@visitwriter);
 
+	# tiling is only implemented for the serial simulator and 3D cells
+	$option{"tiling"} = 0;
+	if ($cinf_config{"tiling"}) {
+		if ($mpi) {
+			_warn("Tiling is not supported by the MPI application, ignoring it");
+		} elsif ($cell{"dim"} != 3) {
+			_warn("Tiling needs a 3D thorn, ignoring it");
+		} else {
+			$option{"tiling"} = 1;
+		}
+	}
+
 	# build main()
-	createMain(\%option, \@bovwriter, \@visitwriter, \%init, \%cell, \@main);
+	createMain(\%option, \@bovwriter, \@visitwriter, \%reducer, \%init, \%cell, \@main);
 
 	# write main, cell, init, selectors, static data class and steerer
 	util_writeFile(\@main,                 $outputdir."/main.cpp");
@@ -423,12 +602,31 @@ sub createLibgeodecompApp
 	util_cp("$RealBin/src/parparser/parparser.cpp", $outputdir);
 	util_cp("$RealBin/src/types/cactusgrid.h",      $outputdir);
 	util_cp("$RealBin/src/types/cactusgrid.cpp",    $outputdir);
+	util_cp("$RealBin/src/types/coordview.h",       $outputdir);
+	util_cp("$RealBin/src/types/memoryreport.h",    $outputdir);
+	util_cp("$RealBin/src/types/memorypolicy.h",    $outputdir)
+		if (useMemoryPolicy());
+	util_cp("$RealBin/src/types/memorypolicy.cpp",  $outputdir)
+		if (useMemoryPolicy());
 	util_cp("$RealBin/src/vector/vector.h",         $outputdir)
 		if ($cinf_config{"use_vectorization"});
+	util_cp("$RealBin/src/simulator/tiledsimulator.h", $outputdir)
+		if ($option{"tiling"});
+	util_cp("$RealBin/src/steerer/symmetryboundary.h", $outputdir);
+	util_cp("$RealBin/src/steerer/cctkreducer.h", $outputdir)
+		if (@{$reducer{"reducer"}});
+	util_cp("$RealBin/src/steerer/perfcounters.h", $outputdir)
+		if ($cinf_config{"perf_counters"});
+	util_cp("$RealBin/src/steerer/roofline.h", $outputdir)
+		if ($cinf_config{"roofline"});
 
 	# tidy source code
 	util_tidySrcDir($outputdir);
 
+	# update changed files only
+	util_syncDir($outputdir, $targetdir);
+	util_rmdir($outputdir);
+
 	return;
 }
 
@@ -80,7 +80,7 @@ sub buildBovSelector
 	# init
 	$class    = "Bov\U$name\ESelector";
 	if ($type eq "CCTK_REAL") {
-		$datatype = "DOUBLE";
+		$datatype = $cinf_config{"real_precision"} eq "single" ? "FLOAT" : "DOUBLE";
 	} elsif ($type eq "CCTK_INT") {
 		$datatype = "INT";
 	} elsif ($type = "CCTK_BYTE") {
@@ -147,12 +147,12 @@ sub buildHeader
 	push(@$out_ref, "#include \"cctk_Types.h\"\n");
 	push(@$out_ref, "\n");
 
-	for my $asciiwriter (keys %{$ascii_ref}) {
+	for my $asciiwriter (sort keys %{$ascii_ref}) {
 		push(@$out_ref, $_) for (@{$ascii_ref->{$asciiwriter}{"data"}});
 		push(@$out_ref, "\n");
 	}
 
-	for my $bovwriter (keys %{$bov_ref}) {
+	for my $bovwriter (sort keys %{$bov_ref}) {
 		push(@$out_ref, $_) for (@{$bov_ref->{$bovwriter}{"data"}});
 		push(@$out_ref, "\n");
 	}
@@ -180,7 +180,7 @@ sub createSelectors
 	my (@header, %bovwriter, %asciiwriter);
 
 	# build selectors
-	for my $group (keys %{$inf_ref}) {
+	for my $group (sort keys %{$inf_ref}) {
 		my (@names, $gtype, $vtype);
 
 		# init
@@ -36,7 +36,7 @@ sub buildInterfaceStrings
 	my ($inf_ref, $val_ref) = @_;
 	my (@def);
 
-	foreach my $group (keys %{$inf_ref}) {
+	foreach my $group (sort keys %{$inf_ref}) {
 		my ($i, $gtype, $vtype, $size, $timelevels, $desc);
 
 		# init
@@ -103,6 +103,8 @@ sub buildHeader
 	push(@$out_ref, "\n");
 	push(@$out_ref, "#include \"cctk_Types.h\"\n");
 	push(@$out_ref, "#include \"cactusgrid.h\"\n");
+	# ENSEMBLESIZE
+	push(@$out_ref, "#include \"parameter.h\"\n") if ($cinf_config{"ensemble_size"} > 1);
 	push(@$out_ref, "\n");
 	push(@$out_ref, "class $class\n");
 	push(@$out_ref, "{\n");
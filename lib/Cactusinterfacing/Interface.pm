@@ -13,6 +13,7 @@ use Cactusinterfacing::Config qw(%cinf_config);
 use Cactusinterfacing::Utils qw(read_file util_indent _warn _err);
 use Cactusinterfacing::InterfaceParser qw(parse_interface_ccl);
 use Cactusinterfacing::ThornList qw(getInherits getFriends);
+use Cactusinterfacing::Libgeodecomp qw(getStorageType getEnsembleNames);
 
 # exports
 our @EXPORT_OK = qw(getInterfaceVars getAllInterfaceVars buildInterfaceStrings
@@ -224,7 +225,7 @@ sub buildInterfaceStrings
 	$gfs_cnt = 0;
 
 	# build interface variables strings
-	foreach my $group (keys %{$inf_ref}) {
+	foreach my $group (sort keys %{$inf_ref}) {
 		my ($i, $gtype, $vtype, $timelevels, $desc, $size);
 
 		# init
@@ -244,15 +245,17 @@ sub buildInterfaceStrings
 
 			# grid functions become normal cell members
 			for ($i = 0; $i < ($timelevels - 1); ++$i) {
-				my ($past_name);
+				my ($past_name, $type);
 
 				# build past_name with appending _p and prepend var_
 				$past_name = "var_" . $name . ("_p" x $i);
+				$type      = getStorageType($vtype, $name, $i);
 
-				push(@inf_vars,    "$vtype $past_name;");
-				# for cell member and constructor declaration
-				push(@c_vars,      "const $vtype& _$past_name = $cinf_config{\"scalar\"}");
-				push(@c_init_vars, "$past_name(_$past_name)");
+				push(@inf_vars,    "$type $_;") for (getEnsembleNames($past_name));
+				# for cell member and constructor declaration,
+				# all ensemble members start with the same value
+				push(@c_vars,      "const $type& _$past_name = $cinf_config{\"scalar\"}");
+				push(@c_init_vars, "$_(_$past_name)") for (getEnsembleNames($past_name));
 				++$gfs_cnt;
 			}
 		}
@@ -290,7 +293,7 @@ sub containsMixedTypes
 	return 0 unless (scalar (keys %{$inf_ref}));
 	$type = $inf_ref->{(keys %{$inf_ref})[0]}{"vtype"};
 
-	foreach my $key (keys %{$inf_ref}) {
+	foreach my $key (sort keys %{$inf_ref}) {
 		return 1 unless ($inf_ref->{$key}{"vtype"} eq $type);
 	}
 
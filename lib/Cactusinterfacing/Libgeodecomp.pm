@@ -11,12 +11,14 @@ use strict;
 use warnings;
 use Exporter 'import';
 use Cactusinterfacing::Config qw(%cinf_config);
-use Cactusinterfacing::Utils qw(_warn util_indent);
+use Cactusinterfacing::Utils qw(_err _warn util_indent);
 
 # exports
-our @EXPORT_OK = qw(generateSoAMacro getCoord getGFIndex getCoordZero
+our @EXPORT_OK = qw(generateSoAMacro getSoAMembers getCoord getGFIndex getCoordZero
 					getFixedCoordZero getGFIndexLast getGFIndexFirst
-					buildCctkSteerer getBOVWriter getVisItWriter getLoopPeeler);
+					buildCctkSteerer getBOVWriter getVisItWriter getReducer
+					getLoopPeeler getStorageType getEnsembleNames
+					getEnsemblePointer getPerfCalls useLanes);
 
 # tab
 my $tab = $cinf_config{"tab"};
@@ -42,7 +44,31 @@ sub generateSoAMacro
 	$vars   = "";
 
 	# get vars and type
-	foreach my $group (keys %{$inf_ref}) {
+	$vars .= "(($_->[0])($_->[1]))" for (getSoAMembers($inf_ref));
+
+	$macro .= $vars;
+	$macro .= ")";
+
+	# if there are no vars, just return ""
+	return $vars ne "" ? $macro : "";
+}
+
+#
+# Gets the members of the cell in SoA order, i.e. every stored timelevel
+# of every grid function and ensemble member.
+#
+# param:
+#  - inf_ref: ref to interface data hash
+#
+# return:
+#  - list of array refs [ type, name ], e.g. [ "CCTK_REAL", "var_phi" ]
+#
+sub getSoAMembers
+{
+	my ($inf_ref) = @_;
+	my (@members);
+
+	foreach my $group (sort keys %{$inf_ref}) {
 		my ($gtype, $vtype, $timelevels, $i);
 
 		# init
@@ -56,16 +82,141 @@ sub generateSoAMacro
 
 		foreach my $name (@{$inf_ref->{$group}{"names"}}) {
 			for ($i = 0; $i < ($timelevels - 1); ++$i) {
-				$vars .= "(($vtype)(var_$name" . (("_p") x $i) . "))";
+				my $type = getStorageType($vtype, $name, $i);
+				# ensemble members have to be consecutive rows
+				push(@members, [ $type, $_ ]) for (getEnsembleNames("var_$name" . ("_p" x $i)));
 			}
 		}
 	}
 
-	$macro .= $vars;
-	$macro .= ")";
+	return @members;
+}
 
-	# if there are no vars, just return ""
-	return $vars ne "" ? $macro : "";
+#
+# Gets the type used for storing a timelevel of a grid function inside
+# the cell. This is the variable type of the group unless the timelevel
+# is configured to be stored in single precision (see float_timelevels).
+#
+# param:
+#  - vtype: variable type of grid function e.g. CCTK_REAL
+#  - name : name of grid function
+#  - level: index of cell member, 0 is var_name, 1 is var_name_p, ...
+#
+# return:
+#  - storage type of cell member
+#
+sub getStorageType
+{
+	my ($vtype, $name, $level) = @_;
+	my ($past_name);
+
+	# cell member var_name_p^level holds cactus timelevel name_p^(level+1)
+	$past_name = $name . ("_p" x ($level + 1));
+
+	return $vtype if ($level < 1);
+	return $vtype if ($vtype !~ /^CCTK_REAL8?$/);
+	# CCTK_REAL already is single precision
+	return $vtype if ($vtype eq "CCTK_REAL" && $cinf_config{"real_precision"} eq "single");
+	return $vtype unless (grep { $_ eq $past_name } split(' ', $cinf_config{"float_timelevels"}));
+
+	return "CCTK_REAL4";
+}
+
+#
+# Gets the names of one variable for all ensemble members (see
+# ensemble_size). Member 0 keeps the name, the others get _e<member>
+# appended, e.g. "var_phi", "var_phi_e1", "var_phi_e2".
+#
+# param:
+#  - name: name of variable or cell member
+#
+# return:
+#  - array of names, just name without ensemble
+#
+sub getEnsembleNames
+{
+	my ($name) = @_;
+
+	return ($name, map { $name . "_e$_" } (1 .. ($cinf_config{"ensemble_size"} - 1)));
+}
+
+#
+# Checks whether the ensemble members share the SIMD lanes, i.e. whether
+# the vectorized kernels compute one grid point of all members at once
+# (lane k holds member k) instead of running once per member.
+#
+# param:
+#  - none
+#
+# return:
+#  - true if ensemble_size > 1 and use_vectorization is set, else false
+#
+sub useLanes
+{
+	return $cinf_config{"ensemble_size"} > 1 && $cinf_config{"use_vectorization"};
+}
+
+#
+# Moves a pointer to a cell member inside updateLineX to the current
+# ensemble member. The member is selected by its accessor, so nothing
+# is assumed about where LibFlatArray places the rows of the members.
+# The selection is done once per line, outside of the x loop.
+#
+# param:
+#  - ptr: pointer expression, e.g. "&hoodNew.var_phi()"
+#
+# return:
+#  - pointer expression to the current ensemble member
+#
+sub getEnsemblePointer
+{
+	my ($ptr) = @_;
+	my ($base, $ret);
+
+	return $ptr if ($cinf_config{"ensemble_size"} == 1);
+
+	($base) = $ptr =~ /^(.*)\(\)$/;
+	_err("Cannot select ensemble member of $ptr.") unless (defined $base);
+
+	# ensembleMember == 1 ? &hood.var_phi_e1() : ... : &hood.var_phi()
+	$ret = $ptr;
+	for (my $i = $cinf_config{"ensemble_size"} - 1; $i > 0; --$i) {
+		$ret = "ensembleMember == $i ? $base" . "_e$i() : $ret";
+	}
+
+	return "($ret)";
+}
+
+#
+# Gets the calls of one evol function inside updateLineX. With
+# perf_counters = 2 they are wrapped into a PerfScope, which adds
+# the hardware counters of the calls to the function's totals
+# (see src/steerer/perfcounters.h).
+#
+# param:
+#  - index    : index of function, unique within updateLineX
+#  - name     : name of function
+#  - calls_ref: ref to array of call statements, without newlines
+#  - out_ref  : ref to array where to store the statements
+#
+# return:
+#  - none, statements without newlines will be stored in out_ref
+#
+sub getPerfCalls
+{
+	my ($index, $name, $calls_ref, $out_ref) = @_;
+
+	if ($cinf_config{"perf_counters"} < 2) {
+		push(@$out_ref, @$calls_ref);
+		return;
+	}
+
+	push(@$out_ref, "{");
+	push(@$out_ref, "PerfScope perfScope($index, \"$name\");");
+	push(@$out_ref, @$calls_ref);
+	push(@$out_ref, "}");
+
+	return;
 }
 
 #
@@ -249,11 +400,14 @@ sub getGFIndex
 
 #
 # Builds the cctk steerer. It increments the iteration and the time
-# every step.
+# every step. If adaptive is set, the steerer takes an optional
+# AdaptiveTimeStep (see src/steerer/cctkreducer.h), which updates
+# the time step afterwards.
 #
 # param:
 #  - cell_class  : name of cell class
 #  - static_class: name of static data class for the cell
+#  - adaptive    : support adaptive time step
 #  - out_ref     : ref to array where to store steerer header file containing
 #                  the class called "CctkSteerer"
 #
@@ -262,20 +416,33 @@ sub getGFIndex
 #
 sub buildCctkSteerer
 {
-	my ($cell_class, $static_class, $out_ref) = @_;
+	my ($cell_class, $static_class, $adaptive, $out_ref) = @_;
 
 	push(@$out_ref, "#include <libgeodecomp.h>\n");
 	push(@$out_ref, "#include <libgeodecomp/io/steerer.h>\n");
 	push(@$out_ref, "#include \"cell.h\"\n");
 	push(@$out_ref, "#include \"staticdata.h\"\n");
+	push(@$out_ref, "#include \"cctkreducer.h\"\n") if ($adaptive);
 	push(@$out_ref, "\n");
 	push(@$out_ref, "class CctkSteerer : public Steerer<$cell_class>\n");
 	push(@$out_ref, "{\n");
 	push(@$out_ref, "public:\n");
-	push(@$out_ref, $tab."CctkSteerer($static_class *staticData) :\n");
-	push(@$out_ref, $tab.$tab."Steerer<$cell_class>(1),\n");
-	push(@$out_ref, $tab.$tab."data(staticData)\n");
-	push(@$out_ref, $tab."{}\n");
+	if ($adaptive) {
+		push(@$out_ref, $tab."CctkSteerer($static_class *staticData, AdaptiveTimeStep<$cell_class> *adaptiveTimeStep = 0) :\n");
+		push(@$out_ref, $tab.$tab."Steerer<$cell_class>(1),\n");
+		push(@$out_ref, $tab.$tab."data(staticData),\n");
+		push(@$out_ref, $tab.$tab."adaptive(adaptiveTimeStep)\n");
+		push(@$out_ref, $tab."{}\n");
+		push(@$out_ref, $tab."virtual ~CctkSteerer()\n");
+		push(@$out_ref, $tab."{\n");
+		push(@$out_ref, $tab.$tab."delete adaptive;\n");
+		push(@$out_ref, $tab."}\n");
+	} else {
+		push(@$out_ref, $tab."CctkSteerer($static_class *staticData) :\n");
+		push(@$out_ref, $tab.$tab."Steerer<$cell_class>(1),\n");
+		push(@$out_ref, $tab.$tab."data(staticData)\n");
+		push(@$out_ref, $tab."{}\n");
+	}
 	push(@$out_ref, $tab."virtual void nextStep(\n");
 	push(@$out_ref, $tab.$tab."GridType *grid,\n");
 	push(@$out_ref, $tab.$tab."const Region<Topology::DIM>& validRegion,\n");
@@ -290,10 +457,16 @@ sub buildCctkSteerer
 	push(@$out_ref, $tab.$tab.$tab."// increment current iteration and timestep\n");
 	push(@$out_ref, $tab.$tab.$tab."data->cctkGH->incrCctkIteration();\n");
 	push(@$out_ref, $tab.$tab.$tab."data->cctkGH->incrCctkTime();\n");
+	if ($adaptive) {
+		push(@$out_ref, $tab.$tab.$tab."// adapt time step to the characteristic speed\n");
+		push(@$out_ref, $tab.$tab.$tab."if (adaptive)\n");
+		push(@$out_ref, $tab.$tab.$tab.$tab."adaptive->update(*grid, validRegion, step, rank, lastCall);\n");
+	}
 	push(@$out_ref, $tab.$tab."}\n");
 	push(@$out_ref, $tab."}\n");
 	push(@$out_ref, "private:\n");
 	push(@$out_ref, $tab."$static_class *data;\n");
+	push(@$out_ref, $tab."AdaptiveTimeStep<$cell_class> *adaptive;\n") if ($adaptive);
 	push(@$out_ref, "};\n");
 
 	return;
@@ -320,7 +493,7 @@ sub getBOVWriter
 	$freq = $freq ? $freq : "outputFrequency";
 	$type = "serial" unless ($type =~ /^serial$/i || $type =~ /^normal$/i);
 
-	foreach my $group (keys %{$inf_ref}) {
+	foreach my $group (sort keys %{$inf_ref}) {
 		my ($gtype);
 
 		$gtype = $inf_ref->{$group}{"gtype"};
@@ -328,7 +501,8 @@ sub getBOVWriter
 		next if ($gtype =~ /^SCALAR$/i);
 		next if ($gtype =~ /^ARRAY$/i);
 
-		foreach my $name (@{$inf_ref->{$group}{"names"}}) {
+		# one writer per ensemble member
+		foreach my $name (map { getEnsembleNames($_) } @{$inf_ref->{$group}{"names"}}) {
 			my ($selector, $var, $writer);
 
 			$var      = "&" . $class . "::" . "var_" . $name;
@@ -370,7 +544,7 @@ sub getVisItWriter
 	push(@$out_ref, "visItWriter = new VisItWriter<$class>(\"visit\", $freq);\n");
 
 	# add variables
-	foreach my $group (keys %{$inf_ref}) {
+	foreach my $group (sort keys %{$inf_ref}) {
 		my ($gtype);
 
 		$gtype = $inf_ref->{$group}{"gtype"};
@@ -378,7 +552,7 @@ sub getVisItWriter
 		next if ($gtype =~ /^SCALAR$/i);
 		next if ($gtype =~ /^ARRAY$/i);
 
-		foreach my $name (@{$inf_ref->{$group}{"names"}}) {
+		foreach my $name (map { getEnsembleNames($_) } @{$inf_ref->{$group}{"names"}}) {
 			my ($var, $add);
 
 			$var = "&" . $class . "::" . "var_" . $name;
@@ -393,27 +567,113 @@ sub getVisItWriter
 	return;
 }
 
+#
+# Generates the strings which register grid functions and grid scalars
+# at the reducer (see src/steerer/cctkreducer.h). Example:
+# "reducer->addVariable("phi", &Cell::var_phi);
+#  reducer->addTarget("phi_norm", &Cell::staticData.phi_norm);"
+# Only CCTK_REAL variables can be reduced.
+#
+# param:
+#  - inf_ref: ref to interface data hash
+#  - class  : name of cell class
+#  - object : name of reducer object, e.g. "reducer"
+#  - targets: add grid scalars as targets
+#  - out_ref: ref to array where to store reducer strings
+#
+# return:
+#  - none, resulting reducer strings will be stored in out_ref,
+#    it stays empty if there is no grid function to reduce
+#
+sub getReducer
+{
+	my ($inf_ref, $class, $object, $targets, $out_ref) = @_;
+	my ($pushed);
+
+	$pushed = 0;
+
+	foreach my $group (sort keys %{$inf_ref}) {
+		my ($gtype, $vtype);
+
+		$gtype = $inf_ref->{$group}{"gtype"};
+		$vtype = $inf_ref->{$group}{"vtype"};
+
+		next if ($gtype =~ /^ARRAY$/i);
+		next if ($vtype !~ /^CCTK_REAL$/i);
+
+		foreach my $name (@{$inf_ref->{$group}{"names"}}) {
+			if ($gtype =~ /^SCALAR$/i) {
+				push(@$out_ref, "$object->addTarget(\"$name\", &$class"."::staticData.$name);\n")
+					if ($targets);
+			} else {
+				push(@$out_ref, "$object->addVariable(\"$_\", &$class"."::var_$_);\n")
+					for (getEnsembleNames($name));
+				$pushed = 1;
+			}
+		}
+	}
+
+	@$out_ref = () unless ($pushed);
+
+	return;
+}
+
 #
 # This functions creates the code for loop peeling if vectorization is used.
+# The line is split into an unaligned head, an aligned body and a tail.
+# Depending on loop_peeling head and tail are computed with scalar code or
+# as one full vector each, which overlaps the body. Functions reading a
+# variable they write would read their own results in the overlap, so
+# these are always peeled with scalar code. Lines shorter than a vector
+# are computed with scalar code. If the ensemble members share the lanes
+# (see useLanes()) the line is computed point by point with one lane per
+# member, so there is nothing to peel.
 #
 # param:
-#  - cargo   : cargo type (like double)
-#  - func_ref: ref to function which should be called, may be array or scalar
-#  - out_ref : ref to array where to store code for loop peeling
+#  - cargo     : cargo type (like double)
+#  - func_ref  : ref to function which should be called, may be array or scalar
+#  - out_ref   : ref to array where to store code for loop peeling
+#  - scalar_ref: ref to hash of functions which need scalar peeling, optional
 #
 # return:
 #  - none, code will be stored in out_ref
 #
 sub getLoopPeeler
 {
-	my ($cargo, $func_ref, $out_ref) = @_;
-	my ($call0, $call1, $call2, $vec_width);
+	my ($cargo, $func_ref, $out_ref, $scalar_ref) = @_;
+	my (@funcs, $vec_width, $overlap, $args, $ensemble);
 
 	# init
-	$call0	   = "<ScalarType>(0, nextStop, hoodOld, hoodNew);";
-	$call1	   = "<ShortVecType>(nextStop, indexEnd, hoodOld, hoodNew);";
-	$call2	   = "<ScalarType>(last, indexEnd, hoodOld, hoodNew);";
 	$vec_width = $cinf_config{"vector_width"};
+	# vector_width is given for double, a register holds twice as many floats
+	$vec_width *= 2 if ($cinf_config{"real_precision"} eq "single");
+	$overlap   = $cinf_config{"loop_peeling"} eq "overlap";
+	$ensemble  = $cinf_config{"ensemble_size"} > 1 && !useLanes();
+	$args      = $ensemble ? "hoodOld, hoodNew, ensembleMember" : "hoodOld, hoodNew";
+
+	# get functions to call
+	if (ref $func_ref eq 'SCALAR') {
+		@funcs = ($$func_ref);
+	} elsif (!(ref $func_ref)) {
+		@funcs = ($func_ref);
+	} elsif (ref $func_ref eq 'ARRAY') {
+		@funcs = @$func_ref;
+	} else {
+		_err("Wrong reference type for func_ref provided.");
+	}
+
+	# one lane per ensemble member
+	if (useLanes()) {
+		push(@$out_ref, "typedef LibFlatArray::short_vec<$cargo, ENSEMBLESIZE> LaneType;");
+		push(@$out_ref, "indexEnd -= hoodOld.index();");
+		push(@$out_ref, "PerfCounters::thread();") if ($cinf_config{"perf_counters"});
+		push(@$out_ref, "advanceWindow(hoodOld, hoodNew);") if ($cinf_config{"out_of_core_dir"} ne "");
+		for my $i (0 .. $#funcs) {
+			getPerfCalls($i, $funcs[$i], [ "$funcs[$i]<LaneType>(0, indexEnd, $args);" ], $out_ref);
+		}
+		util_indent($out_ref, 2);
+		return;
+	}
 
 	# prepare
 	push(@$out_ref, "typedef LibFlatArray::short_vec<$cargo, $vec_width> ShortVecType;");
@@ -429,24 +689,46 @@ sub getLoopPeeler
 	# calculate last start index
 	push(@$out_ref, "long last = (((indexEnd - nextStop) / ShortVecType::ARITY) * ShortVecType::ARITY) + nextStop;");
 
-	# call it/them
-	if (ref $func_ref eq 'SCALAR') {
-		push(@$out_ref, $$func_ref . $call0);
-		push(@$out_ref, $$func_ref . $call1);
-		push(@$out_ref, $$func_ref . $call2);
-	} elsif (!(ref $func_ref)) {
-		push(@$out_ref, $func_ref . $call0);
-		push(@$out_ref, $func_ref . $call1);
-		push(@$out_ref, $func_ref . $call2);
-	} elsif (ref $func_ref eq 'ARRAY') {
-		foreach my $func (@$func_ref) {
-			push(@$out_ref, $func . $call0);
-			push(@$out_ref, $func . $call1);
-			push(@$out_ref, $func . $call2);
+	# registers the counters of this thread
+	push(@$out_ref, "PerfCounters::thread();") if ($cinf_config{"perf_counters"});
+
+	# out-of-core grids are streamed through a window, see memorypolicy.h
+	push(@$out_ref, "advanceWindow(hoodOld, hoodNew);") if ($cinf_config{"out_of_core_dir"} ne "");
+
+	# all ensemble members are advanced line by line
+	push(@$out_ref, "for (int ensembleMember = 0; ensembleMember < ENSEMBLESIZE; ++ensembleMember) {")
+		if ($ensemble);
+
+	# call it/them, every function completes the line before the next one
+	push(@$out_ref, "if (indexEnd < ShortVecType::ARITY) {");
+	for my $i (0 .. $#funcs) {
+		getPerfCalls($i, $funcs[$i], [ "$funcs[$i]<ScalarType>(0, indexEnd, $args);" ], $out_ref);
+	}
+	push(@$out_ref, "}");
+	push(@$out_ref, "else {");
+	for my $i (0 .. $#funcs) {
+		my ($func, @calls);
+
+		$func = $funcs[$i];
+		if ($overlap && !($scalar_ref && $scalar_ref->{$func})) {
+			# head and tail are computed as unaligned vectors, points in the
+			# overlap with the body are computed twice with the same result
+			push(@calls, "if (nextStop > 0) {");
+			push(@calls, "$func<ShortVecType>(0, ShortVecType::ARITY, $args);");
+			push(@calls, "}");
+			push(@calls, "$func<ShortVecType>(nextStop, indexEnd, $args);");
+			push(@calls, "if (last < indexEnd) {");
+			push(@calls, "$func<ShortVecType>(indexEnd - ShortVecType::ARITY, indexEnd, $args);");
+			push(@calls, "}");
+		} else {
+			push(@calls, "$func<ScalarType>(0, nextStop, $args);");
+			push(@calls, "$func<ShortVecType>(nextStop, indexEnd, $args);");
+			push(@calls, "$func<ScalarType>(last, indexEnd, $args);");
 		}
-	} else {
-		_err("Wrong reference type for func_ref provided.");
+		getPerfCalls($i, $func, \@calls, $out_ref);
 	}
+	push(@$out_ref, "}");
+	push(@$out_ref, "}") if ($ensemble);
 
 	# indent
 	util_indent($out_ref, 2);
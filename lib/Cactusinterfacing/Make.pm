@@ -14,7 +14,7 @@ use Cactusinterfacing::Config qw(%cinf_config);
 use Cactusinterfacing::Utils qw(util_readFile _warn);
 
 # exports
-our @EXPORT_OK = qw(createLibgeodecompMakefile getSources);
+our @EXPORT_OK = qw(createLibgeodecompMakefile createPrecompiledHeader getSources);
 
 #
 # This subroutine gatheres all source files
@@ -78,6 +78,13 @@ sub getSources
 # This uses `pkg-config' to determine compiler flags and libs. Make sure the
 # LibGeoDecomp is installed on your system. This can be installed by
 # `sudo make install`. Additionally -O3 is used for optimizations.
+# If precompiled_header is set, LibGeoDecomp and the cctk includes are
+# parsed once into pch.h.gch and included into every object. The target
+# `unity' builds the application out of a single translation unit.
+# The target `lto' builds $name-lto with link time optimization, the target
+# `pgo' builds $name-pgo with profile guided optimization. The profile is
+# taken from a run on TRAINPAR (make pgo TRAINPAR=...) with cctk_itlast
+# reduced to TRAINSTEPS. Each variant uses its own object directory.
 #
 # param:
 #  - config_ref: ref to config hash
@@ -90,11 +97,12 @@ sub getSources
 sub createLibgeodecompMakefile
 {
 	my ($config_ref, $opt_ref, $out_ref) = @_;
-	my ($cxx, $cxxflags, $ldflags, $name);
+	my ($cxx, $cxxflags, $ldflags, $name, $pch);
 
 	# init name and compiler, use mpicxx if mpi is used, g++ is default
 	$name = "cactus_".$config_ref->{"config"};
 	$cxx  = $opt_ref->{"mpi"} ? "mpicxx" : "g++";
+	$pch  = $cinf_config{"precompiled_header"};
 	# ignore some unused variables/parameters warnings,
 	# they're caused by some adjustments to the code
 	$cxxflags  = "-pedantic -Wall -Wextra -Wno-unused-parameter ";
@@ -104,20 +112,41 @@ sub createLibgeodecompMakefile
 	$cxxflags .= " `pkg-config --cflags libgeodecomp`";
 	# build with debug code?
 	$cxxflags .= " -DDEBUG" if ($cinf_config{"debug"});
+	# CCTK_REAL in single precision? see cctk_Types.h
+	$cxxflags .= " -DCCTK_REAL_PRECISION_4" if ($cinf_config{"real_precision"} eq "single");
+	# tune for a specific cpu?
+	$cxxflags .= " -march=$cinf_config{\"march\"}" if ($cinf_config{"march"});
 	# additionally we need to link against boost_regex
 	# the rest will be determined by pkg-config, make sure PKG_CONFIG_PATH is set
 	$ldflags = "`pkg-config --libs libgeodecomp` -lboost_regex";
+	# parallel initialization uses OpenMP
+	if ($cinf_config{"parallel_init"}) {
+		$cxxflags .= " -fopenmp";
+		$ldflags  .= " -fopenmp";
+	}
+	# flags of lto/pgo builds, set by recursive make
+	$cxxflags .= " \$(EXTRAFLAGS)";
+	$ldflags  .= " \$(EXTRAFLAGS)";
 
 	push(@$out_ref, "RM       := rm\n");
 	push(@$out_ref, "CXX      := $cxx\n");
 	push(@$out_ref, "LD       := $cxx\n");
 	push(@$out_ref, "CXXFLAGS := $cxxflags\n");
 	push(@$out_ref, "LDFLAGS  := $ldflags\n");
-	push(@$out_ref, "OBJDIR   := build\n");
-	push(@$out_ref, "SOURCES  := \$(shell find * -name \"*.cpp\" -type f -print)\n");
+	push(@$out_ref, "BUILDDIR := build\n");
+	push(@$out_ref, "OBJDIR   := \$(BUILDDIR)\n");
+	push(@$out_ref, "SOURCES  := \$(shell find * -path \$(BUILDDIR) -prune -o -name \"*.cpp\" -type f -print)\n");
 	push(@$out_ref, "OBJECTS  := \$(SOURCES:%.cpp=\$(OBJDIR)/%.o)\n");
 	push(@$out_ref, "DEPS     := \$(OBJECTS:\$(OBJDIR)/%.o=\$(OBJDIR)/%.d)\n");
 	push(@$out_ref, "PROG     := $name\n");
+	# init.cpp defines the cctk macros of the initializer, so it has to be last
+	push(@$out_ref, "UNITY    := \$(filter-out init.cpp,\$(SOURCES)) init.cpp\n");
+	if ($pch) {
+		push(@$out_ref, "PCH      := \$(OBJDIR)/pch.h.gch\n");
+		push(@$out_ref, "PCHFLAGS := -include \$(OBJDIR)/pch.h -Winvalid-pch\n");
+	}
+	push(@$out_ref, "TRAINPAR   ?= train.par\n");
+	push(@$out_ref, "TRAINSTEPS ?= 20\n");
 	push(@$out_ref, "\n");
 	push(@$out_ref, "\n");
 	push(@$out_ref, "all: \$(PROG)\n");
@@ -126,26 +155,89 @@ sub createLibgeodecompMakefile
 	push(@$out_ref, "\t\@echo \"LD\t\t\$@\"\n");
 	push(@$out_ref, "\t\@\$(LD) -o \$@ \$^ \$(LDFLAGS)\n");
 	push(@$out_ref, "\n");
-	push(@$out_ref, "\$(OBJDIR)/%.o: %.cpp\n");
+	if ($pch) {
+		push(@$out_ref, "\$(PCH): pch.h cactusgrid.h \$(wildcard include/cctk*.h)\n");
+		push(@$out_ref, "\t\@if ! [ -d \$(OBJDIR) ] ; then mkdir -p \$(OBJDIR) ; fi\n");
+		push(@$out_ref, "\t\@echo \"PCH\t\t\$@\"\n");
+		push(@$out_ref, "\t\@cp pch.h \$(OBJDIR)/pch.h\n");
+		push(@$out_ref, "\t\@\$(CXX) \$(CXXFLAGS) -x c++-header -o \$@ \$<\n");
+		push(@$out_ref, "\n");
+	}
+	push(@$out_ref, "\$(OBJDIR)/%.o: %.cpp \$(PCH)\n");
 	push(@$out_ref, "\t\@if ! [ -d \$(OBJDIR) ] ; then mkdir -p \$(OBJDIR) ; fi\n");
 	push(@$out_ref, "\t\@echo \"CXX\t\t\$@\"\n");
-	push(@$out_ref, "\t\@\$(CXX) \$(CXXFLAGS) -c -o \$@ \$<\n");
+	push(@$out_ref, "\t\@\$(CXX) \$(CXXFLAGS) \$(PCHFLAGS) -c -o \$@ \$<\n");
 	push(@$out_ref, "\n");
 	push(@$out_ref, "\$(OBJDIR)/%.d: %.cpp\n");
 	push(@$out_ref, "\t\@if ! [ -d \$(OBJDIR) ] ; then mkdir -p \$(OBJDIR) ; fi\n");
 	push(@$out_ref, "\t\@echo \"DEP\t\t\$@\"\n");
 	push(@$out_ref, "\t\@\$(CXX) \$(CXXFLAGS) -MM -MF \$@ -MT \$(OBJDIR)/\$*.o \$<\n");
 	push(@$out_ref, "\n");
+	push(@$out_ref, "unity: \$(OBJDIR)/unity.cpp\n");
+	push(@$out_ref, "\t\@echo \"CXX LD\t\t\$(PROG)\"\n");
+	push(@$out_ref, "\t\@\$(CXX) \$(CXXFLAGS) -o \$(PROG) \$< \$(LDFLAGS)\n");
+	push(@$out_ref, "\n");
+	push(@$out_ref, "\$(OBJDIR)/unity.cpp: \$(SOURCES)\n");
+	push(@$out_ref, "\t\@if ! [ -d \$(OBJDIR) ] ; then mkdir -p \$(OBJDIR) ; fi\n");
+	push(@$out_ref, "\t\@echo \"GEN\t\t\$@\"\n");
+	push(@$out_ref, "\t\@for f in \$(UNITY) ; do echo \"#include \\\"../\$\$f\\\"\" ; done > \$@\n");
+	push(@$out_ref, "\n");
+	push(@$out_ref, "lto:\n");
+	push(@$out_ref, "\t\@\$(MAKE) --no-print-directory OBJDIR=\$(BUILDDIR)/lto PROG=\$(PROG)-lto EXTRAFLAGS=-flto\n");
+	push(@$out_ref, "\n");
+	push(@$out_ref, "pgo:\n");
+	push(@$out_ref, "\t\@if ! [ -r \$(TRAINPAR) ] ; then echo \"Training parameter file \$(TRAINPAR) not found, use make pgo TRAINPAR=...\" ; exit 1 ; fi\n");
+	push(@$out_ref, "\t\@\$(MAKE) --no-print-directory OBJDIR=\$(BUILDDIR)/pgo PROG=\$(PROG)-pgo EXTRAFLAGS=-fprofile-generate\n");
+	push(@$out_ref, "\t\@echo \"TRAIN\t\t\$(TRAINPAR)\"\n");
+	push(@$out_ref, "\t\@grep -iv \"^ *cactus::cctk_itlast\" \$(TRAINPAR) > \$(BUILDDIR)/pgo/train.par\n");
+	push(@$out_ref, "\t\@echo \"cactus::cctk_itlast = \$(TRAINSTEPS)\" >> \$(BUILDDIR)/pgo/train.par\n");
+	push(@$out_ref, "\t\@./\$(PROG)-pgo \$(BUILDDIR)/pgo/train.par > /dev/null\n");
+	push(@$out_ref, "\t\@\$(MAKE) --no-print-directory -B OBJDIR=\$(BUILDDIR)/pgo PROG=\$(PROG)-pgo EXTRAFLAGS=\"-fprofile-use -fprofile-correction\"\n");
+	push(@$out_ref, "\n");
 	push(@$out_ref, "clean:\n");
 	push(@$out_ref, "\t\@echo \"CLEAN\"\n");
-	push(@$out_ref, "\t\@\$(RM) -rf build \$(PROG)\n");
+	push(@$out_ref, "\t\@\$(RM) -rf \$(BUILDDIR) \$(PROG) \$(PROG)-lto \$(PROG)-pgo\n");
 	push(@$out_ref, "\n");
-	push(@$out_ref, "ifneq (\$(MAKECMDGOALS),clean)\n");
+	push(@$out_ref, "ifeq (\$(filter clean lto pgo,\$(MAKECMDGOALS)),)\n");
 	push(@$out_ref, "-include \$(DEPS)\n");
 	push(@$out_ref, "endif\n");
 	push(@$out_ref, "\n");
-	push(@$out_ref, ".PHONY: all clean\n");
+	push(@$out_ref, ".PHONY: all clean unity lto pgo\n");
+	push(@$out_ref, "\n");
+
+	return;
+}
+
+#
+# Creates the header which is precompiled by the Makefile. It contains
+# LibGeoDecomp and the cctk include set, which are needed by every
+# source file of the application.
+#
+# param:
+#  - opt_ref: ref to options hash
+#  - out_ref: ref to array where to store header lines
+#
+# return:
+#  - none, header will be stored in out_ref
+#
+sub createPrecompiledHeader
+{
+	my ($opt_ref, $out_ref) = @_;
+
+	push(@$out_ref, "#ifndef _PCH_H_\n");
+	push(@$out_ref, "#define _PCH_H_\n");
+	push(@$out_ref, "\n");
+	push(@$out_ref, "/* This file is completely autogenerated, do not modify! */\n");
+	push(@$out_ref, "\n");
+	push(@$out_ref, "#include <cmath>\n");
+	push(@$out_ref, "#include <iostream>\n");
+	push(@$out_ref, "#include <libgeodecomp.h>\n");
+	push(@$out_ref, "#include <libgeodecomp/io/bovwriter.h>\n") if ($opt_ref->{"mpi"});
+	push(@$out_ref, "#include <libgeodecomp/io/serialbovwriter.h>\n") if (!$opt_ref->{"mpi"});
+	push(@$out_ref, "#include <libgeodecomp/io/visitwriter.h>\n");
+	push(@$out_ref, "#include \"cctk.h\"\n");
 	push(@$out_ref, "\n");
+	push(@$out_ref, "#endif /* _PCH_H_ */\n");
 
 	return;
 }
@@ -118,7 +118,9 @@ sub prepareValues
 # This functions builds parameter strings. This includes definition and
 # initialization with default values. It can build these strings either for
 # static members and normal members. To specify which version to build
-# set the parameter static to one or zero.
+# set the parameter static to one or zero. In ensemble mode (see
+# ensemble_size) every parameter becomes an array with one value per
+# ensemble member.
 #
 # param:
 #  - par_ref: ref to parameter data
@@ -133,9 +135,12 @@ sub prepareValues
 sub buildParameterStrings
 {
 	my ($par_ref, $class, $static, $val_ref) = @_;
-	my (@def, @init);
+	my (@def, @init, $size);
 
-	foreach my $name (keys %{$par_ref}) {
+	# init
+	$size = $cinf_config{"ensemble_size"};
+
+	foreach my $name (sort keys %{$par_ref}) {
 		my ($type, $default, $desc);
 
 		# init
@@ -146,7 +151,20 @@ sub buildParameterStrings
 		# add description first
 		push(@def, "// $desc");
 
-		if ($static) {
+		if ($size > 1 && $static) {
+			# def : 'static type name[ENSEMBLESIZE];'
+			# init: 'type classname::name[ENSEMBLESIZE] = { default, ... };'
+			push(@def,  "static $type $name"."[ENSEMBLESIZE];");
+			push(@init, "$type $class"."::"."$name"."[ENSEMBLESIZE] = { " .
+				 join(", ", ($default) x $size) . " };");
+		} elsif ($size > 1) {
+			# def:  'type name[ENSEMBLESIZE];'
+			# init: loop over all members
+			push(@def,  "$type $name"."[ENSEMBLESIZE];");
+			push(@init, "for (int i = 0; i < ENSEMBLESIZE; ++i) {");
+			push(@init, "$name"."[i] = $default;");
+			push(@init, "}");
+		} elsif ($static) {
 			# def : 'static type name;'
 			# init: 'type classname::name = default;'
 			push(@def,  "static $type $name;");
@@ -175,40 +193,46 @@ sub buildParameterStrings
 }
 
 #
-# Generates macro for parameter parser.
+# Generates macro for parameter parser. In ensemble mode the values of
+# all ensemble members are set by GETENSEMBLE (see parparser.cpp). If
+# the members share the lanes of the kernels, only real parameters may
+# differ, the others are set by GETSHARED, which checks that.
 #
 # param:
 #  - par_ref: ref to parameter data hash
 #  - class  : name of class
 #  - prefix : additional prefix for variable, may be ""
 #  - out_ref: ref to hash where to store macros
+#  - lanes  : members share the lanes [optional]
 #
 # return:
 #  - none, macros will be stored in out_ref
 #
 sub generateParameterMacro
 {
-	my ($par_ref, $class, $prefix, $out_ref) = @_;
-	my ($macro_name);
+	my ($par_ref, $class, $prefix, $out_ref, $lanes) = @_;
+	my ($macro_name, $get);
 
 	# build name of macro
 	$macro_name = $class;
 	$macro_name =~ s/_//g;
 	$macro_name = "_SETUP_\U$macro_name\E_PARAMETERS";
+	$get        = $cinf_config{"ensemble_size"} > 1 ? "GETENSEMBLE" : "GET";
 
 	push(@$out_ref, "#define $macro_name \\\n");
 	push(@$out_ref, $tab."do { \\\n");
 
-	foreach my $name (keys %{$par_ref}) {
-		my ($implname, $vtype, $classname);
+	foreach my $name (sort keys %{$par_ref}) {
+		my ($implname, $vtype, $classname, $set);
 
 		# init
 		$implname  = $par_ref->{$name}{"impl"}."::".$par_ref->{$name}{"realname"};
 		$vtype     = $par_ref->{$name}{"type"};
 		$classname = $class."::".$prefix.$par_ref->{$name}{"realname"};
+		$set       = $lanes && $vtype ne "CCTK_REAL" ? "GETSHARED" : $get;
 
 		# GET(impl::name, vtype, class::name);
-		push(@$out_ref, $tab.$tab."GET($implname, $vtype, $classname); \\\n");
+		push(@$out_ref, $tab.$tab."$set($implname, $vtype, $classname); \\\n");
 	}
 
 	push(@$out_ref, $tab."} while (0)\n");
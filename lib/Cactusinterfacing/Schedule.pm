@@ -99,7 +99,7 @@ sub getEvolFunction
 
 	getFunctionsAt($sched_ref, "CCTK_EVOL", "single", \%funcs);
 
-	foreach my $key (keys %funcs) {
+	foreach my $key (sort keys %funcs) {
 		$out_ref->{$key} = $funcs{$key};
 		last;
 	}
@@ -145,7 +145,7 @@ sub getInitFunction
 
 	getFunctionsAt($sched_ref, "CCTK_INITIAL", "single", \%funcs);
 
-	foreach my $key (keys %funcs) {
+	foreach my $key (sort keys %funcs) {
 		$out_ref->{$key} = $funcs{$key};
 		last;
 	}
@@ -191,7 +191,7 @@ sub getInitFunctions
 sub getFunctionsAt
 {
 	my ($sched_ref, $timestep, $type, $out_ref) = @_;
-	my (@thorndirs, %nodes, @functions, @sources, $nfuncs);
+	my (@thorndirs, %nodes, %levels, @functions, @sources, $nfuncs);
 
 	# prepare arguments
 	tie %{$out_ref}, 'Tie::IxHash';
@@ -199,7 +199,7 @@ sub getFunctionsAt
 
 	# get an array of functions at the specific timestep in right order
 	prepareDAG(\%nodes, $sched_ref, $timestep);
-	sortDAG(\%nodes, \@functions);
+	sortDAG(\%nodes, \@functions, \%levels);
 
 	# get directories of all thorns
 	uniqThornDirs($sched_ref, \@thorndirs);
@@ -233,8 +233,9 @@ sub getFunctionsAt
 		$found = 0;
 		foreach my $source (@sources) {
 			if (util_getFunction($source, $func, \@code_func)) {
-				$out_ref->{$func}{"name"} = $func;
-				$out_ref->{$func}{"data"} = \@code_func;
+				$out_ref->{$func}{"name"}  = $func;
+				$out_ref->{$func}{"data"}  = \@code_func;
+				$out_ref->{$func}{"level"} = $levels{$func};
 				$found = 1;
 				last;
 			}
@@ -243,8 +244,9 @@ sub getFunctionsAt
 		if (!$found) {
 			# the scheduled function could not be found in any source file
 			_warn("The scheduled function could not be found. Check your make.code.defn.");
-			$out_ref->{$func}{"name"} = $func;
-			$out_ref->{$func}{"data"} = [ "/** No function found at \U$timestep\E timestep **/" ];
+			$out_ref->{$func}{"name"}  = $func;
+			$out_ref->{$func}{"data"}  = [ "/** No function found at \U$timestep\E timestep **/" ];
+			$out_ref->{$func}{"level"} = $levels{$func};
 		}
 	}
 
@@ -274,7 +276,7 @@ sub uniqThornDirs
 	my ($sched_ref, $out_ref) = @_;
 	my (%seen);
 
-	foreach my $func (keys %{$sched_ref}) {
+	foreach my $func (sort keys %{$sched_ref}) {
 		push(@$out_ref, $sched_ref->{$func}{"thorndir"});
 	}
 
@@ -336,7 +338,7 @@ sub alias2RealName
 	my ($real_name);
 
 	$real_name = "";
-	foreach my $function (keys %{$data_ref}) {
+	foreach my $function (sort keys %{$data_ref}) {
 		if ($data_ref->{$function}{"as"} eq $alias) {
 			_warn("Multiple functions found alias \"$alias\". Using the first one found.")
 				unless ($real_name eq "");
@@ -366,7 +368,7 @@ sub realName2Alias
 	my ($alias);
 
 	$alias = "";
-	foreach my $function (keys %{$data_ref}) {
+	foreach my $function (sort keys %{$data_ref}) {
 		if ($function eq $real_name) {
 			_err("Found two or more aliases for the same function \"$real_name\". ".
 				 "Something went wrong.") unless ($alias eq "");
@@ -394,7 +396,7 @@ sub isFunction
 {
 	my ($symbol, $data_ref) = @_;
 
-	foreach my $function (keys %{$data_ref}) {
+	foreach my $function (sort keys %{$data_ref}) {
 		return 1 if ($function eq $symbol);
 	}
 
@@ -415,7 +417,7 @@ sub isAlias
 {
 	my ($symbol, $data_ref) = @_;
 
-	foreach my $function (keys %{$data_ref}) {
+	foreach my $function (sort keys %{$data_ref}) {
 		return 1 if ($symbol eq $data_ref->{$function}{"as"});
 	}
 
@@ -443,7 +445,7 @@ sub prepareDAG
 	my ($nodes_ref, $data_ref, $timestep) = @_;
 
 	# first create nodes and set ref counter to zero
-	foreach my $function (keys %{$data_ref}) {
+	foreach my $function (sort keys %{$data_ref}) {
 		# right timestep?
 		next unless ($timestep eq $data_ref->{$function}{"timestep"});
 		$nodes_ref->{$function}{"ref_cnt"}   = 0;
@@ -453,7 +455,7 @@ sub prepareDAG
 	return unless (keys %{$nodes_ref});
 
 	# now create DAG by evaluating after and before
-	foreach my $function (keys %{$data_ref}) {
+	foreach my $function (sort keys %{$data_ref}) {
 		my ($after, $before);
 
 		# init
@@ -484,28 +486,34 @@ sub prepareDAG
 #
 # This functions sorts the DAG created by prepareDAG.
 # Note: nodes_ref will be empty afterwards (maybe change that later on).
+# The functions are removed from the graph level by level. All functions
+# of one level do not depend on each other, so the level is stored
+# in levels_ref, if given.
 #
 # param:
-#  - nodes_ref: ref to nodes hash, created by prepareDAG
-#  - out_ref  : ref to array where the sorted functions will be stored
+#  - nodes_ref : ref to nodes hash, created by prepareDAG
+#  - out_ref   : ref to array where the sorted functions will be stored
+#  - levels_ref: ref to hash where to store the level of each function [optional]
 #
 # return:
 #  - none, sorted functions will be stored in out_ref
 #
 sub sortDAG
 {
-	my ($nodes_ref, $out_ref) = @_;
-	my ($deleted, %nodes_cp);
+	my ($nodes_ref, $out_ref, $levels_ref) = @_;
+	my ($deleted, $level, %nodes_cp);
 
+	$level = 0;
 	while (scalar keys %{$nodes_ref} > 0) {
 		$deleted = 0;
 		# changes to the graph are made on a copy which is rotated after each step
 		%nodes_cp = %{ dclone $nodes_ref };
-		foreach my $function (keys %{$nodes_ref}) {
+		foreach my $function (sort keys %{$nodes_ref}) {
 			# get nodes with ref counter 0
 			if ($nodes_ref->{$function}{"ref_cnt"} == 0) {
 				# save
 				push(@$out_ref, $function);
+				$levels_ref->{$function} = $level if (defined $levels_ref);
 				# decr. ref counter of all outgoing nodes
 				foreach my $node (@{$nodes_ref->{$function}{"out_nodes"}}) {
 					$nodes_cp{$node}{"ref_cnt"} -= 1;
@@ -522,6 +530,7 @@ sub sortDAG
 
 		# rotate
 		$nodes_ref = \%nodes_cp;
+		$level++;
 	}
 
 	return;
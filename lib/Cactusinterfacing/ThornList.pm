@@ -93,7 +93,7 @@ sub getInherits
 
 	foreach my $val (@values) {
 		# get ar_thorn
-		foreach my $key (keys %{$info_ref}) {
+		foreach my $key (sort keys %{$info_ref}) {
 			if ($val =~ /^$info_ref->{$key}{"impl"}$/i) {
 				push(@$inherits_ref, $key);
 				getInherits($key, $info_ref, $inherits_ref);
@@ -133,7 +133,7 @@ sub getFriends
 
 	foreach my $val (@values) {
 		# get ar_thorn
-		foreach my $key (keys %{$info_ref}) {
+		foreach my $key (sort keys %{$info_ref}) {
 			if ($val =~ /^$info_ref->{$key}{"impl"}$/i) {
 				push(@$friends_ref, $key);
 				getInherits($key, $info_ref, $friends_ref);
@@ -32,7 +32,10 @@ use warnings;
 use Exporter 'import';
 use File::Copy;
 use File::Which;
+use File::Find;
+use File::Basename;
 use File::Path qw(mkpath remove_tree);
+use Digest::MD5;
 use Cactusinterfacing::Config qw(%cinf_config);
 
 # export
@@ -40,7 +43,8 @@ our @EXPORT_OK = qw(read_file RemoveComments CST_error SplitWithStrings _err
 					_warn dbg info vprint util_writeFile util_mkdir util_trim
 					util_cp util_arrayToHash util_readFile util_input
 					util_indent util_getFunction util_choose util_readDir
-					util_tidySrcDir util_rmdir util_chooseMulti util_buildFunction);
+					util_tidySrcDir util_rmdir util_chooseMulti util_buildFunction
+					util_syncDir);
 
 #
 # Extract a function body from a given source file.
@@ -214,6 +218,10 @@ sub util_tidySrcDir
 	return;
 }
 
+# answers given to util_choose(Multi), the same question is only asked once
+# per process, e.g. when generating several variants while auto-tuning
+my %answers;
+
 #
 # Choose between answers stored in arr_ref.
 # User has to choose a valid answer.
@@ -228,7 +236,10 @@ sub util_tidySrcDir
 sub util_choose
 {
 	my ($message, $arr_ref) = @_;
-	my ($i, $answer);
+	my ($i, $answer, $key);
+
+	$key = join("\n", $message, @$arr_ref);
+	return $answers{$key} if (exists $answers{$key});
 
 	print $message . ":\n";
 
@@ -245,6 +256,8 @@ sub util_choose
 	_err("\"$answer\" is not a valid choice!")
 		if ($answer !~ /^\d+$/ || $answer >= $i);
 
+	$answers{$key} = $arr_ref->[$answer];
+
 	return $arr_ref->[$answer];
 }
 
@@ -264,7 +277,10 @@ sub util_choose
 sub util_chooseMulti
 {
 	my ($message, $arr_ref) = @_;
-	my ($i, $answer, @token, @ret);
+	my ($i, $answer, $key, @token, @ret);
+
+	$key = join("\n", "multi", $message, @$arr_ref);
+	return @{$answers{$key}} if (exists $answers{$key});
 
 	print $message . ":\n";
 
@@ -288,6 +304,8 @@ sub util_chooseMulti
 		push(@ret, $arr_ref->[$choice]);
 	}
 
+	$answers{$key} = [ @ret ];
+
 	return @ret;
 }
 
@@ -354,6 +372,87 @@ sub util_rmdir
 	return;
 }
 
+#
+# Computes the MD5 sum of a file.
+#
+# param:
+#  - file: file to hash
+#
+# return:
+#  - hex digest of the file content
+#
+sub util_md5File
+{
+	my ($file) = @_;
+	my ($fh, $md5);
+
+	open($fh, "<:raw", $file) ||
+		_err("Cannot open file $file: $!");
+	$md5 = Digest::MD5->new->addfile($fh)->hexdigest;
+	close $fh;
+
+	return $md5;
+}
+
+#
+# Copies all files of src_dir into dest_dir, but only those whose content
+# differs from the existing file. Unchanged files are left untouched,
+# so their timestamps are kept. Files copied by a previous call, which
+# are not in src_dir anymore, are deleted. All other files in dest_dir
+# (objects, binaries, ...) are kept. The copied files are recorded in
+# dest_dir/.cinf_files.
+#
+# param:
+#  - src_dir : source directory
+#  - dest_dir: destination directory
+#
+# return:
+#  - number of updated files
+#
+sub util_syncDir
+{
+	my ($src_dir, $dest_dir) = @_;
+	my (@files, @old, %new, $manifest, $updated);
+
+	# get all files relative to src_dir
+	find({ wanted => sub { push(@files, $File::Find::name) if (-f $_) },
+		   no_chdir => 1 }, $src_dir);
+	@files = sort map { substr($_, length($src_dir) + 1) } @files;
+
+	util_mkdir($dest_dir) unless (-d $dest_dir);
+
+	$updated = 0;
+	foreach my $file (@files) {
+		my ($src, $dest);
+
+		$src  = "$src_dir/$file";
+		$dest = "$dest_dir/$file";
+		$new{$file} = 1;
+
+		next if (-f $dest && util_md5File($src) eq util_md5File($dest));
+
+		util_mkdir(dirname($dest)) unless (-d dirname($dest));
+		copy($src, $dest) ||
+			_err("Cannot copy $src to $dest: $!.");
+		++$updated;
+	}
+
+	# remove files generated last time, which are gone now
+	$manifest = "$dest_dir/.cinf_files";
+	util_readFile($manifest, \@old) if (-r $manifest);
+	foreach my $file (@old) {
+		chomp($file);
+		next if ($new{$file});
+		unlink("$dest_dir/$file") if (-f "$dest_dir/$file");
+	}
+
+	util_writeFile([ map { "$_\n" } @files ], $manifest);
+
+	vprint("Updated $updated of " . scalar(@files) . " generated files in $dest_dir");
+
+	return $updated;
+}
+
 #
 # Error checked copy.
 #
@@ -25,6 +25,7 @@ use FindBin;
 use lib "$FindBin::RealBin/lib";
 use Getopt::Long;
 use Cactusinterfacing::CreateLibgeodecompApp qw(createLibgeodecompApp);
+use Cactusinterfacing::AutoTune qw(autoTune);
 use Cactusinterfacing::Utils qw(util_readDir util_readFile util_choose
 								util_input _err vprint util_chooseMulti);
 
@@ -32,7 +33,7 @@ use Cactusinterfacing::Utils qw(util_readDir util_readFile util_choose
 my (@configs, $configdir, @thorns, %config);
 # options
 my (@evol_thorns, @init_thorns, $input_evol_thorn, $input_init_thorn);
-my ($help, $config, $cctk_home, $outputdir, $force_mpi);
+my ($help, $config, $cctk_home, $outputdir, $force_mpi, $autotune);
 
 #
 # Prints usage on stderr and exits with success.
@@ -60,6 +61,9 @@ options:
     --outputdir,  -o        selects the output directory, where generated code will be stored
     --force_mpi,  -f        selects whether the code will be generated with MPI even if the
                             Cactus configuration is built without
+    --autotune,   -a        builds and times variants of the application on a reduced grid
+                            of the given Cactus parameter file and writes the fastest
+                            options into ~/.cactus_inf.rc
 EOF
 
 	exit 0;
@@ -82,6 +86,7 @@ sub getArgs
 
 	GetOptions("help"           => \$help,
 			   "force_mpi"      => \$force_mpi,
+			   "a|autotune=s"   => \$autotune,
 			   "c|config=s"     => \$config,
 			   "evolthorn=s"    => \$input_evol_thorn,
 			   "initthorn=s"    => \$input_init_thorn,
@@ -315,6 +320,11 @@ $config{"outputdir"}  = $outputdir;
 buildThornHash(\%config, \@evol_thorns, \@init_thorns);
 
 # do it
+if ($autotune) {
+	autoTune(\%config, $autotune);
+	vprint("Run main.pl again to generate the application with the tuned options.");
+	exit 0;
+}
 createLibgeodecompApp(\%config);
 
 vprint("Done. You may want to have a look at the source and do some adjustments.");
@@ -0,0 +1,119 @@
+#!/usr/bin/env perl
+#
+# Accuracy regression check for generated applications.
+# Compares the BOV output of a reference run (e.g. full precision) with
+# the output of a test run (e.g. past timelevels stored as float, see
+# float_timelevels in Config.pm) and reports the errors per output file.
+# Returns 0 if all errors are within the tolerance, else 1.
+#
+
+use strict;
+use warnings;
+use Getopt::Long;
+use File::Basename;
+
+my ($tolerance, $help, $ret);
+
+#
+# Reads a BOV header and the data file belonging to it.
+#
+# param:
+#  - file    : path to .bov file
+#  - data_ref: ref to array where to store values
+#
+# return:
+#  - none, exits on error
+#
+sub readBOV
+{
+	my ($file, $data_ref) = @_;
+	my ($fh, %header, $data_file, $format, $buf, $count);
+
+	open($fh, "<", $file) || die "Cannot open file $file: $!\n";
+	while (my $line = <$fh>) {
+		$header{$1} = $2 if ($line =~ /^\s*(\w+)\s*:\s*(.*?)\s*$/);
+	}
+	close $fh;
+
+	die "No DATA_FILE in $file\n" unless (defined $header{"DATA_FILE"});
+
+	# data file is relative to header
+	$data_file = $header{"DATA_FILE"};
+	$data_file = dirname($file) . "/" . $data_file unless ($data_file =~ /^\//);
+	$format    = ($header{"DATA_FORMAT"} || "DOUBLE") =~ /FLOAT/i ? "f" : "d";
+	$count     = 1;
+	$count    *= $_ for (split(' ', $header{"DATA_SIZE"} || "0"));
+
+	open($fh, "<:raw", $data_file) || die "Cannot open file $data_file: $!\n";
+	local $/;
+	$buf = <$fh>;
+	close $fh;
+
+	@$data_ref = unpack("$format$count", $buf);
+
+	return;
+}
+
+#
+# Compares two BOV files.
+#
+# param:
+#  - ref_file : path to reference .bov file
+#  - test_file: path to .bov file to check
+#
+# return:
+#  - maximum relative error
+#
+sub compareBOV
+{
+	my ($ref_file, $test_file) = @_;
+	my (@ref, @test, $max_abs, $max_ref, $sum, $rel, $i);
+
+	readBOV($ref_file,  \@ref);
+	readBOV($test_file, \@test);
+
+	die "Different sizes of $ref_file and $test_file\n" unless (@ref == @test);
+
+	$max_abs = $max_ref = $sum = 0.0;
+	for ($i = 0; $i < @ref; ++$i) {
+		my $diff = abs($ref[$i] - $test[$i]);
+
+		$max_abs = $diff         if ($diff > $max_abs);
+		$max_ref = abs($ref[$i]) if (abs($ref[$i]) > $max_ref);
+		$sum    += $diff * $diff;
+	}
+	$rel = $max_ref > 0 ? $max_abs / $max_ref : $max_abs;
+
+	printf("%-30s max_abs=%.3e rms=%.3e max_rel=%.3e\n", basename($ref_file),
+		   $max_abs, @ref ? sqrt($sum / @ref) : 0, $rel);
+
+	return $rel;
+}
+
+# go
+$tolerance = 1e-5;
+GetOptions("tolerance=f" => \$tolerance,
+		   "help"        => \$help) || die "Wrong options, see --help\n";
+
+if ($help || @ARGV != 2) {
+	print "usage: $0 [--tolerance TOL] reference_dir test_dir\n";
+	print "  Compares all .bov files of reference_dir with the ones in test_dir.\n";
+	print "  Fails if the maximum error relative to max|reference| exceeds TOL (default 1e-5).\n";
+	exit($help ? 0 : 1);
+}
+
+$ret = 0;
+foreach my $ref_file (sort glob("$ARGV[0]/*.bov")) {
+	my $test_file = "$ARGV[1]/" . basename($ref_file);
+
+	unless (-r $test_file) {
+		print STDERR "Missing $test_file\n";
+		$ret = 1;
+		next;
+	}
+	$ret = 1 if (compareBOV($ref_file, $test_file) > $tolerance);
+}
+
+print $ret ? "FAILED: tolerance $tolerance exceeded\n" : "OK\n";
+
+exit $ret;
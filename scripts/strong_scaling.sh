@@ -0,0 +1,116 @@
+#!/usr/bin/env bash
+#
+# Strong scaling benchmark for Cactus WaveToyC demo.
+#  - executes the code generator on the Cactus WaveDemo with MPI
+#  - builds it
+#  - runs it with 1 up to N local MPI ranks on the same problem size
+# Prints run time, speedup and parallel efficiency for each rank count.
+# Returns 0 on success.
+#
+
+set -e
+
+# where to find cactus etc.
+CONFIG="WaveDemo"
+EVOLTHORN="CactusWave/WaveToyC"
+INITTHORN="CactusWave/IDScalarWaveC"
+# get number of cores, assuming a linux system
+NUMCPUS=`awk '/^processor/ { N++ } END { print N }' /proc/cpuinfo`
+# set make options
+MAKEOPTS="-j$NUMCPUS -C $CONFIG"
+MAINOPTS="--evolthorn $EVOLTHORN --initthorn $INITTHORN --config $CONFIG --force_mpi"
+# mpirun command, override by environment variable MPIRUN if needed
+MPIRUN=${MPIRUN:-"mpirun"}
+MAXRANKS=$NUMCPUS
+PARFILE="$HOME/git/Cactus/WaveDemo.par"
+NOBUILD=no
+
+function print_usage()
+{
+  echo "
+USAGE:
+    $0 [options] [path/to/parameter_file]
+
+OPTIONS:
+    -n, --ranks N                      : run with 1 up to N ranks (default: number of cores)
+    -s, --skip-build                   : do not generate and build, make sure to build it first
+    -h, --help                         : display this help
+
+The ghostzone width used for overlapping communication with computation is
+taken from mpi_ghostzone_width in your .cactus_inf.rc.
+"
+}
+
+function get_cctk_home
+{
+  if [ -z "$CCTK_HOME" ] ; then
+    echo -n "Enter the Cactus home directory: "
+    read CCTK_HOME
+    if ! [ -d "$CCTK_HOME" ] ; then
+      echo "This is not a valid directory!"
+      exit -1
+    fi
+  fi
+}
+
+function cmd_build()
+{
+  ./main.pl $MAINOPTS > /dev/null <<EOF
+0
+EOF
+  make $MAKEOPTS > /dev/null
+}
+
+function cmd_scale()
+{
+  local np start end t t1
+
+  printf "%6s %12s %10s %12s\n" "ranks" "time [s]" "speedup" "efficiency"
+  for np in `seq 1 $MAXRANKS` ; do
+    start=`date +%s.%N`
+    $MPIRUN -np $np "$CONFIG/cactus_$CONFIG" "$PARFILE" > /dev/null
+    end=`date +%s.%N`
+    t=`echo "$start $end" | awk '{ print $2 - $1 }'`
+    [ -z "$t1" ] && t1=$t
+    echo "$np $t $t1" | awk '{ printf "%6d %12.3f %10.2f %11.1f%%\n", $1, $2, $3 / $2, 100.0 * $3 / ($2 * $1) }'
+  done
+}
+
+# parse options
+while [ $# -gt 0 ] ; do
+  case "$1" in
+    -n|--ranks)
+      MAXRANKS="$2"
+      shift
+      ;;
+    -s|--skip-build)
+      NOBUILD=yes
+      ;;
+    -h|--help)
+      print_usage
+      exit 0
+      ;;
+    *)
+      PARFILE="$1"
+      ;;
+  esac
+  shift
+done
+
+# parameter file is used after changing directory
+PARFILE=`readlink -f "$PARFILE"`
+
+# test for some tools
+test -x "`which $MPIRUN`" || exit 1
+
+# go
+cd `dirname "${BASH_SOURCE[0]}"`
+cd ..
+if [ "$NOBUILD" == "no" ] ; then
+  get_cctk_home
+  MAINOPTS="$MAINOPTS --cactushome $CCTK_HOME"
+  cmd_build
+fi
+cmd_scale
+
+exit 0
@@ -18,6 +18,14 @@ NUMCPUS=`awk '/^processor/ { N++ } END { print N }' /proc/cpuinfo`
 # set make options
 MAKEOPTS="-j$NUMCPUS -C $CONFIG"
 MAINOPTS="--evolthorn $EVOLTHORN --initthorn $INITTHORN --config $CONFIG"
+# make target, e.g. unity for a single translation unit build
+TARGET="all"
+# line lengths (driver::global_nx) used by the loop peeling benchmark
+PEELING_NX="12 16 20 32 36 64 68 100 128 132"
+# maximum error of the single precision build relative to max|double|
+PRECISION_TOL="1e-3"
+# members of the ensemble benchmark
+ENSEMBLE_SIZE=4
 
 function print_usage()
 {
@@ -27,6 +35,19 @@ USAGE:
 
 OPTIONS:
     -b, --build                        : build only
+    -u, --unity                        : build only, as single translation unit
+    -s, --speedup [path/to/parameter_file] : build with -O3, lto and pgo, run each and
+                                         report the speedups, the parameter file is
+                                         also used for training pgo
+    -p, --peeling [path/to/parameter_file] : build with vectorization and scalar or
+                                         overlapping loop peeling, run both for several
+                                         line lengths and report the speedups
+    -P, --precision [path/to/parameter_file] : build with CCTK_REAL in double and
+                                         single precision, run both and report the
+                                         speedup and the differences of the output
+    -e, --ensemble [path/to/parameter_file] : build with ensemble_size 1 and 4, run the
+                                         first one 4 times, the second one once and
+                                         report the speedup
     -r, --run [path/to/parameter_file] : run only, make sure to build it first
     -m, --main                         : run main.pl only
     -h, --help                         : display this help
@@ -54,10 +75,15 @@ EOF
 
 function cmd_build()
 {
+  local start end
+
   # first of all get source
   execute_main
-  # compile
-  make $MAKEOPTS > /dev/null
+  # compile, report build time
+  start=`date +%s.%N`
+  make $MAKEOPTS $TARGET > /dev/null
+  end=`date +%s.%N`
+  echo "$start $end" | awk '{ printf "Build time ('"$TARGET"'): %.1f s\n", $2 - $1 }'
 }
 
 function cmd_run()
@@ -66,6 +92,123 @@ function cmd_run()
   "$CONFIG/cactus_$CONFIG" "$1"
 }
 
+function time_run()
+{
+  local start end
+
+  start=`date +%s.%N`
+  "$1" "$2" > /dev/null
+  end=`date +%s.%N`
+  echo "$start $end" | awk '{ print $2 - $1 }'
+}
+
+function cmd_speedup()
+{
+  local parfile target prog t t0
+
+  parfile=`readlink -f "$1"`
+  execute_main
+  printf "%8s %10s %8s\n" "build" "time [s]" "speedup"
+  for target in all lto pgo ; do
+    make $MAKEOPTS $target TRAINPAR="$parfile" > /dev/null
+    prog="$CONFIG/cactus_$CONFIG"
+    [ "$target" != "all" ] && prog="$prog-$target"
+    t=`time_run "$prog" "$parfile"`
+    [ -z "$t0" ] && t0=$t
+    echo "$target $t $t0" | awk '{ printf "%8s %10.3f %8.2f\n", $1, $2, $3 / $2 }'
+  done
+}
+
+function cmd_peeling()
+{
+  local parfile tmp peeling nx t t0
+
+  parfile=`readlink -f "$1"`
+  tmp=`mktemp -d`
+  # generate and build one application per peeling strategy, the options
+  # are passed by a private rc file based on the users one
+  for peeling in scalar overlap ; do
+    mkdir -p "$tmp/$peeling"
+    grep -Ev "^ *(use_vectorization|loop_peeling) *=" "$HOME/.cactus_inf.rc" \
+      > "$tmp/$peeling/.cactus_inf.rc" 2> /dev/null || true
+    echo "use_vectorization = 1" >> "$tmp/$peeling/.cactus_inf.rc"
+    echo "loop_peeling = $peeling" >> "$tmp/$peeling/.cactus_inf.rc"
+    echo 0 | HOME="$tmp/$peeling" ./main.pl $MAINOPTS --outputdir "$tmp/$peeling" > /dev/null
+    make -j$NUMCPUS -C "$tmp/$peeling/$CONFIG" > /dev/null
+  done
+  # run both for several line lengths, y and z are kept small
+  printf "%6s %12s %12s %8s\n" "nx" "scalar [s]" "overlap [s]" "speedup"
+  for nx in $PEELING_NX ; do
+    grep -Eiv "^ *driver::global_n(size|x|y|z) *=" "$parfile" > "$tmp/bench.par"
+    echo "driver::global_nx = $nx" >> "$tmp/bench.par"
+    echo "driver::global_ny = 64" >> "$tmp/bench.par"
+    echo "driver::global_nz = 64" >> "$tmp/bench.par"
+    t0=`time_run "$tmp/scalar/$CONFIG/cactus_$CONFIG" "$tmp/bench.par"`
+    t=`time_run "$tmp/overlap/$CONFIG/cactus_$CONFIG" "$tmp/bench.par"`
+    echo "$nx $t0 $t" | awk '{ printf "%6d %12.3f %12.3f %8.2f\n", $1, $2, $3, $2 / $3 }'
+  done
+  rm -rf "$tmp"
+}
+
+function cmd_precision()
+{
+  local parfile tmp precision t t0 ret
+
+  parfile=`readlink -f "$1"`
+  tmp=`mktemp -d`
+  # generate, build and run one application per precision, the options
+  # are passed by a private rc file based on the users one
+  printf "%10s %10s %8s\n" "precision" "time [s]" "speedup"
+  for precision in double single ; do
+    mkdir -p "$tmp/$precision"
+    grep -Ev "^ *real_precision *=" "$HOME/.cactus_inf.rc" \
+      > "$tmp/$precision/.cactus_inf.rc" 2> /dev/null || true
+    echo "real_precision = $precision" >> "$tmp/$precision/.cactus_inf.rc"
+    echo 0 | HOME="$tmp/$precision" ./main.pl $MAINOPTS --outputdir "$tmp/$precision" > /dev/null
+    make -j$NUMCPUS -C "$tmp/$precision/$CONFIG" > /dev/null
+    # run inside the build directory, so the output files are kept apart
+    t=`cd "$tmp/$precision/$CONFIG" && time_run "./cactus_$CONFIG" "$parfile"`
+    [ -z "$t0" ] && t0=$t
+    echo "$precision $t $t0" | awk '{ printf "%10s %10.3f %8.2f\n", $1, $2, $3 / $2 }'
+  done
+  # compare output of single precision against double
+  ret=0
+  scripts/compare_bov.pl --tolerance $PRECISION_TOL \
+    "$tmp/double/$CONFIG" "$tmp/single/$CONFIG" || ret=$?
+  rm -rf "$tmp"
+  return $ret
+}
+
+function cmd_ensemble()
+{
+  local parfile tmp size t t0 i
+
+  parfile=`readlink -f "$1"`
+  tmp=`mktemp -d`
+  # generate and build one application per ensemble size, the options
+  # are passed by a private rc file based on the users one
+  for size in 1 $ENSEMBLE_SIZE ; do
+    mkdir -p "$tmp/$size"
+    grep -Ev "^ *ensemble_size *=" "$HOME/.cactus_inf.rc" \
+      > "$tmp/$size/.cactus_inf.rc" 2> /dev/null || true
+    echo "ensemble_size = $size" >> "$tmp/$size/.cactus_inf.rc"
+    echo 0 | HOME="$tmp/$size" ./main.pl $MAINOPTS --outputdir "$tmp/$size" > /dev/null
+    make -j$NUMCPUS -C "$tmp/$size/$CONFIG" > /dev/null
+  done
+  # separate runs, one after the other
+  t0=0
+  for i in `seq $ENSEMBLE_SIZE` ; do
+    t=`cd "$tmp/1/$CONFIG" && time_run "./cactus_$CONFIG" "$parfile"`
+    t0=`echo "$t0 $t" | awk '{ print $1 + $2 }'`
+  done
+  # one ensemble run
+  t=`cd "$tmp/$ENSEMBLE_SIZE/$CONFIG" && time_run "./cactus_$CONFIG" "$parfile"`
+  printf "%10s %10s %8s\n" "members" "time [s]" "speedup"
+  echo "$ENSEMBLE_SIZE $t0 $t" | awk '{ printf "%10s %10.3f %8.2f\n", $1 " x 1", $2, 1 }'
+  echo "$ENSEMBLE_SIZE $t0 $t" | awk '{ printf "%10s %10.3f %8.2f\n", "1 x " $1, $3, $2 / $3 }'
+  rm -rf "$tmp"
+}
+
 function cmd_main()
 {
   ./main.pl $MAINOPTS <<EOF
@@ -84,6 +227,22 @@ case "$1" in
   -b|--build)
     cmd_build
     ;;
+  -u|--unity)
+    TARGET="unity"
+    cmd_build
+    ;;
+  -s|--speedup)
+    cmd_speedup ${2:-"$HOME/git/Cactus/WaveDemo.par"}
+    ;;
+  -p|--peeling)
+    cmd_peeling ${2:-"$HOME/git/Cactus/WaveDemo.par"}
+    ;;
+  -P|--precision)
+    cmd_precision ${2:-"$HOME/git/Cactus/WaveDemo.par"}
+    ;;
+  -e|--ensemble)
+    cmd_ensemble ${2:-"$HOME/git/Cactus/WaveDemo.par"}
+    ;;
   -r|--run)
     cmd_run ${2:-"$HOME/git/Cactus/WaveDemo.par"}
     ;;
@@ -10,6 +10,9 @@
  * Overrides types located in src/include/cctk_Types.h.
  *
  * CCTK_KEYWORD, CCTK_BOOLEAN got added for parameters.
+ *
+ * CCTK_REAL and CCTK_COMPLEX are single precision if the application
+ * is built with -DCCTK_REAL_PRECISION_4 (see real_precision in Config.pm).
  */
 
 
@@ -33,8 +36,13 @@ typedef std::complex<CCTK_REAL16> CCTK_COMPLEX32;
 typedef unsigned char  CCTK_BYTE;
 typedef char           CCTK_CHAR;
 typedef CCTK_INT4      CCTK_INT;
+#ifdef CCTK_REAL_PRECISION_4
+typedef CCTK_REAL4     CCTK_REAL;
+typedef CCTK_COMPLEX8  CCTK_COMPLEX;
+#else
 typedef CCTK_REAL8     CCTK_REAL;
 typedef CCTK_COMPLEX16 CCTK_COMPLEX;
+#endif
 typedef void *         CCTK_POINTER;
 typedef const void *   CCTK_POINTER_TO_CONST;
 typedef std::string    CCTK_STRING;
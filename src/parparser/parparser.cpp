@@ -1,8 +1,10 @@
 #include "parparser.h"
 
 #include <fstream>
+#include <vector>
 #include <boost/regex.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
 #include <cmath>
 #include "cell.h"
 #include "init.h"
@@ -25,6 +27,54 @@
 		}												\
 	} while (0)
 
+#ifdef ENSEMBLESIZE
+/**
+ * Ensemble version of GET. Sets the value of every ensemble
+ * member, using impl::name[member] if given and impl::name
+ * otherwise.
+ *
+ * @param name
+ * @param type
+ * @param toSet array of size ENSEMBLESIZE
+ *
+ * @return
+ */
+#define GETENSEMBLE(name, type, toSet)									\
+	do {																\
+		for (int member = 0; member < ENSEMBLESIZE; ++member) {			\
+			std::string key = ensembleKey(#name, member);				\
+			if (exists(key)) {											\
+				toSet[member] = fromString<type>(getString(key));		\
+			}															\
+		}																\
+	} while (0)
+
+/**
+ * Version of GETENSEMBLE for parameters which have to be the
+ * same for all ensemble members, since the members share the
+ * lanes of the vectorized kernels.
+ *
+ * @param name
+ * @param type
+ * @param toSet array of size ENSEMBLESIZE
+ *
+ * @return
+ */
+#define GETSHARED(name, type, toSet)									\
+	do {																\
+		std::string first = exists(ensembleKey(#name, 0)) ?				\
+			getString(ensembleKey(#name, 0)) : "";						\
+		for (int member = 1; member < ENSEMBLESIZE; ++member) {			\
+			std::string key = ensembleKey(#name, member);				\
+			if ((exists(key) ? getString(key) : "") != first) {			\
+				throw std::invalid_argument(std::string(#name) +		\
+					" has to be the same for all ensemble members");	\
+			}															\
+		}																\
+		GETENSEMBLE(name, type, toSet);									\
+	} while (0)
+#endif
+
 /**
  * Checks whether an parameter is given and
  * sets it directly into cactus grid hierarchy.
@@ -77,6 +127,13 @@ std::string ParParser::getString(const std::string& key) const
 	return m_parMap.find(copy)->second;
 }
 
+std::string ParParser::ensembleKey(const std::string& name, int member) const
+{
+	std::string key = name + "[" + boost::lexical_cast<std::string>(member) + "]";
+
+	return exists(key) ? key : name;
+}
+
 bool ParParser::equals(const std::string& str1, const std::string& str2) const
 {
 	return boost::iequals(str1, str2);
@@ -120,6 +177,9 @@ void ParParser::initThornDefaults()
 	m_avoidOrigin[0]   = true;
 	m_avoidOrigin[1]   = true;
 	m_avoidOrigin[2]   = true;
+	m_symmetryMirror[0] = 0;
+	m_symmetryMirror[1] = 0;
+	m_symmetryMirror[2] = 0;
 	m_dxyz             = 0.0;
 	m_d[0]             = 0.3;
 	m_d[1]             = 0.3;
@@ -142,6 +202,14 @@ void ParParser::initThornDefaults()
 
 	// HDF5
 	m_hdf5_out         = 1;
+
+	// LibGeoDecomp
+	m_load_balancing_period = 100;
+	m_memory_limit          = MEMORYLIMIT;
+	m_reductions            = "";
+	m_reduction_every       = 1;
+	m_courant_variable      = "";
+	m_courant_every         = 1;
 }
 
 void ParParser::initDefaults()
@@ -175,22 +243,21 @@ void ParParser::proceedPUGH()
 		m_local[0] = m_local[1] = m_local[2] = m_localNSize;
 	}
 	if (m_local[0] > 0 && m_local[1] > 0 && m_local[2] > 0) {
-		for (i = 0; i < dim; ++i) {
+		for (i = 0; i < dim; ++i)
 			m_cctkGH->cctk_gsh()[i] = m_local[i];
-			m_cctkGH->cctk_lsh()[i] = m_local[i];
-		}
+	} else {
+		// global given
+		if (m_globalNSize > 0)
+			m_global[0] = m_global[1] = m_global[2] = m_globalNSize;
 
-		return;
+		for (i = 0; i < dim; ++i)
+			m_cctkGH->cctk_gsh()[i] = m_global[i];
 	}
 
-	// global given
-	if (m_globalNSize > 0)
-		m_global[0] = m_global[1] = m_global[2] = m_globalNSize;
-
-	for (i = 0; i < dim; ++i) {
-		m_cctkGH->cctk_gsh()[i] = m_global[i];
-		m_cctkGH->cctk_lsh()[i] = m_global[i];
-	}
+	// until the initializer knows the region of this rank, the
+	// local part of the grid hierarchy covers the whole grid
+	std::vector<int> origin(dim, 0);
+	m_cctkGH->setLocalBox(&origin[0], m_cctkGH->cctk_gsh());
 }
 
 void ParParser::setupSymmetry()
@@ -198,6 +265,7 @@ void ParParser::setupSymmetry()
 	int i;
 	bool quadrant    = false;
 	unsigned int dim = m_cctkGH->cctk_dim();
+	int ghosts       = GHOSTZONEWIDTH;
 
 	if (equals(m_domain, "bitant")) {
 		// z >= 0
@@ -217,17 +285,34 @@ void ParParser::setupSymmetry()
 		return;
 	}
 
-	// apply symmetry
+	// apply symmetry, the grid size describes the full domain, which is
+	// assumed to be symmetric to the origin. Only the upper half and the
+	// ghost points below the origin are kept, the spacing stays the same.
 	for (; i >= 0; --i) {
 		unsigned int x = quadrant ? i : 2 - i;
+		int inner;
+
 		if (x >= dim)
 			continue;
 		if (m_avoidOrigin[x]) {
-			m_cctkGH->cctk_origin_space()[x] = -m_cctkGH->cctk_delta_space()[x] / 2.0;
+			// points at (k + 1/2) * dx, ghost j mirrors 2 * ghosts - 1 - j
+			inner = (m_cctkGH->cctk_gsh()[x] + 1) / 2;
+			m_cctkGH->cctk_origin_space()[x] = -(ghosts - 0.5) * m_cctkGH->cctk_delta_space()[x];
+			m_symmetryMirror[x] = 2 * ghosts - 1;
 		} else {
-			m_cctkGH->cctk_origin_space()[x] = -m_cctkGH->cctk_delta_space()[x];
+			// points at k * dx, ghost j mirrors 2 * ghosts - j
+			inner = m_cctkGH->cctk_gsh()[x] / 2 + 1;
+			m_cctkGH->cctk_origin_space()[x] = -ghosts * m_cctkGH->cctk_delta_space()[x];
+			m_symmetryMirror[x] = 2 * ghosts;
 		}
+		if (inner <= ghosts)
+			throw std::invalid_argument("Grid too small for symmetric domain " + m_domain);
+		m_cctkGH->cctk_gsh()[x] = inner + ghosts;
 	}
+
+	// the local part covers the whole reduced grid, see proceedPUGH()
+	std::vector<int> origin(dim, 0);
+	m_cctkGH->setLocalBox(&origin[0], m_cctkGH->cctk_gsh());
 }
 
 void ParParser::proceedCartGrid()
@@ -315,6 +400,8 @@ void ParParser::proceedTime()
 	GET(time::timestep_method, std::string, m_timeMethod);
 	GET(time::dtfac, CCTK_REAL, m_dtfac);
 	GET(time::courant_fac, CCTK_REAL, m_courant_fac);
+	GET(time::courant_wave_speed, CCTK_REAL, m_courant_speed);
+	GET(time::courant_min_time, CCTK_REAL, m_courant_min_time);
 
 	// compute
 	if (equals(m_timeMethod, "given")) {
@@ -323,13 +410,19 @@ void ParParser::proceedTime()
 		// dt = dtfac * min (dx^i)
 		min = m_cctkGH->min_cctk_delta_space();
 		delta_time = m_dtfac * min;
-	} else if (equals(m_timeMethod, "courant_speed")) { // FIXME:
+	} else if (equals(m_timeMethod, "courant_speed")) {
 		// dt = courant_fac * min(dx^i) / courant_wave_speed / sqrt(dim)
+		// this is the initial time step if it's adapted during the run,
+		// see libgeodecomp::courant_speed_variable
+		if (m_courant_speed <= 0)
+			throw std::invalid_argument("time::courant_wave_speed has to be greater than zero");
 		min = m_cctkGH->min_cctk_delta_space();
 		sdim = sqrt(m_cctkGH->cctk_dim());
 		delta_time = m_courant_fac * min / m_courant_speed / sdim;
-	} else if (equals(m_timeMethod, "courant_time")) {  // FIXME:
+	} else if (equals(m_timeMethod, "courant_time")) {
 		// dt = courant_fac * courant_min_time / sqrt(dim)
+		if (m_courant_min_time <= 0)
+			throw std::invalid_argument("time::courant_min_time has to be greater than zero");
 		sdim = sqrt(m_cctkGH->cctk_dim());
 		delta_time = m_courant_fac * m_courant_min_time / sdim;
 	} else {
@@ -346,6 +439,35 @@ void ParParser::proceedHDF5()
 	GET(iohdf5::out_every, unsigned, m_hdf5_out);
 }
 
+void ParParser::proceedLibGeoDecomp()
+{
+	// get load balancing period
+	GET(libgeodecomp::load_balancing_period, unsigned, m_load_balancing_period);
+
+	if (m_load_balancing_period == 0)
+		throw std::invalid_argument("libgeodecomp::load_balancing_period has to be greater than zero");
+
+	// get memory limit
+	GET(libgeodecomp::memory_limit, unsigned, m_memory_limit);
+
+	// get reductions, the list contains spaces, so don't convert it
+	if (exists("libgeodecomp::reductions"))
+		m_reductions = getString("libgeodecomp::reductions");
+	GET(libgeodecomp::reduction_every, unsigned, m_reduction_every);
+
+	if (m_reduction_every == 0)
+		throw std::invalid_argument("libgeodecomp::reduction_every has to be greater than zero");
+
+	// get grid function for adaptive time step, only used by courant_speed
+	GET(libgeodecomp::courant_speed_variable, std::string, m_courant_variable);
+	GET(libgeodecomp::courant_every, unsigned, m_courant_every);
+
+	if (!equals(m_timeMethod, "courant_speed"))
+		m_courant_variable = "";
+	if (m_courant_every == 0)
+		throw std::invalid_argument("libgeodecomp::courant_every has to be greater than zero");
+}
+
 void ParParser::prepareValues()
 {
 	for (std::map<std::string, std::string>::iterator it = m_parMap.begin();
@@ -375,7 +497,7 @@ void ParParser::parseLine(const std::string& line)
 {
 	boost::regex comment("^\\s*(#|!)", boost::regex::perl | boost::regex::icase);
 	boost::regex empty("^\\s*$", boost::regex::perl | boost::regex::icase);
-	boost::regex parameter("^\\s*(\\w+::\\w+|ActiveThorns)\\s*=\\s*(.*)$",
+	boost::regex parameter("^\\s*(\\w+::\\w+(?:\\[\\d+\\])?|ActiveThorns)\\s*=\\s*(.*)$",
 						   boost::regex::perl | boost::regex::icase);
 	boost::smatch token;
 
@@ -437,6 +559,9 @@ void ParParser::parse()
 	// init output parameters
 	proceedHDF5();
 
+	// init LibGeoDecomp parameters
+	proceedLibGeoDecomp();
+
 	// setup thorn specific parameters
 	SETUPTHORNPARAMETERS;
 
@@ -43,6 +43,7 @@ private:
 	std::string m_domain;		/**< grid domain */
 	bool m_avoidOriginNSize;	/**< avoid origin */
 	bool m_avoidOrigin[3];		/**< avoid origin in each direction */
+	int m_symmetryMirror[3];	/**< ghost j mirrors point m - j, 0 for no symmetry */
 	CCTK_REAL m_dxyz;			/**< delta space */
 	CCTK_REAL m_d[3];			/**< delta space in each direction */
 	CCTK_REAL m_xyzmax;			/**< maximum */
@@ -56,6 +57,12 @@ private:
 	CCTK_REAL m_courant_min_time; /**< courant minimum time */
 	unsigned  m_it_max;			/**< maximum iteration */
 	unsigned  m_hdf5_out;		/**< hdf5 output frequency */
+	unsigned  m_load_balancing_period; /**< steps between two load balancing calls */
+	unsigned  m_memory_limit;	/**< memory limit per rank in MiB, 0 means none */
+	std::string m_reductions;	/**< reductions of grid functions */
+	unsigned  m_reduction_every; /**< steps between two reductions */
+	std::string m_courant_variable; /**< grid function holding the characteristic speed */
+	unsigned  m_courant_every;	/**< steps between two updates of the time step */
 	/**
 	 * Parses a line of parameter file
 	 * and stores impl::name and value into the hash map.
@@ -93,6 +100,17 @@ private:
 	 * @return
 	 */
 	std::string getString(const std::string& key) const;
+	/**
+	 * Key of a parameter for one ensemble member. Values for single
+	 * members are given as impl::name[member] in the parameter file,
+	 * all other members use impl::name.
+	 *
+	 * @param name impl::name of parameter
+	 * @param member ensemble member
+	 *
+	 * @return impl::name[member] if given, impl::name otherwise
+	 */
+	std::string ensembleKey(const std::string& name, int member) const;
 	/**
 	 * Prepares values for further processing, including:
 	 *  - removes ""
@@ -131,7 +149,9 @@ private:
 	void proceedPUGH();
 	/**
 	 * Helper function for proceedCartGrid().
-	 * This function applys the symmetry to the grid.
+	 * This function applys the symmetry to the grid. Symmetric
+	 * directions are reduced to the upper half of the domain plus
+	 * GHOSTZONEWIDTH mirror points below the origin.
 	 * Make sure all needed variables are set up.
 	 *
 	 */
@@ -155,6 +175,11 @@ private:
 	 *
 	 */
 	void proceedHDF5();
+	/**
+	 * Gets the parameters for LibGeoDecomp itself, given
+	 * by libgeodecomp::name in the parameter file.
+	 */
+	void proceedLibGeoDecomp();
 	/**
 	 * Converts a string into type given by T.
 	 *
@@ -244,6 +269,109 @@ public:
 
 		return m_hdf5_out;
 	}
+	/**
+	 * Gets the number of time steps between two load balancing calls.
+	 * Only used by the MPI application if a load balancer is configured.
+	 * Note: Call parse() first.
+	 * @return load balancing period
+	 */
+	inline const unsigned& loadBalancingPeriod() const
+	{
+		if (!m_parsed)
+			throw std::logic_error("ParParser: Call parse() first!");
+
+		return m_load_balancing_period;
+	}
+	/**
+	 * Gets the memory limit per rank in MiB. The application refuses to
+	 * run if the estimated memory usage exceeds it. 0 means no limit.
+	 * Note: Call parse() first.
+	 * @return memory limit in MiB
+	 */
+	inline const unsigned& memoryLimit() const
+	{
+		if (!m_parsed)
+			throw std::logic_error("ParParser: Call parse() first!");
+
+		return m_memory_limit;
+	}
+	/**
+	 * Gets the list of reductions, see cctkreducer.h.
+	 * Note: Call parse() first.
+	 * @return reductions, empty if there are none
+	 */
+	inline const std::string& reductions() const
+	{
+		if (!m_parsed)
+			throw std::logic_error("ParParser: Call parse() first!");
+
+		return m_reductions;
+	}
+	/**
+	 * Gets the number of time steps between two reductions.
+	 * Note: Call parse() first.
+	 * @return reduction period
+	 */
+	inline const unsigned& reductionEvery() const
+	{
+		if (!m_parsed)
+			throw std::logic_error("ParParser: Call parse() first!");
+
+		return m_reduction_every;
+	}
+	/**
+	 * Gets the courant factor of CactusBase/Time.
+	 * Note: Call parse() first.
+	 * @return courant factor
+	 */
+	inline const CCTK_REAL& courantFac() const
+	{
+		if (!m_parsed)
+			throw std::logic_error("ParParser: Call parse() first!");
+
+		return m_courant_fac;
+	}
+	/**
+	 * Gets the grid function holding the characteristic speed, which
+	 * is used to adapt the time step. Only set for the time method
+	 * courant_speed.
+	 * Note: Call parse() first.
+	 * @return name of grid function, empty for a static time step
+	 */
+	inline const std::string& courantSpeedVariable() const
+	{
+		if (!m_parsed)
+			throw std::logic_error("ParParser: Call parse() first!");
+
+		return m_courant_variable;
+	}
+	/**
+	 * Gets the number of time steps between two updates of the
+	 * adaptive time step.
+	 * Note: Call parse() first.
+	 * @return update period
+	 */
+	inline const unsigned& courantEvery() const
+	{
+		if (!m_parsed)
+			throw std::logic_error("ParParser: Call parse() first!");
+
+		return m_courant_every;
+	}
+	/**
+	 * Gets the reflection of the ghost points of a symmetric direction
+	 * (bitant, quadrant, octant): ghost point j mirrors point m - j.
+	 * Note: Call parse() first.
+	 * @param dir direction
+	 * @return m, 0 if dir isn't symmetric
+	 */
+	inline int symmetryMirror(unsigned dir) const
+	{
+		if (!m_parsed)
+			throw std::logic_error("ParParser: Call parse() first!");
+
+		return dir < 3 ? m_symmetryMirror[dir] : 0;
+	}
 };
 
 #endif /* _PARPARSER_H_ */
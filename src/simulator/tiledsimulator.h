@@ -0,0 +1,298 @@
+#ifndef _TILEDSIMULATOR_H_
+#define _TILEDSIMULATOR_H_
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <typeinfo>
+#include <vector>
+#include <sys/time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <libgeodecomp.h>
+
+/**
+ * @file   tiledsimulator.h
+ *
+ * @brief Serial simulator for 3D cells, which updates the grid in tiles
+ * of y-z lines instead of plain y-z order.
+ *
+ * The SerialSimulator walks all lines of a plane before going to the next
+ * plane. For large x extents the neighbouring lines in y and z are evicted
+ * from cache before they are read again. Updating the grid tile by tile
+ * keeps the working set (about three planes of one tile) in cache.
+ *
+ * The tile size is picked by a short auto-tuning run on construction,
+ * which times update sweeps of the initial grid for a few candidates.
+ * Writers and steerers are added after construction, so they don't see
+ * the sweeps. The per function totals of the performance counters do,
+ * the generated main resets them after construction. The result is
+ * recorded in a cache file per cell type, thread count and grid size,
+ * so later runs skip the tuning.
+ *
+ */
+template<typename CELL_TYPE>
+class TiledSimulator : public LibGeoDecomp::SerialSimulator<CELL_TYPE>
+{
+public:
+	typedef LibGeoDecomp::SerialSimulator<CELL_TYPE> ParentType;
+	typedef typename ParentType::GridType GridType;
+	static const int DIM = ParentType::DIM;
+	static const unsigned NANO_STEPS = ParentType::NANO_STEPS;
+
+	/**
+	 * Constructor. Reads the tile size for the current grid from the
+	 * cache file or auto-tunes it, if there is no entry yet.
+	 *
+	 * @param initializer initializer for the grid
+	 * @param cacheFile file where tile sizes are recorded
+	 */
+	TiledSimulator(LibGeoDecomp::Initializer<CELL_TYPE> *initializer,
+				   const std::string& cacheFile = "tiling.cache") :
+		ParentType(initializer),
+		m_cacheFile(cacheFile),
+		m_tileY(0), m_tileZ(0)
+	{
+		if (!readCache())
+			autoTune();
+		setupTiles(m_tileY, m_tileZ);
+	}
+
+	virtual ~TiledSimulator()
+	{}
+
+	/**
+	 * Same as SerialSimulator::step(), but the nano steps are
+	 * done tile by tile.
+	 *
+	 */
+	virtual void step()
+	{
+		unsigned i;
+
+		this->handleInput(LibGeoDecomp::STEERER_NEXT_STEP);
+		for (i = 0; i < NANO_STEPS; ++i) {
+			updateTiles(i);
+			std::swap(this->curGrid, this->newGrid);
+			// like SerialSimulator::nanoStep(), needed for periodic topologies
+			this->updateGhostZones();
+		}
+		++this->stepNum;
+		this->handleOutput(LibGeoDecomp::WRITER_STEP_FINISHED);
+	}
+
+	/**
+	 * @return tile size in y direction
+	 */
+	int tileY() const
+	{
+		return m_tileY;
+	}
+
+	/**
+	 * @return tile size in z direction
+	 */
+	int tileZ() const
+	{
+		return m_tileZ;
+	}
+
+private:
+	std::string m_cacheFile;						/**< file where tile sizes are recorded */
+	int m_tileY;									/**< tile size in y direction */
+	int m_tileZ;									/**< tile size in z direction */
+	std::vector<LibGeoDecomp::Region<DIM> > m_tiles;	/**< simArea split into tiles */
+
+	/**
+	 * Updates all tiles from curGrid into newGrid.
+	 *
+	 * @param nanoStep current nano step
+	 */
+	void updateTiles(unsigned nanoStep)
+	{
+		typename std::vector<LibGeoDecomp::Region<DIM> >::const_iterator it;
+
+		for (it = m_tiles.begin(); it != m_tiles.end(); ++it)
+			LibGeoDecomp::UpdateFunctor<CELL_TYPE>()(
+				*it, LibGeoDecomp::Coord<DIM>(), LibGeoDecomp::Coord<DIM>(),
+				*this->curGrid, this->newGrid, nanoStep);
+	}
+
+	/**
+	 * Splits the simulation area into tiles of tileY x tileZ lines.
+	 * Tiles are ordered z-major like the lines within a tile.
+	 *
+	 * @param tileY tile size in y direction
+	 * @param tileZ tile size in z direction
+	 */
+	void setupTiles(int tileY, int tileZ)
+	{
+		LibGeoDecomp::CoordBox<DIM> box = this->simArea.boundingBox();
+		int y, z;
+
+		m_tiles.clear();
+		for (z = 0; z < box.dimensions.z(); z += tileZ) {
+			for (y = 0; y < box.dimensions.y(); y += tileY) {
+				LibGeoDecomp::Coord<DIM> origin = box.origin;
+				LibGeoDecomp::Coord<DIM> dims   = box.dimensions;
+				LibGeoDecomp::Region<DIM> tile;
+
+				origin.y() += y;
+				origin.z() += z;
+				dims.y()    = std::min(tileY, box.dimensions.y() - y);
+				dims.z()    = std::min(tileZ, box.dimensions.z() - z);
+				tile << LibGeoDecomp::CoordBox<DIM>(origin, dims);
+				m_tiles.push_back(tile & this->simArea);
+			}
+		}
+	}
+
+	/**
+	 * Times update sweeps for the given tile size. The sweeps write
+	 * newGrid only, so the state of the simulation is not changed.
+	 * They don't call handleInput() or handleOutput().
+	 *
+	 * @param tileY tile size in y direction
+	 * @param tileZ tile size in z direction
+	 *
+	 * @return time in seconds for one sweep
+	 */
+	double measure(int tileY, int tileZ)
+	{
+		static const int repeats = 2;
+		struct timeval start, end;
+		int i;
+
+		setupTiles(tileY, tileZ);
+		// warm up
+		updateTiles(0);
+		gettimeofday(&start, NULL);
+		for (i = 0; i < repeats; ++i)
+			updateTiles(0);
+		gettimeofday(&end, NULL);
+
+		return ((end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) * 1e-6) / repeats;
+	}
+
+	/**
+	 * Picks the fastest tile size out of a few candidates, starting
+	 * with a single tile (plain y-z order) and records it.
+	 *
+	 */
+	void autoTune()
+	{
+		static const int sizes[] = { 4, 8, 16, 32, 64, 128 };
+		LibGeoDecomp::Coord<DIM> dims = this->simArea.boundingBox().dimensions;
+		double best, time;
+		unsigned i;
+
+		// the sweeps read the ghost zones of curGrid
+		this->updateGhostZones();
+		m_tileY = dims.y();
+		m_tileZ = dims.z();
+		best    = measure(m_tileY, m_tileZ);
+
+		for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+			if (sizes[i] >= dims.y())
+				break;
+			// square tiles and slabs spanning the whole z extent
+			time = measure(sizes[i], std::min(sizes[i], dims.z()));
+			if (time < best) {
+				best    = time;
+				m_tileY = sizes[i];
+				m_tileZ = std::min(sizes[i], dims.z());
+			}
+			time = measure(sizes[i], dims.z());
+			if (time < best) {
+				best    = time;
+				m_tileY = sizes[i];
+				m_tileZ = dims.z();
+			}
+		}
+
+		std::cout << "TiledSimulator: using tiles of " << m_tileY << "x" << m_tileZ
+				  << " lines for grid " << dims << std::endl;
+		writeCache();
+	}
+
+	/**
+	 * @return number of threads updating the grid
+	 */
+	static int threads()
+	{
+#ifdef _OPENMP
+		return omp_get_max_threads();
+#else
+		return 1;
+#endif
+	}
+
+	/**
+	 * The best tile size depends on the bytes per cell and the cache
+	 * share of a thread as well, so the cell type and the number of
+	 * threads are part of the key.
+	 *
+	 * @return key of the current cell type, thread count and grid size
+	 *         in the cache file
+	 */
+	std::string cacheKey() const
+	{
+		LibGeoDecomp::Coord<DIM> dims = this->simArea.boundingBox().dimensions;
+		std::ostringstream key;
+
+		key << typeid(CELL_TYPE).name() << " " << threads() << " "
+			<< dims.x() << " " << dims.y() << " " << dims.z();
+
+		return key.str();
+	}
+
+	/**
+	 * Looks up the tile size for the current key in the cache file.
+	 * Lines have the format "cell threads nx ny nz tileY tileZ".
+	 *
+	 * @return true if found, else false
+	 */
+	bool readCache()
+	{
+		std::ifstream in(m_cacheFile.c_str());
+		std::string line, key, cell;
+		int nt, nx, ny, nz, ty, tz;
+
+		key = cacheKey();
+		while (std::getline(in, line)) {
+			std::istringstream fields(line);
+			std::ostringstream lineKey;
+
+			if (!(fields >> cell >> nt >> nx >> ny >> nz >> ty >> tz) || ty <= 0 || tz <= 0)
+				continue;
+			lineKey << cell << " " << nt << " " << nx << " " << ny << " " << nz;
+			if (lineKey.str() != key)
+				continue;
+			m_tileY = ty;
+			m_tileZ = tz;
+			return true;
+		}
+
+		return false;
+	}
+
+	/**
+	 * Appends the tile size for the current key to the cache file.
+	 *
+	 */
+	void writeCache() const
+	{
+		std::ofstream out(m_cacheFile.c_str(), std::ios::app);
+
+		if (!out) {
+			std::cerr << "TiledSimulator: cannot write " << m_cacheFile << std::endl;
+			return;
+		}
+		out << cacheKey() << " " << m_tileY << " " << m_tileZ << std::endl;
+	}
+};
+
+#endif /* _TILEDSIMULATOR_H_ */
@@ -0,0 +1,715 @@
+#ifndef _CCTKREDUCER_H_
+#define _CCTKREDUCER_H_
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/time.h>
+#include <libgeodecomp.h>
+#include <libgeodecomp/io/steerer.h>
+#include "cctk_Types.h"
+#include "cactusgrid.h"
+
+/**
+ * @file   cctkreducer.h
+ *
+ * @brief Global reductions of grid functions into grid scalars, similar
+ * to CCTK_Reduce().
+ *
+ * A reduction is given by "operation(variable)=target", where operation
+ * is one of the Cactus reduction operators (sum, minimum, maximum,
+ * average, count, norm1, norm2, norm_inf) and target is a grid scalar of
+ * the static data class. The target may be omitted, then the value is
+ * only printed. The reductions are listed in the parameter file:
+ *
+ *   libgeodecomp::reductions      = "norm2(phi)=phi_norm maximum(phi)"
+ *   libgeodecomp::reduction_every = 10
+ *
+ * Every thread accumulates partial results over its share of the streaks
+ * of the local region (if compiled with OpenMP), which are combined per
+ * rank and finally over all ranks by MPI_Allreduce. The results and the
+ * time needed for the reductions are printed by rank 0.
+ *
+ * On bitant, quadrant and octant domains only the upper half of each
+ * symmetric direction is stored (see symmetryboundary.h). The ghost points
+ * below the origin are skipped and every other point stands for itself and
+ * its mirror image, so it is weighted by 2 per symmetric direction (1 on
+ * the symmetry plane). This gives the sums, counts and norms of the full
+ * domain.
+ *
+ * AdaptiveTimeStep uses the same reduction to adapt cctk_delta_time to the
+ * maximum characteristic speed (time::timestep_method = "courant_speed").
+ *
+ */
+
+/**
+ * Partial result of a reduction. It holds everything needed to compute
+ * any of the reduction operators, so all operators on one variable share
+ * a single sweep over the grid.
+ *
+ */
+class ReductionResult
+{
+public:
+	enum Operation {
+		SUM, MINIMUM, MAXIMUM, AVERAGE, COUNT, NORM1, NORM2, NORM_INF
+	};
+
+	double sum;					/**< sum of values */
+	double sumAbs;				/**< sum of absolute values */
+	double sumSquares;			/**< sum of squared values */
+	double min;					/**< minimum value */
+	double max;					/**< maximum value */
+	double count;				/**< number of values, weighted */
+
+	ReductionResult() :
+		sum(0), sumAbs(0), sumSquares(0),
+		min(std::numeric_limits<double>::max()),
+		max(-std::numeric_limits<double>::max()),
+		count(0)
+	{}
+
+	/**
+	 * Adds a value.
+	 *
+	 * @param value value to add
+	 * @param weight number of points the value stands for
+	 */
+	inline void add(double value, double weight = 1)
+	{
+		sum        += weight * value;
+		sumAbs     += weight * std::fabs(value);
+		sumSquares += weight * value * value;
+		min         = std::min(min, value);
+		max         = std::max(max, value);
+		count      += weight;
+	}
+
+	/**
+	 * Combines another partial result into this one.
+	 *
+	 * @param other partial result
+	 */
+	void combine(const ReductionResult& other)
+	{
+		sum        += other.sum;
+		sumAbs     += other.sumAbs;
+		sumSquares += other.sumSquares;
+		min         = std::min(min, other.min);
+		max         = std::max(max, other.max);
+		count      += other.count;
+	}
+
+	/**
+	 * Combines the partial results of all ranks, so every rank gets the
+	 * global result. Does nothing without MPI.
+	 *
+	 */
+	void allReduce()
+	{
+#ifdef LIBGEODECOMP_WITH_MPI
+		double sums[4] = { sum, sumAbs, sumSquares, count };
+		double mins[2] = { min, -max };
+
+		MPI_Allreduce(MPI_IN_PLACE, sums, 4, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+		MPI_Allreduce(MPI_IN_PLACE, mins, 2, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+		sum        = sums[0];
+		sumAbs     = sums[1];
+		sumSquares = sums[2];
+		count      = sums[3];
+		min        = mins[0];
+		max        = -mins[1];
+#endif
+	}
+
+	/**
+	 * Computes the value of a reduction operator. The norms are
+	 * defined as in CactusPUGH/PUGHReduce.
+	 *
+	 * @param op reduction operator
+	 *
+	 * @return result
+	 */
+	double value(Operation op) const
+	{
+		switch (op) {
+		case SUM:
+			return sum;
+		case MINIMUM:
+			return min;
+		case MAXIMUM:
+			return max;
+		case AVERAGE:
+			return count > 0 ? sum / count : 0;
+		case COUNT:
+			return count;
+		case NORM1:
+			return count > 0 ? sumAbs / count : 0;
+		case NORM2:
+			return count > 0 ? std::sqrt(sumSquares / count) : 0;
+		case NORM_INF:
+			return std::max(std::fabs(min), std::fabs(max));
+		}
+		return 0;
+	}
+
+	/**
+	 * Gets the operator for a Cactus reduction name, case is ignored.
+	 * Besides the Cactus names min, max and avg are accepted.
+	 *
+	 * @param name name of reduction
+	 *
+	 * @return operator
+	 */
+	static Operation operation(const std::string& name)
+	{
+		std::string op = toLower(name);
+
+		if (op == "sum")
+			return SUM;
+		if (op == "minimum" || op == "min")
+			return MINIMUM;
+		if (op == "maximum" || op == "max")
+			return MAXIMUM;
+		if (op == "average" || op == "avg" || op == "mean")
+			return AVERAGE;
+		if (op == "count")
+			return COUNT;
+		if (op == "norm1")
+			return NORM1;
+		if (op == "norm2")
+			return NORM2;
+		if (op == "norm_inf")
+			return NORM_INF;
+
+		throw std::invalid_argument("Unknown reduction operator " + name);
+	}
+
+	/**
+	 * @return lower case copy of str, names in parameter files ignore case
+	 */
+	static std::string toLower(const std::string& str)
+	{
+		std::string ret = str;
+
+		std::transform(ret.begin(), ret.end(), ret.begin(), ::tolower);
+
+		return ret;
+	}
+
+	/**
+	 * Reduces a local array, e.g. a grid array of the static data class,
+	 * over all threads and ranks. This is the counterpart of
+	 * CCTK_ReduceLocArrayToArray1D() for analysis code.
+	 *
+	 * @param values array to reduce
+	 * @param size number of elements
+	 * @param global combine results of all ranks
+	 *
+	 * @return reduction result
+	 */
+	template<typename T>
+	static ReductionResult reduceArray(const T *values, long size, bool global = false)
+	{
+		ReductionResult result;
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+		{
+			ReductionResult partial;
+			long i;
+
+#ifdef _OPENMP
+#pragma omp for schedule(static) nowait
+#endif
+			for (i = 0; i < size; ++i)
+				partial.add(values[i]);
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+			result.combine(partial);
+		}
+		if (global)
+			result.allReduce();
+
+		return result;
+	}
+};
+
+/**
+ * Reduces grid functions of the cells in a region. The streaks of the
+ * region are distributed among the threads, each one accumulating its
+ * own partial results, which are combined afterwards. The values of a
+ * grid function are copied streak by streak by GridBase::saveMember(),
+ * which reads only this member from the SoA grid instead of whole cells.
+ * Along symmetric directions the ghost points below the origin are skipped
+ * and all other points are weighted by their mirror images.
+ *
+ * @param grid grid to reduce
+ * @param region region to reduce
+ * @param members grid functions to reduce
+ * @param results partial results to add to, one per member
+ * @param mirror per direction: ghost point j mirrors point mirror[j] - j,
+ *        0 if the direction isn't symmetric, NULL for no symmetry at all
+ * @param ghosts number of ghost points below the origin
+ */
+template<typename CELL_TYPE, typename GRID_TYPE, int DIM>
+void reduceRegion(const GRID_TYPE& grid, const LibGeoDecomp::Region<DIM>& region,
+				  const std::vector<CCTK_REAL CELL_TYPE::*>& members,
+				  std::vector<ReductionResult>& results,
+				  const int *mirror = 0, int ghosts = 0)
+{
+	std::vector<LibGeoDecomp::Streak<DIM> > streaks;
+
+	for (typename LibGeoDecomp::Region<DIM>::StreakIterator s = region.beginStreak();
+		 s != region.endStreak(); ++s)
+		streaks.push_back(*s);
+	results.resize(members.size());
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+	{
+		std::vector<ReductionResult> partial(members.size());
+		std::vector<CCTK_REAL> values;
+		long i;
+		unsigned v, j;
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic) nowait
+#endif
+		for (i = 0; i < static_cast<long>(streaks.size()); ++i) {
+			LibGeoDecomp::Region<DIM> streak;
+			double weight = 1;
+			int d, x;
+
+			// y and z are the same for the whole streak
+			for (d = 1; mirror && d < DIM; ++d) {
+				if (!mirror[d])
+					continue;
+				if (streaks[i].origin[d] < ghosts)
+					weight = 0;
+				else if (2 * streaks[i].origin[d] != mirror[d])
+					weight *= 2;
+			}
+			if (weight == 0)
+				continue;
+
+			streak << streaks[i];
+			values.resize(streaks[i].length());
+			for (v = 0; v < members.size(); ++v) {
+				grid.saveMember(&values[0], LibGeoDecomp::Selector<CELL_TYPE>(members[v], "reduction"), streak);
+				for (j = 0; j < values.size(); ++j) {
+					if (!mirror || !mirror[0]) {
+						partial[v].add(values[j], weight);
+						continue;
+					}
+					x = streaks[i].origin[0] + j;
+					if (x >= ghosts)
+						partial[v].add(values[j], 2 * x == mirror[0] ? weight : 2 * weight);
+				}
+			}
+		}
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+		for (v = 0; v < members.size(); ++v)
+			results[v].combine(partial[v]);
+	}
+}
+
+/**
+ * Steerer which reduces grid functions of the cell into grid scalars
+ * of the static data class.
+ *
+ * Example usage (generated into main.cpp):
+ *   CctkReducer<Cell> *reducer = new CctkReducer<Cell>(parser.reductionEvery(), true,
+ *                                                      mirror, GHOSTZONEWIDTH);
+ *   reducer->addVariable("phi", &Cell::var_phi);
+ *   reducer->addTarget("phi_norm", &Cell::staticData.phi_norm);
+ *   reducer->setup(parser.reductions());
+ *   sim.addSteerer(reducer);
+ *
+ */
+template<typename CELL_TYPE>
+class CctkReducer : public LibGeoDecomp::Steerer<CELL_TYPE>
+{
+public:
+	typedef LibGeoDecomp::Steerer<CELL_TYPE> ParentType;
+	typedef typename ParentType::GridType GridType;
+	typedef typename ParentType::CoordType CoordType;
+	typedef typename ParentType::Topology Topology;
+	typedef CCTK_REAL CELL_TYPE::*Member;
+	static const int DIM = Topology::DIM;
+
+	/**
+	 * Constructor.
+	 *
+	 * @param period number of steps between two reductions
+	 * @param global combine results of all ranks by MPI
+	 * @param mirror per direction: ghost point j mirrors point mirror[j] - j,
+	 *        0 if the direction isn't symmetric, NULL for no symmetry at all
+	 * @param ghosts number of ghost points below the origin
+	 */
+	CctkReducer(unsigned period, bool global, const int *mirror = 0, int ghosts = 0) :
+		ParentType(period), m_global(global), m_seconds(0), m_ghosts(ghosts)
+	{
+		int i;
+
+		for (i = 0; i < DIM; ++i)
+			m_mirror[i] = mirror ? mirror[i] : 0;
+	}
+
+	virtual ~CctkReducer()
+	{}
+
+	/**
+	 * Makes a grid function available for reductions.
+	 *
+	 * @param name name of grid function as used in the parameter file
+	 * @param member member of cell
+	 */
+	void addVariable(const std::string& name, Member member)
+	{
+		m_variables[ReductionResult::toLower(name)] = member;
+	}
+
+	/**
+	 * Makes a grid scalar available as target of reductions.
+	 *
+	 * @param name name of grid scalar as used in the parameter file
+	 * @param target pointer to the grid scalar
+	 */
+	void addTarget(const std::string& name, CCTK_REAL *target)
+	{
+		m_targets[ReductionResult::toLower(name)] = target;
+	}
+
+	/**
+	 * Parses the list of reductions. Call this after all variables
+	 * and targets are added.
+	 *
+	 * @param spec list of "operation(variable)=target"
+	 */
+	void setup(const std::string& spec)
+	{
+		std::istringstream stream(spec);
+		std::string token;
+
+		while (stream >> token) {
+			std::string::size_type open, close, assign;
+			Reduction red;
+			std::string var;
+
+			open   = token.find('(');
+			close  = token.find(')');
+			assign = token.find('=');
+			if (open == std::string::npos || close == std::string::npos || close < open)
+				throw std::invalid_argument("Malformed reduction " + token);
+
+			red.name = token.substr(0, close + 1);
+			red.op   = ReductionResult::operation(token.substr(0, open));
+			var      = ReductionResult::toLower(token.substr(open + 1, close - open - 1));
+			if (m_variables.count(var) == 0)
+				throw std::invalid_argument("Unknown grid function in reduction " + token);
+			red.var    = var;
+			red.target = 0;
+			if (assign != std::string::npos) {
+				std::string target = ReductionResult::toLower(token.substr(assign + 1));
+
+				if (m_targets.count(target) == 0)
+					throw std::invalid_argument("Unknown grid scalar in reduction " + token);
+				red.target = m_targets[target];
+			}
+			m_reductions.push_back(red);
+		}
+	}
+
+	/**
+	 * @return true if there is at least one reduction
+	 */
+	bool active() const
+	{
+		return !m_reductions.empty();
+	}
+
+	virtual void nextStep(
+		GridType *grid,
+		const LibGeoDecomp::Region<DIM>& validRegion,
+		const CoordType& globalDimensions,
+		unsigned step,
+		LibGeoDecomp::SteererEvent event,
+		std::size_t rank,
+		bool lastCall,
+		LibGeoDecomp::SteererFeedback *feedback)
+	{
+		struct timeval start, end;
+
+		if (event != LibGeoDecomp::STEERER_NEXT_STEP)
+			return;
+
+		gettimeofday(&start, NULL);
+		accumulate(*grid, validRegion);
+		gettimeofday(&end, NULL);
+		m_seconds += (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) * 1e-6;
+
+		if (lastCall)
+			finish(step, rank);
+	}
+
+private:
+	/**
+	 * One reduction out of the parameter file.
+	 *
+	 */
+	struct Reduction
+	{
+		std::string name;				/**< operation(variable) */
+		ReductionResult::Operation op;	/**< reduction operator */
+		std::string var;				/**< name of grid function */
+		CCTK_REAL *target;				/**< grid scalar to fill, may be NULL */
+	};
+
+	bool m_global;									/**< reduce over all ranks */
+	double m_seconds;								/**< time spent in current step */
+	int m_mirror[DIM];								/**< mirror per direction, 0 if not symmetric */
+	int m_ghosts;									/**< number of ghost points below the origin */
+	std::map<std::string, Member> m_variables;		/**< available grid functions */
+	std::map<std::string, CCTK_REAL *> m_targets;	/**< available grid scalars */
+	std::vector<Reduction> m_reductions;			/**< reductions to do */
+	std::map<std::string, ReductionResult> m_partial; /**< partial result per grid function */
+
+	/**
+	 * Adds the values of the given region to the partial results.
+	 * Every grid function is swept only once, regardless of the number
+	 * of reductions on it.
+	 *
+	 * @param grid grid to reduce
+	 * @param region region to reduce
+	 */
+	void accumulate(const GridType& grid, const LibGeoDecomp::Region<DIM>& region)
+	{
+		std::vector<Member> members;
+		std::vector<std::string> names;
+		std::vector<ReductionResult> results;
+		typename std::map<std::string, Member>::const_iterator it;
+		typename std::vector<Reduction>::const_iterator red;
+		unsigned v;
+
+		for (it = m_variables.begin(); it != m_variables.end(); ++it) {
+			for (red = m_reductions.begin(); red != m_reductions.end(); ++red) {
+				if (red->var == it->first) {
+					names.push_back(it->first);
+					members.push_back(it->second);
+					break;
+				}
+			}
+		}
+
+		reduceRegion(grid, region, members, results, m_mirror, m_ghosts);
+		for (v = 0; v < members.size(); ++v)
+			m_partial[names[v]].combine(results[v]);
+	}
+
+	/**
+	 * Combines the results of all ranks, fills the grid scalars and
+	 * prints the results.
+	 *
+	 * @param step current step
+	 * @param rank current rank
+	 */
+	void finish(unsigned step, std::size_t rank)
+	{
+		struct timeval start, end;
+		typename std::map<std::string, ReductionResult>::iterator it;
+		typename std::vector<Reduction>::const_iterator red;
+		std::ostringstream out;
+
+		gettimeofday(&start, NULL);
+		if (m_global)
+			for (it = m_partial.begin(); it != m_partial.end(); ++it)
+				it->second.allReduce();
+		gettimeofday(&end, NULL);
+		m_seconds += (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) * 1e-6;
+
+		out << "Reductions at step " << step << ":";
+		for (red = m_reductions.begin(); red != m_reductions.end(); ++red) {
+			double value = m_partial[red->var].value(red->op);
+
+			if (red->target)
+				*red->target = value;
+			out << " " << red->name << " = " << std::setprecision(10) << value;
+		}
+		out << " (" << std::fixed << std::setprecision(3) << m_seconds * 1e3 << " ms)";
+		if (rank == 0)
+			std::cout << out.str() << std::endl;
+
+		m_partial.clear();
+		m_seconds = 0;
+	}
+};
+
+/**
+ * Adapts cctk_delta_time to the maximum of the characteristic speed, which
+ * is given by a grid function of the cell. This is the dynamic version of
+ * the courant_speed method of CactusBase/Time:
+ *
+ *   dt = courant_fac * min(dx^i) / max|speed| / sqrt(dim)
+ *
+ * The initial time step is computed by ParParser out of the static
+ * time::courant_wave_speed and kept as reference to count the steps saved.
+ * It is not a steerer itself but called by CctkSteerer, which advances
+ * cctk_time. In ensemble mode all members share the time step, so the
+ * maximum is taken over the speeds of all members (speed, speed_e1, ...).
+ *
+ * Example usage (generated into main.cpp):
+ *   AdaptiveTimeStep<Cell> *adaptive = new AdaptiveTimeStep<Cell>(
+ *       cctkGH, parser.courantFac(), parser.courantEvery(), true);
+ *   adaptive->addVariable("speed", &Cell::var_speed);
+ *   adaptive->setup(parser.courantSpeedVariable());
+ *
+ */
+template<typename CELL_TYPE>
+class AdaptiveTimeStep
+{
+public:
+	typedef CCTK_REAL CELL_TYPE::*Member;
+
+	/**
+	 * Constructor.
+	 *
+	 * @param cctkGH cactus grid hierarchy, cctk_delta_time has to be set up
+	 * @param courantFac courant factor
+	 * @param period number of steps between two updates of the time step
+	 * @param global combine results of all ranks by MPI
+	 * @param ghostZoneWidth steps between two halo exchanges, the period is
+	 *        rounded up to a multiple of it, so the time step only changes
+	 *        when all ranks are synchronized
+	 */
+	AdaptiveTimeStep(CactusGrid *cctkGH, CCTK_REAL courantFac, unsigned period, bool global,
+					 unsigned ghostZoneWidth = 1) :
+		m_cctkGH(cctkGH), m_courantFac(courantFac), m_period(period ? period : 1),
+		m_global(global), m_staticDeltaTime(cctkGH->cctk_delta_time())
+	{
+		if (ghostZoneWidth > 1)
+			m_period = (m_period + ghostZoneWidth - 1) / ghostZoneWidth * ghostZoneWidth;
+	}
+
+	/**
+	 * @return number of steps between two updates of the time step
+	 */
+	unsigned period() const
+	{
+		return m_period;
+	}
+
+	/**
+	 * Makes a grid function available as characteristic speed.
+	 *
+	 * @param name name of grid function as used in the parameter file
+	 * @param member member of cell
+	 */
+	void addVariable(const std::string& name, Member member)
+	{
+		m_variables[ReductionResult::toLower(name)] = member;
+	}
+
+	/**
+	 * Selects the grid function holding the characteristic speed, together
+	 * with its copies of the other ensemble members (name_e1, name_e2, ...).
+	 * Call this after all variables are added.
+	 *
+	 * @param name name of grid function
+	 */
+	void setup(const std::string& name)
+	{
+		std::string var = ReductionResult::toLower(name);
+		int member;
+
+		if (m_variables.count(var) == 0)
+			throw std::invalid_argument("Unknown grid function " + name + " for courant speed");
+		m_speeds.assign(1, m_variables[var]);
+
+		for (member = 1; ; ++member) {
+			std::ostringstream ensembleVar;
+
+			ensembleVar << var << "_e" << member;
+			if (m_variables.count(ensembleVar.str()) == 0)
+				break;
+			m_speeds.push_back(m_variables[ensembleVar.str()]);
+		}
+	}
+
+	/**
+	 * Reduces the speed of the given region and updates cctk_delta_time
+	 * with the last call of a step. Call this once per step and region.
+	 *
+	 * @param grid current grid
+	 * @param region region of grid owned by this rank
+	 * @param step current step
+	 * @param rank current rank
+	 * @param lastCall true for the last region of this step
+	 */
+	template<typename GRID_TYPE, int DIM>
+	void update(const GRID_TYPE& grid, const LibGeoDecomp::Region<DIM>& region,
+				unsigned step, std::size_t rank, bool lastCall)
+	{
+		std::vector<ReductionResult> results;
+		CCTK_REAL speed, dt, saved;
+		std::size_t i;
+
+		if (m_speeds.empty() || step % m_period != 0)
+			return;
+
+		reduceRegion(grid, region, m_speeds, results);
+		for (i = 0; i < results.size(); ++i)
+			m_partial.combine(results[i]);
+		if (!lastCall)
+			return;
+
+		if (m_global)
+			m_partial.allReduce();
+		speed     = m_partial.value(ReductionResult::NORM_INF);
+		m_partial = ReductionResult();
+		// keep the last time step, if nothing moves
+		if (speed <= 0)
+			return;
+
+		dt = m_courantFac * m_cctkGH->min_cctk_delta_space() / speed /
+			std::sqrt(static_cast<CCTK_REAL>(m_cctkGH->cctk_dim()));
+		m_cctkGH->cctk_delta_time(dt);
+
+		// steps the static time step would have needed for the same time
+		saved = m_cctkGH->cctk_time() / m_staticDeltaTime - m_cctkGH->cctk_iteration();
+		if (rank == 0) {
+			std::ostringstream out;
+
+			out << "Adaptive time step at iteration " << m_cctkGH->cctk_iteration()
+				<< ": max speed " << speed << ", dt " << dt
+				<< " (static " << m_staticDeltaTime << "), steps saved "
+				<< std::fixed << std::setprecision(1) << saved;
+			std::cout << out.str() << std::endl;
+		}
+	}
+
+private:
+	CactusGrid *m_cctkGH;						/**< cactus grid hierarchy to update */
+	CCTK_REAL m_courantFac;						/**< courant factor */
+	unsigned m_period;							/**< steps between two updates */
+	bool m_global;								/**< reduce over all ranks */
+	std::vector<Member> m_speeds;				/**< grid functions holding the speed */
+	CCTK_REAL m_staticDeltaTime;				/**< initial time step */
+	ReductionResult m_partial;					/**< partial result of current step */
+	std::map<std::string, Member> m_variables;	/**< available grid functions */
+};
+
+#endif /* _CCTKREDUCER_H_ */
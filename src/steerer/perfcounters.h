@@ -0,0 +1,474 @@
+#ifndef _PERFCOUNTERS_H_
+#define _PERFCOUNTERS_H_
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <sys/time.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+#include <libgeodecomp.h>
+#include <libgeodecomp/io/steerer.h>
+
+/**
+ * @file   perfcounters.h
+ *
+ * @brief Hardware performance counters per step and per evol function.
+ *
+ * Every thread calling updateLineX opens its own counters for cycles,
+ * instructions and last level cache misses by perf_event_open() and
+ * registers them. PerfSteerer sums the counters of all threads before
+ * every step, so the difference to the last sum is the cost of one step.
+ * With perf_counters = 2 every evol function call in updateLineX is
+ * wrapped into a PerfScope, which adds the difference of the thread's
+ * counters to the totals of the function. This costs a few system calls
+ * per line, so the timing of level 2 isn't representative.
+ *
+ * The memory traffic is estimated as LLC misses * CACHELINE bytes, the
+ * memory controller counters are not available by perf_event_open()
+ * without knowing the uncore PMU of the machine.
+ *
+ * If the counters cannot be opened (e.g. perf_event_paranoid, no PMU in
+ * a virtual machine), everything still works and only the time per step
+ * is printed.
+ *
+ */
+class PerfCounters
+{
+public:
+	enum Event {
+		CYCLES, INSTRUCTIONS, LLC_MISSES, EVENTS
+	};
+
+	static const int MAX_THREADS   = 256;	/**< threads registered at most */
+	static const int MAX_FUNCTIONS = 64;	/**< evol functions at most */
+	static const int CACHELINE     = 64;	/**< bytes per LLC miss */
+
+	typedef unsigned long long Values[EVENTS];
+
+	/**
+	 * Opens the counters of the calling thread.
+	 *
+	 */
+	PerfCounters()
+	{
+		static const unsigned long long configs[EVENTS] = {
+#ifdef __linux__
+			PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES
+#else
+			0, 0, 0
+#endif
+		};
+		int e;
+
+		for (e = 0; e < EVENTS; ++e)
+			m_fd[e] = open(configs[e]);
+	}
+
+	~PerfCounters()
+	{
+		int e;
+
+		for (e = 0; e < EVENTS; ++e)
+			if (m_fd[e] >= 0)
+				close(m_fd[e]);
+	}
+
+	/**
+	 * @return true if all counters are available
+	 */
+	bool available() const
+	{
+		return m_fd[CYCLES] >= 0 && m_fd[INSTRUCTIONS] >= 0 && m_fd[LLC_MISSES] >= 0;
+	}
+
+	/**
+	 * Reads the counters, unavailable ones are 0.
+	 *
+	 * @param values current values
+	 */
+	void read(Values values) const
+	{
+		int e;
+
+		for (e = 0; e < EVENTS; ++e) {
+			values[e] = 0;
+			if (m_fd[e] >= 0 &&
+				::read(m_fd[e], &values[e], sizeof(values[e])) != sizeof(values[e]))
+				values[e] = 0;
+		}
+	}
+
+	/**
+	 * Counters of the calling thread, opened and registered on the
+	 * first call. Cheap afterwards, so updateLineX calls it every line.
+	 *
+	 * @return counters of the calling thread
+	 */
+	static PerfCounters *thread()
+	{
+		static __thread PerfCounters *counters = 0;
+
+		if (!counters) {
+			Registry& reg = registry();
+			int slot;
+
+			counters = new PerfCounters();
+			slot     = __sync_fetch_and_add(&reg.threads, 1);
+			if (slot < MAX_THREADS)
+				reg.counters[slot] = counters;
+		}
+		return counters;
+	}
+
+	/**
+	 * Sums the counters of all registered threads.
+	 *
+	 * @param values sum
+	 */
+	static void sum(Values values)
+	{
+		Registry& reg = registry();
+		int t, e, threads;
+
+		threads = std::min(static_cast<int>(reg.threads), static_cast<int>(MAX_THREADS));
+		for (e = 0; e < EVENTS; ++e)
+			values[e] = 0;
+		for (t = 0; t < threads; ++t) {
+			Values thread;
+
+			// slot is taken, but the pointer not yet stored
+			if (!reg.counters[t])
+				continue;
+			reg.counters[t]->read(thread);
+			for (e = 0; e < EVENTS; ++e)
+				values[e] += thread[e];
+		}
+	}
+
+	/**
+	 * @return errno of the first counter that couldn't be opened, 0 if all are open
+	 */
+	static int error()
+	{
+		return registry().error;
+	}
+
+	/**
+	 * Adds the counts of one call of an evol function.
+	 *
+	 * @param func index of function
+	 * @param name name of function
+	 * @param delta counts of the call
+	 */
+	static void addFunction(int func, const char *name, const Values delta)
+	{
+		Registry& reg = registry();
+		int e;
+
+		if (func >= MAX_FUNCTIONS)
+			return;
+		reg.names[func] = name;
+		for (e = 0; e < EVENTS; ++e)
+			__sync_fetch_and_add(&reg.functions[func][e], delta[e]);
+	}
+
+	/**
+	 * Gets the totals of an evol function.
+	 *
+	 * @param func index of function
+	 * @param values totals
+	 *
+	 * @return name of function, 0 if it was never called
+	 */
+	static const char *function(int func, Values values)
+	{
+		Registry& reg = registry();
+		int e;
+
+		for (e = 0; e < EVENTS; ++e)
+			values[e] = reg.functions[func][e];
+		return reg.names[func];
+	}
+
+	/**
+	 * Clears the totals of the evol functions, e.g. after updates
+	 * which don't belong to the simulation.
+	 *
+	 */
+	static void resetFunctions()
+	{
+		Registry& reg = registry();
+		int func, e;
+
+		for (func = 0; func < MAX_FUNCTIONS; ++func)
+			for (e = 0; e < EVENTS; ++e)
+				reg.functions[func][e] = 0;
+	}
+
+private:
+	/**
+	 * Registered threads and totals of the evol functions.
+	 *
+	 */
+	struct Registry
+	{
+		int threads;								/**< threads registered */
+		PerfCounters *counters[MAX_THREADS];		/**< counters per thread */
+		int error;									/**< errno of first failed open */
+		const char *names[MAX_FUNCTIONS];			/**< names of evol functions */
+		Values functions[MAX_FUNCTIONS];			/**< totals per evol function */
+	};
+
+	int m_fd[EVENTS];			/**< file descriptor per counter, -1 if unavailable */
+
+	static Registry& registry()
+	{
+		// zero initialized
+		static Registry reg;
+
+		return reg;
+	}
+
+	/**
+	 * Opens one counter for the calling thread, user space only.
+	 *
+	 * @param config event
+	 *
+	 * @return file descriptor, -1 on failure
+	 */
+	static int open(unsigned long long config)
+	{
+#ifdef __linux__
+		struct perf_event_attr attr;
+		int fd;
+
+		std::memset(&attr, 0, sizeof(attr));
+		attr.type           = PERF_TYPE_HARDWARE;
+		attr.size           = sizeof(attr);
+		attr.config         = config;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv     = 1;
+		fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		if (fd < 0)
+			__sync_bool_compare_and_swap(&registry().error, 0, errno);
+		return fd;
+#else
+		(void)config;
+		__sync_bool_compare_and_swap(&registry().error, 0, ENOSYS);
+		return -1;
+#endif
+	}
+};
+
+/**
+ * Counts one call of an evol function, from construction to destruction.
+ *
+ */
+class PerfScope
+{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param func index of function
+	 * @param name name of function
+	 */
+	PerfScope(int func, const char *name) :
+		m_func(func), m_name(name), m_counters(PerfCounters::thread())
+	{
+		m_counters->read(m_start);
+	}
+
+	~PerfScope()
+	{
+		PerfCounters::Values end;
+		int e;
+
+		m_counters->read(end);
+		for (e = 0; e < PerfCounters::EVENTS; ++e)
+			end[e] -= m_start[e];
+		PerfCounters::addFunction(m_func, m_name, end);
+	}
+
+private:
+	int m_func;							/**< index of function */
+	const char *m_name;					/**< name of function */
+	PerfCounters *m_counters;			/**< counters of calling thread */
+	PerfCounters::Values m_start;		/**< values at construction */
+};
+
+/**
+ * Steerer which samples the counters of all threads before every step
+ * and prints the totals and derived metrics (IPC, LLC misses and bytes
+ * per cell, bandwidth) at the end. The time before the first step
+ * (initialization) is not counted. Only rank 0 prints, the numbers are
+ * the ones of rank 0.
+ *
+ */
+template<typename CELL_TYPE>
+class PerfSteerer : public LibGeoDecomp::Steerer<CELL_TYPE>
+{
+public:
+	typedef LibGeoDecomp::Steerer<CELL_TYPE> ParentType;
+	typedef typename ParentType::GridType GridType;
+	typedef typename ParentType::CoordType CoordType;
+	typedef typename ParentType::Topology Topology;
+	static const int DIM = Topology::DIM;
+
+	PerfSteerer() :
+		ParentType(1), m_started(false), m_printed(false), m_rank(0), m_steps(0),
+		m_cells(0), m_stepCells(0), m_seconds(0), m_minIPC(0), m_maxIPC(0)
+	{
+		int e;
+
+		for (e = 0; e < PerfCounters::EVENTS; ++e)
+			m_total[e] = 0;
+		// the counters of the main thread also tell whether
+		// the counters of the other threads can be opened
+		m_available = PerfCounters::thread()->available();
+	}
+
+	/**
+	 * Prints the summary, if the simulator didn't send STEERER_ALL_DONE.
+	 *
+	 */
+	virtual ~PerfSteerer()
+	{
+		if (m_rank == 0)
+			print(std::cout);
+	}
+
+	virtual void nextStep(
+		GridType *grid,
+		const LibGeoDecomp::Region<DIM>& validRegion,
+		const CoordType& globalDimensions,
+		unsigned step,
+		LibGeoDecomp::SteererEvent event,
+		std::size_t rank,
+		bool lastCall,
+		LibGeoDecomp::SteererFeedback *feedback)
+	{
+		m_rank       = rank;
+		m_stepCells += validRegion.size();
+		if (!lastCall)
+			return;
+
+		sample();
+		if (event == LibGeoDecomp::STEERER_ALL_DONE && rank == 0)
+			print(std::cout);
+	}
+
+private:
+	bool m_started;						/**< first step has started */
+	bool m_printed;						/**< summary is printed */
+	bool m_available;					/**< counters can be read */
+	std::size_t m_rank;					/**< rank of this process */
+	unsigned m_steps;					/**< steps measured */
+	double m_cells;						/**< cells updated in all steps */
+	double m_stepCells;					/**< cells of current step */
+	double m_seconds;					/**< time of all steps */
+	double m_minIPC;					/**< lowest IPC of a step */
+	double m_maxIPC;					/**< highest IPC of a step */
+	struct timeval m_lastTime;			/**< time of last sample */
+	PerfCounters::Values m_last;		/**< counters at last sample */
+	PerfCounters::Values m_total;		/**< counts of all steps */
+
+	/**
+	 * Adds the counts since the last sample as one step.
+	 *
+	 */
+	void sample()
+	{
+		PerfCounters::Values now;
+		struct timeval time;
+		double ipc;
+		int e;
+
+		PerfCounters::sum(now);
+		gettimeofday(&time, NULL);
+		if (m_started) {
+			for (e = 0; e < PerfCounters::EVENTS; ++e)
+				m_total[e] += now[e] - m_last[e];
+			m_seconds += (time.tv_sec - m_lastTime.tv_sec) +
+				(time.tv_usec - m_lastTime.tv_usec) * 1e-6;
+			m_cells   += m_stepCells;
+
+			ipc = now[PerfCounters::CYCLES] > m_last[PerfCounters::CYCLES] ?
+				static_cast<double>(now[PerfCounters::INSTRUCTIONS] - m_last[PerfCounters::INSTRUCTIONS]) /
+				(now[PerfCounters::CYCLES] - m_last[PerfCounters::CYCLES]) : 0;
+			m_minIPC = m_steps ? std::min(m_minIPC, ipc) : ipc;
+			m_maxIPC = m_steps ? std::max(m_maxIPC, ipc) : ipc;
+			++m_steps;
+		}
+		for (e = 0; e < PerfCounters::EVENTS; ++e)
+			m_last[e] = now[e];
+		m_lastTime  = time;
+		m_stepCells = 0;
+		m_started   = true;
+	}
+
+	/**
+	 * Prints the summary.
+	 *
+	 * @param out stream to print to
+	 */
+	void print(std::ostream& out)
+	{
+		std::ostringstream str;
+		double cycles, instructions, misses, bytes;
+		int func;
+
+		if (m_printed || !m_steps)
+			return;
+		m_printed = true;
+
+		cycles       = m_total[PerfCounters::CYCLES];
+		instructions = m_total[PerfCounters::INSTRUCTIONS];
+		misses       = m_total[PerfCounters::LLC_MISSES];
+		bytes        = misses * PerfCounters::CACHELINE;
+
+		str << std::setprecision(3)
+			<< "Hardware counters (" << m_steps << " steps, "
+			<< m_cells / m_steps << " cells per step):\n"
+			<< "  time              : " << m_seconds / m_steps * 1e3 << " ms per step, "
+			<< m_cells / m_seconds * 1e-6 << " MLUPS\n";
+		if (!m_available) {
+			str << "  counters unavailable (" << std::strerror(PerfCounters::error())
+				<< "), only the time is measured\n";
+			out << str.str() << std::flush;
+			return;
+		}
+		str << "  cycles            : " << cycles / m_steps << " per step\n"
+			<< "  instructions      : " << instructions / m_steps << " per step\n"
+			<< "  IPC               : " << (cycles ? instructions / cycles : 0)
+			<< " (min " << m_minIPC << ", max " << m_maxIPC << " per step)\n"
+			<< "  LLC misses        : " << misses / m_cells << " per cell\n"
+			<< "  memory traffic    : " << bytes / m_cells << " bytes/cell, "
+			<< bytes / m_seconds * 1e-9 << " GB/s\n";
+
+		for (func = 0; func < PerfCounters::MAX_FUNCTIONS; ++func) {
+			PerfCounters::Values values;
+			const char *name = PerfCounters::function(func, values);
+
+			if (!name)
+				continue;
+			str << "  " << std::left << std::setw(18) << name << std::right << ": IPC "
+				<< (values[PerfCounters::CYCLES] ?
+					static_cast<double>(values[PerfCounters::INSTRUCTIONS]) / values[PerfCounters::CYCLES] : 0)
+				<< ", " << static_cast<double>(values[PerfCounters::LLC_MISSES]) *
+				PerfCounters::CACHELINE / m_cells << " bytes/cell, "
+				<< (cycles ? 100.0 * values[PerfCounters::CYCLES] / cycles : 0) << " % of cycles\n";
+		}
+		out << str.str() << std::flush;
+	}
+};
+
+#endif /* _PERFCOUNTERS_H_ */
@@ -0,0 +1,295 @@
+#ifndef _ROOFLINE_H_
+#define _ROOFLINE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <unistd.h>
+#include <sys/time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <libgeodecomp.h>
+#include <libgeodecomp/io/steerer.h>
+
+/**
+ * @file   roofline.h
+ *
+ * @brief Compares the achieved MLUPS with the roofline bound.
+ *
+ * At construction two short probes measure what one rank can get out of
+ * the hardware with the compiler flags of the application:
+ *  - bandwidth: STREAM triad a = b + s * c on arrays larger than the LLC
+ *  - peak:      independent multiply-adds on an array in L1
+ * All ranks run the probes at about the same time, so the bandwidth is
+ * the share of one rank, like in the simulation. The LLC is shared by the
+ * ranks of a node (MPI_COMM_TYPE_SHARED), so the arrays are sized by the
+ * share of this rank. With OpenMP both probes run on all threads of the
+ * rank.
+ *
+ * The bound of a cell update is min(peak / flops, bandwidth / bytes). The
+ * flops per cell are counted by the generator in the loop bodies of the
+ * evol functions. The bytes per cell follow from the SoA layout: every
+ * member of the cell is streamed from the old grid and to the new grid,
+ * which is read first (write allocate), i.e. 3 * sizeof(CELL_TYPE). The
+ * triad counts its write allocate, too.
+ *
+ * The report is printed by rank 0 at the end of the simulation. The
+ * initialization is not counted, writers and steerers are.
+ *
+ */
+template<typename CELL_TYPE, typename DOUBLE>
+class RooflineReport : public LibGeoDecomp::Steerer<CELL_TYPE>
+{
+public:
+	typedef LibGeoDecomp::Steerer<CELL_TYPE> ParentType;
+	typedef typename ParentType::GridType GridType;
+	typedef typename ParentType::CoordType CoordType;
+	typedef typename ParentType::Topology Topology;
+	static const int DIM = Topology::DIM;
+
+	/**
+	 * Constructor. Runs the probes, which takes about a second. MPI has
+	 * to be initialized, if it is used.
+	 *
+	 * @param flops floating point operations per cell update, 0 if unknown
+	 */
+	RooflineReport(double flops) :
+		ParentType(1), m_flops(flops), m_bytes(3.0 * sizeof(CELL_TYPE)),
+		m_started(false), m_printed(false), m_rank(0), m_cells(0), m_seconds(0)
+	{
+		m_ranksPerNode = ranksPerNode();
+		m_threads      = threads();
+		m_bandwidth    = probeBandwidth(m_ranksPerNode);
+		m_peak         = probePeak();
+	}
+
+	/**
+	 * Prints the report, if the simulator didn't send STEERER_ALL_DONE.
+	 *
+	 */
+	virtual ~RooflineReport()
+	{
+		if (m_rank == 0)
+			print(std::cout);
+	}
+
+	virtual void nextStep(
+		GridType *grid,
+		const LibGeoDecomp::Region<DIM>& validRegion,
+		const CoordType& globalDimensions,
+		unsigned step,
+		LibGeoDecomp::SteererEvent event,
+		std::size_t rank,
+		bool lastCall,
+		LibGeoDecomp::SteererFeedback *feedback)
+	{
+		struct timeval now;
+
+		m_rank = rank;
+		// the first call comes before the first step
+		if (m_started)
+			m_cells += validRegion.size();
+		if (!lastCall)
+			return;
+
+		gettimeofday(&now, NULL);
+		if (m_started)
+			m_seconds += (now.tv_sec - m_start.tv_sec) + (now.tv_usec - m_start.tv_usec) * 1e-6;
+		m_start   = now;
+		m_started = true;
+
+		if (event == LibGeoDecomp::STEERER_ALL_DONE && rank == 0)
+			print(std::cout);
+	}
+
+private:
+	double m_flops;						/**< flops per cell update */
+	double m_bytes;						/**< bytes per cell update */
+	double m_bandwidth;					/**< bytes/s of triad probe */
+	double m_peak;						/**< flops/s of peak probe */
+	unsigned m_ranksPerNode;			/**< ranks sharing the LLC */
+	unsigned m_threads;					/**< threads per rank */
+	bool m_started;						/**< first step has started */
+	bool m_printed;						/**< report is printed */
+	std::size_t m_rank;					/**< rank of this process */
+	double m_cells;						/**< cells updated */
+	double m_seconds;					/**< time of all steps */
+	struct timeval m_start;				/**< start of current step */
+
+	static double seconds()
+	{
+		struct timeval time;
+
+		gettimeofday(&time, NULL);
+		return time.tv_sec + time.tv_usec * 1e-6;
+	}
+
+	/**
+	 * @return number of ranks on the node of this rank, 1 without MPI
+	 */
+	static unsigned ranksPerNode()
+	{
+		int ranks = 1;
+#ifdef LIBGEODECOMP_WITH_MPI
+		MPI_Comm node;
+		int initialized;
+
+		MPI_Initialized(&initialized);
+		if (initialized) {
+			MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node);
+			MPI_Comm_size(node, &ranks);
+			MPI_Comm_free(&node);
+		}
+#endif
+		return ranks > 0 ? ranks : 1;
+	}
+
+	/**
+	 * @return number of threads of this rank, 1 without OpenMP
+	 */
+	static unsigned threads()
+	{
+#ifdef _OPENMP
+		return omp_get_max_threads();
+#else
+		return 1;
+#endif
+	}
+
+	/**
+	 * Measures the triad bandwidth, best of five runs.
+	 *
+	 * @param ranks number of ranks sharing the LLC
+	 *
+	 * @return bytes/s including write allocate
+	 */
+	static double probeBandwidth(unsigned ranks)
+	{
+		const std::size_t minBytes = 8 * 1024 * 1024;
+		const DOUBLE scalar = 3;
+		std::size_t llc = 0, bytes, n;
+		long i, end;
+		double best = 0;
+		int run;
+
+#ifdef _SC_LEVEL3_CACHE_SIZE
+		if (sysconf(_SC_LEVEL3_CACHE_SIZE) > 0)
+			llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+		if (!llc)
+			llc = 32 * 1024 * 1024;
+		// each array four times the share of the LLC of this rank
+		bytes = std::max(4 * llc / ranks, minBytes);
+		n     = bytes / sizeof(DOUBLE);
+
+		std::vector<DOUBLE> a(n, 0), b(n, 1), c(n, 2);
+		end = n;
+		for (run = 0; run < 5; ++run) {
+			double start = seconds(), time;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+			for (i = 0; i < end; ++i)
+				a[i] = b[i] + scalar * c[i];
+			time = seconds() - start;
+			if (time > 0)
+				best = std::max(best, 4.0 * n * sizeof(DOUBLE) / time);
+			// keeps the runs from being merged
+			std::swap(a, b);
+		}
+
+		return best;
+	}
+
+	/**
+	 * Measures the peak of all threads, each running probePeakThread().
+	 *
+	 * @return flops/s
+	 */
+	static double probePeak()
+	{
+		double peak = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel reduction(+:peak)
+#endif
+		peak += probePeakThread();
+
+		return peak;
+	}
+
+	/**
+	 * Measures the peak of independent multiply-adds, which the compiler
+	 * vectorizes and contracts as far as the flags of the application allow.
+	 *
+	 * @return flops/s of the calling thread
+	 */
+	static double probePeakThread()
+	{
+		const int lanes   = 128;
+		const int repeats = 1 << 18;
+		const DOUBLE factor = 0.999999, summand = 1e-6;
+		// volatile, so the loop cannot be computed at compile time
+		volatile DOUBLE init = 1;
+		DOUBLE x[lanes], sum = 0;
+		double start, time;
+		int i, j;
+
+		for (j = 0; j < lanes; ++j)
+			x[j] = init + j * 1e-3;
+		start = seconds();
+		for (i = 0; i < repeats; ++i)
+			for (j = 0; j < lanes; ++j)
+				x[j] = x[j] * factor + summand;
+		time = seconds() - start;
+		for (j = 0; j < lanes; ++j)
+			sum += x[j];
+		init = sum;
+
+		return time > 0 ? 2.0 * lanes * repeats / time : 0;
+	}
+
+	/**
+	 * Prints the report.
+	 *
+	 * @param out stream to print to
+	 */
+	void print(std::ostream& out)
+	{
+		std::ostringstream str;
+		double memoryBound, computeBound, bound, achieved;
+
+		if (m_printed || m_seconds <= 0 || m_bandwidth <= 0)
+			return;
+		m_printed = true;
+
+		memoryBound  = m_bandwidth / m_bytes;
+		computeBound = m_flops > 0 ? m_peak / m_flops : 0;
+		bound        = computeBound > 0 ? std::min(memoryBound, computeBound) : memoryBound;
+		achieved     = m_cells / m_seconds;
+
+		str << std::fixed << std::setprecision(2)
+			<< "Roofline (rank 0, " << m_ranksPerNode << " rank(s) per node, "
+			<< m_threads << " thread(s) per rank):\n"
+			<< "  bandwidth probe   : " << m_bandwidth * 1e-9 << " GB/s (triad)\n"
+			<< "  peak probe        : " << m_peak * 1e-9 << " GFLOP/s\n"
+			<< "  per cell          : ";
+		if (m_flops > 0)
+			str << m_flops << " flops, " << m_bytes << " bytes ("
+				<< m_flops / m_bytes << " flops/byte)\n";
+		else
+			str << "flops unknown, " << m_bytes << " bytes\n";
+		str << "  bound             : " << bound * 1e-6 << " MLUPS ("
+			<< (bound == computeBound ? "compute" : "memory") << " bound)\n"
+			<< "  achieved          : " << achieved * 1e-6 << " MLUPS, "
+			<< 100.0 * achieved / bound << " % of the bound\n";
+		out << str.str() << std::flush;
+	}
+};
+
+#endif /* _ROOFLINE_H_ */
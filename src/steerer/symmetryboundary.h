@@ -0,0 +1,188 @@
+#ifndef _SYMMETRYBOUNDARY_H_
+#define _SYMMETRYBOUNDARY_H_
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <libgeodecomp.h>
+#include <libgeodecomp/io/steerer.h>
+
+/**
+ * @file   symmetryboundary.h
+ *
+ * @brief Steerer which fills the ghost points below the origin of
+ * bitant, quadrant and octant domains by reflection.
+ *
+ * For symmetric domains ParParser keeps only the upper half of each
+ * symmetric direction plus GHOSTZONEWIDTH ghost points below the origin
+ * (see ParParser::setupSymmetry()). Before every step the ghost point j
+ * of such a direction gets a copy of the whole cell at mirror - j, which
+ * is an even parity reflection of all grid functions and timelevels.
+ * Grid functions with odd parity (e.g. the normal component of a vector)
+ * are not supported.
+ *
+ * In the MPI application every rank reflects the ghost points of its own
+ * region, so the mirror points have to belong to the same rank. This
+ * holds as long as the subdomains at the symmetry planes are at least
+ * mirror + 1 points thick. The partition is checked by all ranks on the
+ * first call, which comes before the first update, and the simulation
+ * stops with an error if it doesn't hold. A load balancer could move the
+ * subdomain boundaries later, so the generated main doesn't allow load
+ * balancing for symmetric domains.
+ *
+ */
+template<typename CELL_TYPE>
+class SymmetryBoundary : public LibGeoDecomp::Steerer<CELL_TYPE>
+{
+public:
+	typedef LibGeoDecomp::Steerer<CELL_TYPE> ParentType;
+	typedef typename ParentType::GridType GridType;
+	typedef typename ParentType::CoordType CoordType;
+	typedef typename ParentType::Topology Topology;
+	static const int DIM = Topology::DIM;
+
+	/**
+	 * Constructor.
+	 *
+	 * @param mirror per direction: ghost point j mirrors point mirror[j] - j,
+	 *        0 if the direction isn't symmetric
+	 * @param ghosts number of ghost points below the origin
+	 */
+	SymmetryBoundary(const int *mirror, int ghosts) :
+		ParentType(1), m_ghosts(ghosts), m_checked(false), m_foreign(false)
+	{
+		int i;
+
+		for (i = 0; i < DIM; ++i)
+			m_mirror[i] = mirror[i];
+	}
+
+	virtual ~SymmetryBoundary()
+	{}
+
+	virtual void nextStep(
+		GridType *grid,
+		const LibGeoDecomp::Region<DIM>& validRegion,
+		const CoordType& globalDimensions,
+		unsigned step,
+		LibGeoDecomp::SteererEvent event,
+		std::size_t rank,
+		bool lastCall,
+		LibGeoDecomp::SteererFeedback *feedback)
+	{
+		int d;
+
+		if (event != LibGeoDecomp::STEERER_NEXT_STEP)
+			return;
+
+		if (!m_checked) {
+			for (d = 0; d < DIM; ++d)
+				if (m_mirror[d])
+					m_foreign = m_foreign || !check(validRegion, d);
+			if (lastCall) {
+				checkPartition(rank);
+				m_checked = true;
+			}
+		}
+
+		// one direction after another, so edges and corners get
+		// reflected twice or three times
+		for (d = 0; d < DIM; ++d)
+			if (m_mirror[d])
+				reflect(grid, validRegion, d);
+	}
+
+private:
+	int m_mirror[DIM];			/**< ghost point j mirrors point m_mirror - j */
+	int m_ghosts;				/**< number of ghost points below the origin */
+	bool m_checked;				/**< partition is checked */
+	bool m_foreign;				/**< a mirror point belongs to another rank */
+
+	/**
+	 * Checks whether the mirror points of all ghost points of one
+	 * direction are in the region.
+	 *
+	 * @param region region owned by this rank
+	 * @param dir direction
+	 *
+	 * @return true if all are in the region, else false
+	 */
+	bool check(const LibGeoDecomp::Region<DIM>& region, int dir) const
+	{
+		typename LibGeoDecomp::Region<DIM>::StreakIterator s;
+
+		for (s = region.beginStreak(); s != region.endStreak(); ++s) {
+			CoordType c = s->origin;
+
+			for (; c.x() < s->endX; ++c.x()) {
+				CoordType mirror = c;
+
+				if (c[dir] >= m_ghosts)
+					break;
+				mirror[dir] = m_mirror[dir] - c[dir];
+				if (!region.count(mirror))
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * Combines the checks of all ranks and stops the simulation on
+	 * every rank, if one of them failed.
+	 *
+	 * @param rank rank of this process
+	 */
+	void checkPartition(std::size_t rank) const
+	{
+		int foreign = m_foreign;
+		int d, thickness = 0;
+		std::ostringstream msg;
+
+#ifdef LIBGEODECOMP_WITH_MPI
+		MPI_Allreduce(MPI_IN_PLACE, &foreign, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+#endif
+		if (!foreign)
+			return;
+
+		for (d = 0; d < DIM; ++d)
+			thickness = std::max(thickness, m_mirror[d] + 1);
+		msg << "SymmetryBoundary: the subdomains at the symmetry planes have to be at least "
+			<< thickness << " points thick, run with fewer ranks or a larger grid";
+		if (rank == 0)
+			std::cerr << msg.str() << std::endl;
+		throw std::invalid_argument(msg.str());
+	}
+
+	/**
+	 * Reflects the ghost points of one direction. Mirror points of
+	 * other ranks only occur before the check stopped the simulation.
+	 *
+	 * @param grid grid to update
+	 * @param region region owned by this rank
+	 * @param dir direction
+	 */
+	void reflect(GridType *grid, const LibGeoDecomp::Region<DIM>& region, int dir)
+	{
+		typename LibGeoDecomp::Region<DIM>::StreakIterator s;
+
+		for (s = region.beginStreak(); s != region.endStreak(); ++s) {
+			CoordType c = s->origin;
+
+			for (; c.x() < s->endX; ++c.x()) {
+				CoordType mirror = c;
+
+				if (c[dir] >= m_ghosts)
+					break;
+				mirror[dir] = m_mirror[dir] - c[dir];
+				if (!region.count(mirror))
+					continue;
+				grid->set(c, grid->get(mirror));
+			}
+		}
+	}
+};
+
+#endif /* _SYMMETRYBOUNDARY_H_ */
@@ -47,7 +47,9 @@ CactusGrid::CactusGrid(unsigned int dim)
 
 CactusGrid::CactusGrid(const CactusGrid& other)
 {
-	*this = other;
+	m_cctk_dim = other.m_cctk_dim;
+	allocateMemory(m_cctk_dim);
+	copyData(other);
 }
 
 CactusGrid::~CactusGrid()
@@ -91,6 +93,29 @@ CactusGrid& CactusGrid::operator= (const CactusGrid& rhs)
 	return *this;
 }
 
+void CactusGrid::setLocalBox(const int *origin, const int *dimensions)
+{
+	unsigned int i;
+
+	for (i = 0; i < m_cctk_dim; ++i) {
+		int lower = origin[i];
+		int upper = origin[i] + dimensions[i] - 1;
+
+		// clip to global grid
+		if (lower < 0)
+			lower = 0;
+		if (upper > m_cctk_gsh[i] - 1)
+			upper = m_cctk_gsh[i] - 1;
+		if (upper < lower)
+			upper = lower - 1;
+
+		m_cctk_lbnd[i]         = lower;
+		m_cctk_ubnd[i]         = upper;
+		m_cctk_lsh[i]          = upper - lower + 1;
+		m_cctk_bbox[2 * i]     = lower == 0;
+		m_cctk_bbox[2 * i + 1] = upper == m_cctk_gsh[i] - 1;
+	}
+}
 
 #ifdef DEBUG
 
@@ -118,12 +143,13 @@ void CactusGrid::dumpCctkGH() const
 	PRINTPAR(cctk_iteration);
 	PRINTPARINDEX(cctk_gsh);
 	PRINTPARINDEX(cctk_lsh);
-	/*PRINTPARINDEX(cctk_lbnd);*/
-	/*PRINTPARINDEX(cctk_ubnd);*/
+	PRINTPARINDEX(cctk_lbnd);
+	PRINTPARINDEX(cctk_ubnd);
 	PRINTPAR(cctk_delta_time);
 	PRINTPARINDEX(cctk_delta_space);
 	PRINTPARINDEX(cctk_origin_space);
-	/*PRINTPARINDEX(cctk_bbox);*/
+	for (unsigned int i = 0; i < 2 * m_cctk_dim; ++i)
+		std::cout << "cctk_bbox[" << i << "]=" << m_cctk_bbox[i] << std::endl;
 	PRINTPARINDEX(cctk_levfac);
 	PRINTPARINDEX(cctk_levoff);
 	PRINTPARINDEX(cctk_levoffdenom);
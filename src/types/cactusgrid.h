@@ -70,7 +70,7 @@ private:
 			m_cctk_levoffdenom[i]  = rhs.m_cctk_levoffdenom[i];
 			m_cctk_nghostzones[i]  = rhs.m_cctk_nghostzones[i];
 		}
-		for (unsigned int i = 0; i < (2 * m_cctk_dim + 1); ++i)
+		for (unsigned int i = 0; i < 2 * m_cctk_dim; ++i)
 			m_cctk_bbox[i] = rhs.m_cctk_bbox[i];
 	}
 
@@ -352,6 +352,16 @@ public:
 		for (i = 0; i < 2 * m_cctk_dim; ++i)
 			m_cctk_bbox[i] = nsize;
 	}
+	/**
+	 * Sets up the local part of the grid hierarchy, i.e. cctk_lsh,
+	 * cctk_lbnd, cctk_ubnd and cctk_bbox, for a box given in global
+	 * coordinates. The box is clipped to the global grid, so each
+	 * rank or region only sees the points it actually owns.
+	 *
+	 * @param origin global index of the first point of the box
+	 * @param dimensions size of the box in each direction
+	 */
+	void setLocalBox(const int *origin, const int *dimensions);
 	/**
 	 * Computes the minimum of cctk_delta_space.
 	 * This is used for setting up cctk_delta_time.
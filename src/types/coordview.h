@@ -0,0 +1,67 @@
+#ifndef _COORDVIEW_H_
+#define _COORDVIEW_H_
+
+#include "cctk_Types.h"
+#include "cactusgrid.h"
+
+/**
+ * @file   coordview.h
+ *
+ * @brief This class provides the coordinates x, y, z usually set up by
+ * CartGrid3D as a lazy view on the local grid.
+ *
+ * Instead of storing one coordinate per grid point, the coordinate
+ * is computed on access by origin + delta * (lbnd + i), where i is the
+ * component of the linear grid index in the direction of the view.
+ * Thus the memory usage is O(1) instead of O(lsh[0] * lsh[1] * lsh[2]).
+ * Index layout is the same as used by CCTK_GFINDEX3D.
+ *
+ */
+class CoordView
+{
+private:
+	CCTK_REAL m_origin;			/**< coordinate of first local point */
+	CCTK_REAL m_delta;			/**< delta space in direction of view */
+	int m_stride;				/**< distance of two points in direction of view */
+	int m_size;					/**< local grid size in direction of view */
+public:
+	/**
+	 * Constructor. Creates an empty view, which has to be set up
+	 * by setup() before use.
+	 *
+	 */
+	CoordView() :
+		m_origin(0), m_delta(0), m_stride(1), m_size(1)
+	{}
+	/**
+	 * Sets up the view for the local part of the given grid hierarchy.
+	 * Call this again whenever cctk_lsh or cctk_lbnd change.
+	 *
+	 * @param cctkGH cactus grid hierarchy
+	 * @param dir direction of view (0 for x, 1 for y, ...)
+	 */
+	void setup(const CactusGrid *cctkGH, unsigned int dir)
+	{
+		unsigned int i;
+
+		m_delta  = cctkGH->cctk_delta_space()[dir];
+		m_origin = cctkGH->cctk_origin_space()[dir] + m_delta * cctkGH->cctk_lbnd()[dir];
+		m_size   = cctkGH->cctk_lsh()[dir];
+		m_stride = 1;
+		for (i = 0; i < dir; ++i)
+			m_stride *= cctkGH->cctk_lsh()[i];
+	}
+	/**
+	 * Computes the coordinate of a grid point.
+	 *
+	 * @param index linear index of grid point
+	 *
+	 * @return coordinate in direction of view
+	 */
+	inline CCTK_REAL operator[](int index) const
+	{
+		return m_origin + m_delta * ((index / m_stride) % m_size);
+	}
+};
+
+#endif /* _COORDVIEW_H_ */
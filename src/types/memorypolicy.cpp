@@ -0,0 +1,659 @@
+#include "memorypolicy.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <new>
+#include <string>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "parameter.h"			// contains MEMORYPOLICY, NUMANODE and OUTOFCOREWINDOW
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2				// see numaif.h
+#endif
+
+// dynamic exception specifications are gone since C++17
+#if __cplusplus >= 201103L
+#define THROW_BAD_ALLOC
+#define THROW_NOTHING noexcept
+#else
+#define THROW_BAD_ALLOC throw(std::bad_alloc)
+#define THROW_NOTHING throw()
+#endif
+
+namespace {
+
+const std::size_t HUGEPAGE = 2 * 1024 * 1024;
+
+/**
+ * Header in front of every block. mapped is the length of the
+ * mapping starting at the header, 0 if the block is from malloc().
+ *
+ */
+struct BlockHeader
+{
+	std::size_t mapped;
+	std::size_t pad;			// keeps the block 16 byte aligned
+};
+
+/**
+ * Statistics of the mapped blocks, updated atomically.
+ *
+ */
+struct Statistics
+{
+	std::size_t blocks;			/**< blocks mapped so far */
+	std::size_t hugetlbBytes;	/**< bytes on explicit huge pages */
+	std::size_t thpBytes;		/**< bytes advised for transparent huge pages */
+	std::size_t plainBytes;		/**< bytes on normal pages */
+	std::size_t fileBytes;		/**< bytes backed by files (out-of-core) */
+	std::size_t fileFailures;	/**< failed file mappings */
+	std::size_t peakChunks;		/**< most chunks in the window at once */
+	std::size_t evictedBytes;	/**< bytes evicted from the full window */
+	std::size_t untracked;		/**< file blocks not tracked by the window */
+	std::size_t fallbacks;		/**< failed MAP_HUGETLB mappings */
+	std::size_t bindFailures;	/**< failed mbind() calls */
+} stats;
+
+/**
+ * Reads a value in kB from a file like /proc/meminfo.
+ *
+ * @param file file to read
+ * @param key key including the colon, e.g. "Hugepagesize:"
+ *
+ * @return value, 0 if not found
+ */
+std::size_t readKiB(const char *file, const std::string& key)
+{
+	std::ifstream in(file);
+	std::string name;
+	std::size_t value;
+
+	while (in >> name) {
+		if (name == key && in >> value)
+			return value;
+		in.ignore(1024, '\n');
+	}
+	return 0;
+}
+
+/**
+ * Binds a mapping to NUMANODE. Has to be called before
+ * the mapping is touched.
+ *
+ * @param ptr start of mapping
+ * @param length length of mapping
+ */
+void bindNode(void *ptr, std::size_t length)
+{
+#if defined(SYS_mbind) && NUMANODE >= 0
+	const std::size_t bits = 8 * sizeof(unsigned long);
+	unsigned long mask[NUMANODE / bits + 1] = { 0 };
+
+	mask[NUMANODE / bits] = 1UL << (NUMANODE % bits);
+	if (syscall(SYS_mbind, ptr, length, MPOL_BIND, mask, sizeof(mask) * 8 + 1, 0) != 0)
+		__sync_fetch_and_add(&stats.bindFailures, 1);
+#else
+	(void)ptr;
+	(void)length;
+#endif
+}
+
+#ifdef OUTOFCOREDIR
+const std::size_t CHUNK     = HUGEPAGE;	/**< unit of the window */
+const int MAXFILES          = 64;		/**< file blocks tracked by the window */
+const std::size_t MAXCHUNKS = 65536;	/**< largest window in chunks (128 GiB) */
+const int SEEN              = 64;		/**< chunks cached per thread */
+
+/**
+ * A block backed by a file. The file descriptor stays open, the
+ * pages of evicted chunks are written back and dropped through it.
+ *
+ */
+struct FileBlock
+{
+	char *start;
+	std::size_t length;
+	int fd;
+};
+
+/**
+ * The window of RAM the file blocks are streamed through. chunks is a
+ * ring of the resident chunks, the oldest first. epoch is increased on
+ * every eviction, which invalidates the chunks cached by the threads.
+ *
+ */
+struct Window
+{
+	FileBlock files[MAXFILES];
+	int numFiles;
+	char *chunks[MAXCHUNKS];
+	std::size_t first;
+	std::size_t count;
+	std::size_t capacity;
+	volatile unsigned long epoch;
+} window = { {}, 0, {}, 0, 0, (OUTOFCOREWINDOW * 1024UL * 1024UL + CHUNK - 1) / CHUNK, 0 };
+
+pthread_mutex_t windowMutex = PTHREAD_MUTEX_INITIALIZER;
+char *scratch[MAXCHUNKS];		// sorted copy of the ring, used by trim()
+
+__thread const char *seen[SEEN];
+__thread unsigned long seenEpoch;
+
+/**
+ * Finds the file block containing an address.
+ *
+ * @param addr address
+ *
+ * @return file block, 0 if addr is not file backed
+ */
+FileBlock *findFile(const char *addr)
+{
+	for (int i = 0; i < window.numFiles; ++i)
+		if (addr >= window.files[i].start &&
+			addr < window.files[i].start + window.files[i].length)
+			return &window.files[i];
+	return 0;
+}
+
+/**
+ * Starts writing back a range of a file block, without waiting for it.
+ *
+ * @param file file block
+ * @param start start of range
+ * @param length length of range
+ */
+void writeBack(FileBlock *file, char *start, std::size_t length)
+{
+#ifdef SYNC_FILE_RANGE_WRITE
+	sync_file_range(file->fd, start - file->start, length, SYNC_FILE_RANGE_WRITE);
+#else
+	(void)file;
+	(void)start;
+	(void)length;
+#endif
+}
+
+/**
+ * Evicts a range of a file block from RAM. The pages are unmapped,
+ * written back if they are dirty and dropped from the page cache. The
+ * mapping is shared, so the next access reads them back from the file.
+ *
+ * @param file file block
+ * @param start start of range
+ * @param length length of range
+ */
+void evict(FileBlock *file, char *start, std::size_t length)
+{
+	off_t offset = start - file->start;
+
+	madvise(start, length, MADV_DONTNEED);
+#ifdef SYNC_FILE_RANGE_WRITE
+	sync_file_range(file->fd, offset, length, SYNC_FILE_RANGE_WAIT_BEFORE |
+					SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#else
+	fdatasync(file->fd);
+#endif
+	posix_fadvise(file->fd, offset, length, POSIX_FADV_DONTNEED);
+	++window.epoch;
+}
+
+/**
+ * Length of a chunk, the last one of a block may be shorter.
+ *
+ * @param file file block
+ * @param chunk start of chunk
+ *
+ * @return length
+ */
+std::size_t chunkLength(const FileBlock *file, const char *chunk)
+{
+	return std::min<std::size_t>(CHUNK, file->start + file->length - chunk);
+}
+
+/**
+ * Adds a chunk to the window. The oldest chunk is evicted if the window
+ * is full, the chunk half a window back is written back already, so the
+ * eviction rarely waits for the disk, and the next chunk is read ahead.
+ * Expects windowMutex to be locked.
+ *
+ * @param file file block
+ * @param chunk start of chunk
+ */
+void pushChunk(FileBlock *file, char *chunk)
+{
+	std::size_t half;
+	char *next;
+
+	while (window.count >= window.capacity) {
+		char *oldest = window.chunks[window.first];
+		FileBlock *owner = findFile(oldest);
+
+		evict(owner, oldest, chunkLength(owner, oldest));
+		stats.evictedBytes += chunkLength(owner, oldest);
+		window.first = (window.first + 1) % MAXCHUNKS;
+		--window.count;
+	}
+	window.chunks[(window.first + window.count) % MAXCHUNKS] = chunk;
+	++window.count;
+	stats.peakChunks = std::max(stats.peakChunks, window.count);
+
+	half = window.capacity / 2;
+	if (half && window.count > half) {
+		char *old = window.chunks[(window.first + window.count - 1 - half) % MAXCHUNKS];
+		FileBlock *owner = findFile(old);
+
+		writeBack(owner, old, chunkLength(owner, old));
+	}
+
+	next = chunk + CHUNK;
+	if (next < file->start + file->length)
+		madvise(next, chunkLength(file, next), MADV_WILLNEED);
+}
+
+/**
+ * Tracks a file block by the window. Blocks beyond MAXFILES stay with
+ * the page cache alone.
+ *
+ * @param start start of mapping
+ * @param length length of mapping
+ * @param fd file descriptor of the file
+ *
+ * @return true if the block is tracked, fd has to be kept open
+ */
+bool trackFile(char *start, std::size_t length, int fd)
+{
+	bool tracked = false;
+
+	pthread_mutex_lock(&windowMutex);
+	if (window.numFiles < MAXFILES) {
+		FileBlock& file = window.files[window.numFiles];
+
+		file.start   = start;
+		file.length  = length;
+		file.fd      = fd;
+		tracked      = true;
+		++window.numFiles;
+	} else {
+		++stats.untracked;
+	}
+	pthread_mutex_unlock(&windowMutex);
+	return tracked;
+}
+
+/**
+ * Stops tracking a file block, its chunks leave the window
+ * and its file is closed.
+ *
+ * @param start start of mapping
+ */
+void untrackFile(char *start)
+{
+	std::size_t i, kept;
+	FileBlock *file;
+
+	pthread_mutex_lock(&windowMutex);
+	file = findFile(start);
+	if (file) {
+		kept = 0;
+		for (i = 0; i < window.count; ++i) {
+			char *chunk = window.chunks[(window.first + i) % MAXCHUNKS];
+
+			if (chunk < file->start || chunk >= file->start + file->length)
+				window.chunks[(window.first + kept++) % MAXCHUNKS] = chunk;
+		}
+		window.count = kept;
+		close(file->fd);
+		*file = window.files[--window.numFiles];
+		++window.epoch;
+	}
+	pthread_mutex_unlock(&windowMutex);
+}
+#endif
+
+/**
+ * Maps a block backed by a file in OUTOFCOREDIR. The file is unlinked
+ * right away, so it vanishes with the mapping, and its disk blocks are
+ * reserved, so a full disk shows up here and not as SIGBUS later. The
+ * block is tracked by the window (see MemoryPolicy::advance()).
+ *
+ * @param length length of mapping
+ *
+ * @return start of mapping, MAP_FAILED on failure
+ */
+char *mapFile(std::size_t length)
+{
+#ifdef OUTOFCOREDIR
+	char path[4096];
+	char *ptr;
+	int fd;
+
+	std::snprintf(path, sizeof(path), "%s/cactus_grid_XXXXXX", OUTOFCOREDIR);
+	fd = mkstemp(path);
+	if (fd < 0) {
+		__sync_fetch_and_add(&stats.fileFailures, 1);
+		return static_cast<char *>(MAP_FAILED);
+	}
+	unlink(path);
+
+	ptr = static_cast<char *>(MAP_FAILED);
+	if (posix_fallocate(fd, 0, length) == 0)
+		ptr = static_cast<char *>(mmap(0, length, PROT_READ | PROT_WRITE,
+									   MAP_SHARED, fd, 0));
+	if (ptr == MAP_FAILED) {
+		close(fd);
+		__sync_fetch_and_add(&stats.fileFailures, 1);
+		return ptr;
+	}
+	if (!trackFile(ptr, length, fd))
+		close(fd);
+
+	// the grids are swept plane by plane
+	madvise(ptr, length, MADV_SEQUENTIAL);
+	__sync_fetch_and_add(&stats.fileBytes, length);
+	return ptr;
+#else
+	(void)length;
+	return static_cast<char *>(MAP_FAILED);
+#endif
+}
+
+/**
+ * Maps a block of at least bytes according to the policy.
+ *
+ * @param bytes size including header
+ *
+ * @return start of mapping with header set up, 0 on failure
+ */
+BlockHeader *mapBlock(std::size_t bytes)
+{
+	std::size_t length = (bytes + HUGEPAGE - 1) / HUGEPAGE * HUGEPAGE;
+	char *ptr = mapFile(length);
+	BlockHeader *block;
+
+#ifdef MAP_HUGETLB
+	if (ptr == MAP_FAILED && MEMORYPOLICY == MemoryPolicy::HUGETLB) {
+		ptr = static_cast<char *>(mmap(0, length, PROT_READ | PROT_WRITE,
+									   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0));
+		if (ptr != MAP_FAILED) {
+			__sync_fetch_and_add(&stats.hugetlbBytes, length);
+		} else {
+			__sync_fetch_and_add(&stats.fallbacks, 1);
+		}
+	}
+#endif
+	if (ptr == MAP_FAILED) {
+		char *start, *end;
+
+		// map one huge page more and trim it, so the block
+		// starts at a huge page boundary, which THP needs
+		ptr = static_cast<char *>(mmap(0, length + HUGEPAGE, PROT_READ | PROT_WRITE,
+									   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+		if (ptr == MAP_FAILED)
+			return 0;
+		start = reinterpret_cast<char *>((reinterpret_cast<std::size_t>(ptr) + HUGEPAGE - 1) /
+										 HUGEPAGE * HUGEPAGE);
+		end   = start + length;
+		if (start > ptr)
+			munmap(ptr, start - ptr);
+		munmap(end, ptr + length + HUGEPAGE - end);
+		ptr = start;
+
+#ifdef MADV_HUGEPAGE
+		if (MEMORYPOLICY != MemoryPolicy::DEFAULT &&
+			madvise(ptr, length, MADV_HUGEPAGE) == 0) {
+			__sync_fetch_and_add(&stats.thpBytes, length);
+		} else {
+			__sync_fetch_and_add(&stats.plainBytes, length);
+		}
+#else
+		__sync_fetch_and_add(&stats.plainBytes, length);
+#endif
+	}
+	bindNode(ptr, length);
+	__sync_fetch_and_add(&stats.blocks, 1);
+
+	block         = reinterpret_cast<BlockHeader *>(ptr);
+	block->mapped = length;
+	return block;
+}
+
+}
+
+void *MemoryPolicy::allocate(std::size_t size)
+{
+	std::size_t bytes  = size + sizeof(BlockHeader);
+	BlockHeader *block = 0;
+
+	if (size >= THRESHOLD)
+		block = mapBlock(bytes);
+	if (!block) {
+		block = static_cast<BlockHeader *>(std::malloc(bytes));
+		if (!block)
+			return 0;
+		block->mapped = 0;
+	}
+
+	return block + 1;
+}
+
+void MemoryPolicy::deallocate(void *ptr)
+{
+	BlockHeader *block;
+
+	if (!ptr)
+		return;
+
+	block = static_cast<BlockHeader *>(ptr) - 1;
+	if (block->mapped) {
+#ifdef OUTOFCOREDIR
+		untrackFile(reinterpret_cast<char *>(block));
+#endif
+		munmap(block, block->mapped);
+	} else {
+		std::free(block);
+	}
+}
+
+void MemoryPolicy::advance(const void *addr)
+{
+#ifdef OUTOFCOREDIR
+	const char *ptr = static_cast<const char *>(addr);
+	const int slot  = reinterpret_cast<std::size_t>(ptr) / CHUNK % SEEN;
+	FileBlock *file;
+	char *chunk;
+	std::size_t i;
+
+	if (!window.numFiles)
+		return;
+
+	// the chunk is in the window since the last eviction
+	if (seenEpoch == window.epoch && seen[slot] &&
+		ptr >= seen[slot] && ptr < seen[slot] + CHUNK)
+		return;
+
+	pthread_mutex_lock(&windowMutex);
+	if (seenEpoch != window.epoch) {
+		std::fill(seen, seen + SEEN, static_cast<const char *>(0));
+		seenEpoch = window.epoch;
+	}
+	file = findFile(ptr);
+	if (!file) {
+		// not out of core, remember the surrounding chunk as done
+		seen[slot] = ptr - reinterpret_cast<std::size_t>(ptr) % CHUNK;
+		pthread_mutex_unlock(&windowMutex);
+		return;
+	}
+
+	chunk = file->start + (ptr - file->start) / CHUNK * CHUNK;
+	for (i = 0; i < window.count; ++i)
+		if (window.chunks[(window.first + i) % MAXCHUNKS] == chunk)
+			break;
+	if (i == window.count)
+		pushChunk(file, chunk);
+
+	// an eviction invalidated the cache, the new chunk is valid anyway
+	if (seenEpoch != window.epoch) {
+		std::fill(seen, seen + SEEN, static_cast<const char *>(0));
+		seenEpoch = window.epoch;
+	}
+	seen[slot] = chunk;
+	pthread_mutex_unlock(&windowMutex);
+#else
+	(void)addr;
+#endif
+}
+
+void MemoryPolicy::reserveWindow(std::size_t bytes, unsigned int streams)
+{
+#ifdef OUTOFCOREDIR
+	std::size_t chunks = (bytes + CHUNK - 1) / CHUNK + 2 * streams;
+
+	pthread_mutex_lock(&windowMutex);
+	window.capacity = std::min(std::max(window.capacity, chunks), MAXCHUNKS);
+	pthread_mutex_unlock(&windowMutex);
+#else
+	(void)bytes;
+	(void)streams;
+#endif
+}
+
+void MemoryPolicy::trim()
+{
+#ifdef OUTOFCOREDIR
+	std::size_t i, n;
+
+	pthread_mutex_lock(&windowMutex);
+	n = window.count;
+	for (i = 0; i < n; ++i)
+		scratch[i] = window.chunks[(window.first + i) % MAXCHUNKS];
+	std::sort(scratch, scratch + n);
+
+	// evict the runs of chunks between those in the window
+	for (int f = 0; f < window.numFiles; ++f) {
+		FileBlock *file = &window.files[f];
+		char *end = file->start + file->length;
+		char *pos = file->start;
+		char **chunk = std::lower_bound(scratch, scratch + n, pos);
+
+		while (pos < end) {
+			char *stop = (chunk < scratch + n && *chunk < end) ? *chunk : end;
+
+			if (stop > pos)
+				evict(file, pos, stop - pos);
+			if (stop == end)
+				break;
+			pos = stop + chunkLength(file, stop);
+			++chunk;
+		}
+	}
+	pthread_mutex_unlock(&windowMutex);
+#endif
+}
+
+void MemoryPolicy::print(std::ostream& out)
+{
+	static const char *names[] = { "default", "thp", "hugetlb" };
+	const double mib = 1024.0 * 1024.0;
+	std::size_t thpBacked, pageKiB;
+
+	// what the kernel actually did
+	thpBacked = readKiB("/proc/self/smaps_rollup", "AnonHugePages:");
+	if (stats.hugetlbBytes)
+		pageKiB = readKiB("/proc/meminfo", "Hugepagesize:");
+	else if (thpBacked)
+		pageKiB = HUGEPAGE / 1024;
+	else
+		pageKiB = sysconf(_SC_PAGESIZE) / 1024;
+
+	out << std::fixed << std::setprecision(2)
+		<< "Memory policy: " << names[MEMORYPOLICY];
+	if (NUMANODE >= 0)
+		out << ", bound to NUMA node " << NUMANODE;
+	out << "\n"
+		<< "  mapped blocks     : " << stats.blocks << "\n"
+		<< "  hugetlb pages     : " << stats.hugetlbBytes / mib << " MiB ("
+		<< stats.fallbacks << " fallback(s) to thp)\n"
+		<< "  thp advised       : " << stats.thpBytes / mib << " MiB, "
+		<< thpBacked / 1024.0 << " MiB backed by huge pages\n"
+		<< "  normal pages      : " << stats.plainBytes / mib << " MiB\n";
+#ifdef OUTOFCOREDIR
+	out << "  out of core       : " << stats.fileBytes / mib << " MiB in " << OUTOFCOREDIR
+		<< " (" << stats.fileFailures << " failure(s))\n"
+		<< "  window            : " << window.capacity * CHUNK / mib << " MiB, peak "
+		<< stats.peakChunks * CHUNK / mib << " MiB, "
+		<< stats.evictedBytes / (1024.0 * mib) << " GiB evicted";
+	if (stats.untracked)
+		out << ", " << stats.untracked << " block(s) untracked";
+	out << "\n";
+#endif
+	if (stats.bindFailures)
+		out << "  mbind failures    : " << stats.bindFailures << "\n";
+	out << "  page size         : " << pageKiB << " kB" << std::endl;
+}
+
+/*
+ * Global operator new and delete, every allocation of the
+ * application goes through MemoryPolicy.
+ */
+void *operator new(std::size_t size) THROW_BAD_ALLOC
+{
+	void *ptr = MemoryPolicy::allocate(size);
+
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void *operator new[](std::size_t size) THROW_BAD_ALLOC
+{
+	return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t&) THROW_NOTHING
+{
+	return MemoryPolicy::allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t&) THROW_NOTHING
+{
+	return MemoryPolicy::allocate(size);
+}
+
+void operator delete(void *ptr) THROW_NOTHING
+{
+	MemoryPolicy::deallocate(ptr);
+}
+
+void operator delete[](void *ptr) THROW_NOTHING
+{
+	MemoryPolicy::deallocate(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t&) THROW_NOTHING
+{
+	MemoryPolicy::deallocate(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t&) THROW_NOTHING
+{
+	MemoryPolicy::deallocate(ptr);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void *ptr, std::size_t) THROW_NOTHING
+{
+	MemoryPolicy::deallocate(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) THROW_NOTHING
+{
+	MemoryPolicy::deallocate(ptr);
+}
+#endif
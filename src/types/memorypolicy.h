@@ -0,0 +1,145 @@
+#ifndef _MEMORYPOLICY_H_
+#define _MEMORYPOLICY_H_
+
+#include <cstddef>
+#include <iostream>
+#include <libgeodecomp.h>
+#include <libgeodecomp/io/steerer.h>
+
+/**
+ * @file   memorypolicy.h
+ *
+ * @brief Places large allocations on huge pages and/or a NUMA node.
+ *
+ * The SoA grids are allocated deep inside LibGeoDecomp and LibFlatArray,
+ * so memorypolicy.cpp replaces the global operator new and delete. Every
+ * block gets a small header. Blocks of at least THRESHOLD bytes are mapped
+ * by mmap() with the configured policy:
+ *  - THP:     transparent huge pages, requested by madvise(MADV_HUGEPAGE)
+ *  - HUGETLB: explicit 2 MiB pages (MAP_HUGETLB), falls back to THP if
+ *             no huge pages are reserved (see /proc/sys/vm/nr_hugepages)
+ *  - DEFAULT: normal pages, only used together with a NUMA node
+ * If a NUMA node is given, the mapping is bound to it by mbind() before
+ * it is touched. Smaller blocks, like the arrays of CactusGrid, stay with
+ * malloc(), since they cannot fill a huge page anyway.
+ *
+ * With OUTOFCOREDIR the large blocks are backed by files in that directory
+ * instead (out-of-core). They are streamed through a window of RAM of
+ * OUTOFCOREWINDOW MiB, which is kept explicitly and not left to the page
+ * cache: updateLineX() reports the lines it sweeps by advance(), the
+ * window holds the chunks (2 MiB) touched last, reads the next chunk of
+ * each one ahead and evicts the oldest chunk, i.e. writes it back and
+ * drops it from RAM, once it is full. The window has to hold the planes
+ * the stencil reads around the current one (see reserveWindow()). Pages
+ * touched outside the sweep, like halos, are evicted by trim() after
+ * every step.
+ *
+ * The policy is chosen at generation time by the options memory_policy,
+ * numa_node, out_of_core_dir and out_of_core_window (see Config.pm),
+ * which end up in parameter.h.
+ *
+ */
+class MemoryPolicy
+{
+public:
+	enum Policy {
+		DEFAULT, THP, HUGETLB
+	};
+
+	static const std::size_t THRESHOLD = 2 * 1024 * 1024; /**< smallest mapped block */
+
+	/**
+	 * Allocates a block according to the policy.
+	 *
+	 * @param size bytes
+	 *
+	 * @return block, 0 if out of memory
+	 */
+	static void *allocate(std::size_t size);
+	/**
+	 * Frees a block allocated by allocate().
+	 *
+	 * @param ptr block, may be 0
+	 */
+	static void deallocate(void *ptr);
+	/**
+	 * Out-of-core only: moves the window to the chunk containing addr,
+	 * evicting the oldest chunk if the window is full. Cheap if the chunk
+	 * is in the window already, so it may be called for every line.
+	 *
+	 * @param addr address being swept, ignored if not out-of-core
+	 */
+	static void advance(const void *addr);
+	/**
+	 * Out-of-core only: grows the window to hold at least bytes plus two
+	 * chunks (the current and the next one) for each stream, i.e. each
+	 * array swept at the same time.
+	 *
+	 * @param bytes bytes which have to stay resident, e.g. the planes of
+	 *              the stencil
+	 * @param streams number of arrays swept at the same time
+	 */
+	static void reserveWindow(std::size_t bytes, unsigned int streams);
+	/**
+	 * Out-of-core only: evicts all chunks not in the window.
+	 */
+	static void trim();
+	/**
+	 * Prints the policy, the mapped blocks and the page size actually
+	 * used for them.
+	 *
+	 * @param out stream to print to
+	 */
+	static void print(std::ostream& out);
+};
+
+/**
+ * Steerer which prints the MemoryPolicy report once the grids are
+ * allocated, i.e. on the first step. Only rank 0 prints. Out-of-core
+ * it trims the window after every step.
+ *
+ */
+template<typename CELL_TYPE>
+class MemoryPolicyReport : public LibGeoDecomp::Steerer<CELL_TYPE>
+{
+public:
+	typedef LibGeoDecomp::Steerer<CELL_TYPE> ParentType;
+	typedef typename ParentType::GridType GridType;
+	typedef typename ParentType::CoordType CoordType;
+	typedef typename ParentType::Topology Topology;
+	static const int DIM = Topology::DIM;
+
+	MemoryPolicyReport() :
+		ParentType(1), m_printed(false)
+	{}
+
+	virtual ~MemoryPolicyReport()
+	{}
+
+	virtual void nextStep(
+		GridType *grid,
+		const LibGeoDecomp::Region<DIM>& validRegion,
+		const CoordType& globalDimensions,
+		unsigned step,
+		LibGeoDecomp::SteererEvent event,
+		std::size_t rank,
+		bool lastCall,
+		LibGeoDecomp::SteererFeedback *feedback)
+	{
+		if (!lastCall)
+			return;
+
+		MemoryPolicy::trim();
+		if (m_printed)
+			return;
+
+		m_printed = true;
+		if (rank == 0)
+			MemoryPolicy::print(std::cout);
+	}
+
+private:
+	bool m_printed;				/**< report is printed */
+};
+
+#endif /* _MEMORYPOLICY_H_ */
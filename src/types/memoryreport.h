@@ -0,0 +1,234 @@
+#ifndef _MEMORYREPORT_H_
+#define _MEMORYREPORT_H_
+
+#include <cmath>
+#include <cstddef>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+#include "cactusgrid.h"
+#include "coordview.h"
+
+/**
+ * @file   memoryreport.h
+ *
+ * @brief Estimates the memory used by the grids of a generated application.
+ *
+ * The estimate is computed from the size of the cell (all timelevels of
+ * all grid functions in SoA layout) and cctk_gsh. Each rank holds two
+ * grids (old and new) of its part of the domain plus a halo of the given
+ * width around it. LibFlatArray rounds the storage up to one of the sizes
+ * of the cell in each direction (CELL_TYPE::soaStorageSize()), which is
+ * counted as padding. For more than one rank the extent of the part of
+ * each rank is derived from the partition (see Layout). Irregular parts
+ * are only approximated, those estimates are not checked against a limit.
+ * Coordinates are computed on the fly by CoordView and need no arrays.
+ *
+ */
+template<typename CELL_TYPE>
+class MemoryReport
+{
+public:
+	/**
+	 * Shape of the part of each rank.
+	 */
+	enum Layout {
+		STRIPES,	/**< slabs along the last axis (StripingPartition) */
+		BISECTION,	/**< longest axis halved recursively (RecursiveBisectionPartition) */
+		IRREGULAR	/**< anything else, e.g. ZCurve or load balanced, estimated as BISECTION */
+	};
+private:
+	static const int GRIDS = 2;		/**< old and new grid */
+	std::size_t m_cellBytes;		/**< bytes per cell */
+	double m_cells;					/**< cells per rank */
+	double m_haloCells;				/**< halo cells per rank */
+	double m_paddingCells;			/**< cells added by rounding up the storage */
+	double m_planeCells;			/**< cells of one plane of the storage */
+	std::size_t m_coordBytes;		/**< bytes used for coordinates */
+	unsigned int m_ranks;			/**< number of ranks */
+	bool m_tooLarge;				/**< extent larger than all storage sizes */
+	bool m_approximate;				/**< extent of the parts is only approximated */
+
+	static double toMiB(double bytes)
+	{
+		return bytes / (1024.0 * 1024.0);
+	}
+
+	/**
+	 * Computes the extent of the largest part of a rank.
+	 *
+	 * @param gsh global grid size
+	 * @param dim dimension
+	 * @param layout shape of the parts
+	 * @param extent array where to store the extent
+	 */
+	void partExtent(const int *gsh, unsigned int dim, Layout layout, double *extent)
+	{
+		unsigned int i, longest, ranks;
+
+		for (i = 0; i < dim; ++i)
+			extent[i] = gsh[i];
+
+		// one slab of the last axis per rank
+		if (layout == STRIPES) {
+			extent[dim - 1] = std::ceil(extent[dim - 1] / m_ranks);
+			return;
+		}
+
+		// halve the longest axis, the larger half gets the extra rank
+		for (ranks = m_ranks; ranks > 1; ranks = (ranks + 1) / 2) {
+			longest = 0;
+			for (i = 1; i < dim; ++i)
+				if (extent[i] > extent[longest])
+					longest = i;
+			extent[longest] = std::ceil(extent[longest] * ((ranks + 1) / 2) / ranks);
+		}
+	}
+
+	/**
+	 * Rounds an extent up to the storage size of LibFlatArray.
+	 *
+	 * @param dir direction
+	 * @param extent extent including halo
+	 *
+	 * @return storage size, extent if there is none
+	 */
+	double storageSize(unsigned int dir, double extent)
+	{
+		int size = CELL_TYPE::soaStorageSize(dir, static_cast<int>(std::ceil(extent)));
+
+		if (!size) {
+			m_tooLarge = true;
+			return extent;
+		}
+		return size;
+	}
+public:
+	/**
+	 * Constructor. Computes the estimate.
+	 *
+	 * @param cctkGH cactus grid hierarchy, cctk_gsh has to be set up
+	 * @param haloWidth width of the halo around the part of each rank
+	 * @param ranks number of ranks the grid is distributed to
+	 * @param layout shape of the part of each rank, unused for one rank
+	 */
+	MemoryReport(const CactusGrid *cctkGH, unsigned int haloWidth, unsigned int ranks = 1,
+				 Layout layout = BISECTION) :
+		m_cellBytes(sizeof(CELL_TYPE)), m_cells(1), m_haloCells(0), m_paddingCells(0),
+		m_planeCells(1), m_coordBytes(3 * sizeof(CoordView)), m_ranks(ranks ? ranks : 1), m_tooLarge(false),
+		m_approximate(m_ranks > 1 && layout == IRREGULAR)
+	{
+		unsigned int dim = cctkGH->cctk_dim();
+		std::vector<double> extent(dim);
+		double withHalo, storage;
+		unsigned int i;
+
+		partExtent(cctkGH->cctk_gsh(), dim, layout, &extent[0]);
+
+		withHalo = 1;
+		storage  = 1;
+		for (i = 0; i < dim; ++i) {
+			m_cells  *= extent[i];
+			extent[i] += 2.0 * haloWidth;
+			withHalo *= extent[i];
+			storage  *= storageSize(i, extent[i]);
+			if (i + 1 < dim)
+				m_planeCells = storage;
+		}
+		m_haloCells    = withHalo - m_cells;
+		m_paddingCells = storage - withHalo;
+	}
+
+	/**
+	 * @return bytes per cell
+	 */
+	std::size_t cellBytes() const
+	{
+		return m_cellBytes;
+	}
+
+	/**
+	 * @return bytes of the grids per rank without halo
+	 */
+	double gridBytes() const
+	{
+		return GRIDS * m_cells * m_cellBytes;
+	}
+
+	/**
+	 * @return bytes of the halos per rank
+	 */
+	double haloBytes() const
+	{
+		return GRIDS * m_haloCells * m_cellBytes;
+	}
+
+	/**
+	 * @return bytes per rank added by rounding up the storage
+	 */
+	double paddingBytes() const
+	{
+		return GRIDS * m_paddingCells * m_cellBytes;
+	}
+
+	/**
+	 * @return bytes of one plane (all axes but the last) of one grid
+	 *         including halo and padding, the unit the grids are swept in
+	 */
+	double planeBytes() const
+	{
+		return m_planeCells * m_cellBytes;
+	}
+
+	/**
+	 * @return bytes per rank in total
+	 */
+	double totalBytes() const
+	{
+		return gridBytes() + haloBytes() + paddingBytes() + m_coordBytes;
+	}
+
+	/**
+	 * @return true if the extent of the parts is only approximated
+	 */
+	bool approximate() const
+	{
+		return m_approximate;
+	}
+
+	/**
+	 * Checks the total against a limit. Approximated estimates always
+	 * fit, a run is not refused on a guess.
+	 *
+	 * @param limitMiB limit per rank in MiB, 0 means no limit
+	 *
+	 * @return true if the total fits into the limit, else false
+	 */
+	bool fits(unsigned int limitMiB) const
+	{
+		return limitMiB == 0 || m_approximate || toMiB(totalBytes()) <= limitMiB;
+	}
+
+	/**
+	 * Prints the report.
+	 *
+	 * @param out stream to print to
+	 */
+	void print(std::ostream& out) const
+	{
+		out << std::fixed << std::setprecision(2)
+			<< "Memory estimate per rank (" << m_ranks << " rank(s)):\n"
+			<< "  bytes per cell    : " << m_cellBytes << "\n"
+			<< "  grids (old + new) : " << toMiB(gridBytes()) << " MiB\n"
+			<< "  halo              : " << toMiB(haloBytes()) << " MiB\n"
+			<< "  storage padding   : " << toMiB(paddingBytes()) << " MiB\n"
+			<< "  coordinates       : " << m_coordBytes << " bytes (computed on the fly)\n"
+			<< "  total             : " << toMiB(totalBytes()) << " MiB" << std::endl;
+		if (m_tooLarge)
+			out << "  the grid is larger than the storage sizes of the cell" << std::endl;
+		if (m_approximate)
+			out << "  the parts of the ranks are irregular, the estimate is approximate" << std::endl;
+	}
+};
+
+#endif /* _MEMORYREPORT_H_ */
@@ -4,15 +4,62 @@
 #include <libflatarray/short_vec.hpp>
 
 /**
- * Wrapper class for SoA variables to do a vector read.
+ * Helper class for loading and storing vectors from memory of
+ * a different type (STORAGE), e.g. past timelevels stored
+ * in single precision. Values are converted element wise.
+ */
+template<typename TYPE, int ARITY, typename STORAGE>
+class VecConvert
+{
+public:
+	static inline
+	void load(LibFlatArray::short_vec<TYPE, ARITY>& buf, const STORAGE *data)
+	{
+		TYPE tmp[ARITY];
+		for (int i = 0; i < ARITY; ++i)
+			tmp[i] = data[i];
+		buf = tmp;
+	}
+	static inline
+	void store(STORAGE *data, const LibFlatArray::short_vec<TYPE, ARITY>& buf)
+	{
+		TYPE tmp[ARITY];
+		&tmp[0] << buf;
+		for (int i = 0; i < ARITY; ++i)
+			data[i] = tmp[i];
+	}
+};
+
+/**
+ * Same types, no conversion needed.
  */
 template<typename TYPE, int ARITY>
+class VecConvert<TYPE, ARITY, TYPE>
+{
+public:
+	static inline
+	void load(LibFlatArray::short_vec<TYPE, ARITY>& buf, const TYPE *data)
+	{
+		buf = data;
+	}
+	static inline
+	void store(TYPE *data, const LibFlatArray::short_vec<TYPE, ARITY>& buf)
+	{
+		data << buf;
+	}
+};
+
+/**
+ * Wrapper class for SoA variables to do a vector read.
+ * STORAGE is the type of the SoA variable, it gets converted to TYPE.
+ */
+template<typename TYPE, int ARITY, typename STORAGE = TYPE>
 class VecRead
 {
 private:
-	const TYPE *m_data;
+	const STORAGE *m_data;
 public:
-	VecRead(const TYPE *data) :
+	VecRead(const STORAGE *data) :
 		m_data(data)
 	{}
 	inline
@@ -20,23 +67,24 @@ public:
 	{
 		LibFlatArray::short_vec<TYPE, ARITY> buf;
 		// load vector
-		buf = m_data + index;
+		VecConvert<TYPE, ARITY, STORAGE>::load(buf, m_data + index);
 		return buf;
 	}
 };
 
 /**
  * Wrapper class for SoA variables to do a vector write.
+ * STORAGE is the type of the SoA variable, TYPE gets converted to it.
  */
-template<typename TYPE, int ARITY>
+template<typename TYPE, int ARITY, typename STORAGE = TYPE>
 class VecWrite
 {
 private:
-	TYPE *m_data;
+	STORAGE *m_data;
 	int m_index;
 public:
 	inline
-	VecWrite(TYPE *data) :
+	VecWrite(STORAGE *data) :
 		m_data(data), m_index(0)
 	{}
 	inline
@@ -50,24 +98,142 @@ public:
 	VecWrite& operator= (const LibFlatArray::short_vec<TYPE, ARITY>& buf)
 	{
 		// store vector
-		(m_data + m_index) << buf;
+		VecConvert<TYPE, ARITY, STORAGE>::store(m_data + m_index, buf);
+		return *this;
+	}
+};
+
+/**
+ * Wrapper class for SoA variables of all ensemble members to do a
+ * vector read. Lane l is read from the variable of member l, which is
+ * set by lane(). STORAGE is the type of the SoA variable, it gets
+ * converted to TYPE.
+ */
+template<typename TYPE, int ARITY, typename STORAGE = TYPE>
+class VecGather
+{
+private:
+	const STORAGE *m_data[ARITY];
+public:
+	inline
+	void lane(int l, const STORAGE *data)
+	{
+		m_data[l] = data;
+	}
+	inline
+	LibFlatArray::short_vec<TYPE, ARITY> operator[] (int index)
+	{
+		LibFlatArray::short_vec<TYPE, ARITY> buf;
+		TYPE tmp[ARITY];
+		// gather lanes
+		for (int l = 0; l < ARITY; ++l)
+			tmp[l] = m_data[l][index];
+		buf = tmp;
+		return buf;
+	}
+};
+
+/**
+ * Wrapper class for SoA variables of all ensemble members to do a
+ * vector write. Lane l is written to the variable of member l, which
+ * is set by lane(). STORAGE is the type of the SoA variable, TYPE gets
+ * converted to it.
+ */
+template<typename TYPE, int ARITY, typename STORAGE = TYPE>
+class VecScatter
+{
+private:
+	STORAGE *m_data[ARITY];
+	int m_index;
+public:
+	inline
+	VecScatter() :
+		m_index(0)
+	{}
+	inline
+	void lane(int l, STORAGE *data)
+	{
+		m_data[l] = data;
+	}
+	inline
+	VecScatter& operator[] (int index)
+	{
+		// save index
+		m_index = index;
+		return *this;
+	}
+	inline
+	VecScatter& operator= (const LibFlatArray::short_vec<TYPE, ARITY>& buf)
+	{
+		TYPE tmp[ARITY];
+		// scatter lanes
+		&tmp[0] << buf;
+		for (int l = 0; l < ARITY; ++l)
+			m_data[l][m_index] = tmp[l];
 		return *this;
 	}
 };
 
+/**
+ * Loads one value per lane, e.g. the values of a parameter for all
+ * ensemble members.
+ *
+ * @param lanes array of VEC::ARITY values
+ *
+ * @return vector holding lanes[l] in lane l
+ */
+template<typename VEC, typename TYPE>
+inline
+VEC vecLanes(const TYPE *lanes)
+{
+	VEC buf;
+	buf = lanes;
+	return buf;
+}
+
+/**
+ * Type of a scalar operand of the operators below. It is not deduced,
+ * so any arithmetic type (e.g. the int in 2 * vec) is converted to TYPE.
+ */
+template<typename TYPE>
+struct VecScalar
+{
+	typedef TYPE Type;
+};
+
 /**
  * The following code does operator overloading for missing operators.
  */
 template<typename TYPE, int ARITY>
 inline
-LibFlatArray::short_vec<TYPE, ARITY> operator* (TYPE scalar, const LibFlatArray::short_vec<TYPE, ARITY>& vec)
+LibFlatArray::short_vec<TYPE, ARITY> operator+ (typename VecScalar<TYPE>::Type scalar,
+												const LibFlatArray::short_vec<TYPE, ARITY>& vec)
+{
+	return vec + scalar;
+}
+
+template<typename TYPE, int ARITY>
+inline
+LibFlatArray::short_vec<TYPE, ARITY> operator- (typename VecScalar<TYPE>::Type scalar,
+												const LibFlatArray::short_vec<TYPE, ARITY>& vec)
+{
+	LibFlatArray::short_vec<TYPE, ARITY> buf = scalar;
+	buf -= vec;
+	return buf;
+}
+
+template<typename TYPE, int ARITY>
+inline
+LibFlatArray::short_vec<TYPE, ARITY> operator* (typename VecScalar<TYPE>::Type scalar,
+												const LibFlatArray::short_vec<TYPE, ARITY>& vec)
 {
 	return vec * scalar;
 }
 
 template<typename TYPE, int ARITY>
 inline
-LibFlatArray::short_vec<TYPE, ARITY> operator/ (TYPE scalar, const LibFlatArray::short_vec<TYPE, ARITY>& vec)
+LibFlatArray::short_vec<TYPE, ARITY> operator/ (typename VecScalar<TYPE>::Type scalar,
+												const LibFlatArray::short_vec<TYPE, ARITY>& vec)
 {
 	LibFlatArray::short_vec<TYPE, ARITY> buf = scalar;
 	buf /= vec;